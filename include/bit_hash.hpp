@@ -7,11 +7,16 @@
 #include <iostream>
 #include <set>
 #include <random>
+#include <functional>
+#include <unordered_map>
 
 #include "shuffle.hpp"
 #include "bit_vector.hpp"
 #include "key_value_set.hpp"
 
+template<class THash>
+std::vector<bit_vector> find_stash_of(const THash &h, const key_value_set &keys, unsigned groupSize=1);
+
 struct BitHash
 {
   struct table
@@ -103,8 +108,13 @@ struct BitHash
   unsigned wO;
   std::vector<table> tables;
 
+  /* Optional XOR level in front of the tables (see premix.hpp). If it is
+     not empty, mixed bit j is the parity of the key bits in premix[j], and
+     the tables select mixed bits rather than key bits. */
+  std::vector<std::vector<unsigned> > premix;
+
     bool operator==(const BitHash &o) const
-    { return wI==o.wI && wO==o.wO && tables==o.tables; }
+    { return wI==o.wI && wO==o.wO && tables==o.tables && premix==o.premix; }
 
     bool operator<(const BitHash &o) const {
         if (wI < o.wI) return true;
@@ -118,7 +128,7 @@ struct BitHash
                 return false;
         }
 
-        return false;
+        return premix < o.premix;
     }
 
     void print(std::ostream &dst, std::string prefix="") const
@@ -128,14 +138,60 @@ struct BitHash
         for(unsigned i=0;i<tables.size();i++){
             tables[i].print(dst,i,prefix+"  ");
         }
+        if(!premix.empty()){
+            dst<<prefix<<"  premix "<<premix.size()<<"\n";
+            for(unsigned j=0;j<premix.size();j++){
+                dst<<prefix<<"    mix "<<j<<" "<<premix[j].size()<<" sel";
+                for(unsigned b : premix[j]){
+                    dst<<" "<<b;
+                }
+                dst<<"\n";
+            }
+        }
         dst<<prefix<<"BitHashEnd\n";
     }
 
+    //! The key as seen by the tables, which is just x without a premix
+    unsigned mix(unsigned x) const
+    {
+        if(premix.empty())
+            return x;
+        unsigned res=0;
+        for(unsigned j=0;j<premix.size();j++){
+            unsigned bit=0;
+            for(unsigned b : premix[j]){
+                bit ^= (x>>b)&1;
+            }
+            res |= bit<<j;
+        }
+        return res;
+    }
+
+    //! As mix(unsigned), where a mixed bit is -1 if any of its inputs are
+    bit_vector mix(const bit_vector &x) const
+    {
+        if(premix.empty())
+            return x;
+        std::vector<int> res(premix.size());
+        for(unsigned j=0;j<premix.size();j++){
+            int bit=0;
+            for(unsigned b : premix[j]){
+                int v=x[b];
+                bit = (bit==-1 || v==-1) ? -1 : (bit^v);
+            }
+            res[j]=bit;
+        }
+        return bit_vector(res);
+    }
+
   unsigned operator()(unsigned x) const
   {
       assert(x<(1u<<wI));
       assert(wO==tables.size());
 
+      if(!premix.empty())
+          x=mix(x);
+
       unsigned acc=0;
       for(unsigned i=0;i<wO;i++){
           int bit=tables[i](x);
@@ -150,9 +206,12 @@ struct BitHash
         assert(x.size()<(1u<<wI));
         assert(wO==tables.size());
 
+        bit_vector mixed;
+        const bit_vector &k = premix.empty() ? x : (mixed=mix(x));
+
         unsigned acc=0;
         for(unsigned i=0;i<wO;i++){
-            int bit=tables[i](x);
+            int bit=tables[i](k);
             assert((bit==0)||(bit==1)); // Don't allow unknowns here
             acc=acc|(unsigned(bit)<<i);
         }
@@ -167,9 +226,93 @@ struct BitHash
         }
     }
 
-    bool is_solution(const key_value_set &keys) const
+    /*! Keys which do not fit in the hash, and so would need to live in a
+        separate stash (CAM). The first groupSize keys in each hash (in key
+        order) are kept, and everything else is stashed, as are keys which
+        are above the maxHash or whose variants don't agree. */
+    std::vector<bit_vector> find_stash(const key_value_set &keys, unsigned groupSize=1) const
+    {
+        return find_stash_of(*this, keys, groupSize);
+    }
+
+    /*! A lower bound on find_stash(keys,groupSize).size() for any lut
+        contents, looking only at the selectors. Keys which read the same
+        address in every table of a subset T of the tables can only differ
+        in the other wO-|T| hash bits, so at most groupSize*2^(wO-|T|) of
+        them fit. Subsets are visited depth first, with each one refining
+        the classes of its parent, and only keys in classes bigger than
+        groupSize are carried down. Ternary keys are represented by their
+        first variant. */
+    unsigned stash_lower_bound(const key_value_set &keys, unsigned groupSize=1) const
+    {
+        std::vector<std::vector<unsigned> > addr(wO);
+        for(const auto &kv : keys){
+            auto k=mix(*kv.first.variants_begin());
+            for(unsigned ti=0; ti<wO; ti++){
+                addr[ti].push_back(tables[ti].address(k));
+            }
+        }
+
+        unsigned best=0;
+
+        // live[i] is a key index, and cls[i] the class it is in
+        std::function<void(const std::vector<unsigned>&,const std::vector<unsigned>&,unsigned,unsigned)> refine;
+        refine=[&](const std::vector<unsigned> &live, const std::vector<unsigned> &cls, unsigned nextTable, unsigned depth)
+        {
+            std::unordered_map<uint64_t,unsigned> ids;
+            std::vector<unsigned> sizes, childCls(live.size());
+            std::vector<unsigned> nextLive, nextCls;
+            for(unsigned ti=nextTable; ti<wO; ti++){
+                ids.clear();
+                sizes.clear();
+                for(unsigned i=0; i<live.size(); i++){
+                    uint64_t key=(uint64_t(cls[i])<<32) | addr[ti][live[i]];
+                    auto ins=ids.insert(std::make_pair(key, (unsigned)sizes.size()));
+                    if(ins.second)
+                        sizes.push_back(0);
+                    childCls[i]=ins.first->second;
+                    sizes[childCls[i]]++;
+                }
+
+                unsigned cap=groupSize<<(wO-depth-1), excess=0;
+                for(unsigned s : sizes){
+                    excess += s>cap ? s-cap : 0;
+                }
+                best=std::max(best, excess);
+
+                nextLive.clear();
+                nextCls.clear();
+                for(unsigned i=0; i<live.size(); i++){
+                    if(sizes[childCls[i]]>groupSize){
+                        nextLive.push_back(live[i]);
+                        nextCls.push_back(childCls[i]);
+                    }
+                }
+                if(!nextLive.empty()){
+                    refine(nextLive, nextCls, ti+1, depth+1);
+                }
+            }
+        };
+
+        std::vector<unsigned> live(keys.keys_size());
+        for(unsigned i=0; i<live.size(); i++){
+            live[i]=i;
+        }
+        if(live.size()>groupSize){
+            refine(live, std::vector<unsigned>(live.size(), 0), 0, 0);
+        }
+        return best;
+    }
+
+    //! Check that no more than groupSize keys share any hash, apart from
+    //! up to keys.getMaxStash() keys which can go in the stash
+    bool is_solution(const key_value_set &keys, unsigned groupSize=1) const
     {
-        std::set<unsigned> hits;
+        if(keys.getMaxStash()>0)
+            return find_stash(keys, groupSize).size() <= keys.getMaxStash();
+
+        std::map<unsigned,unsigned> hits;
+        unsigned maxHash=keys.getMaxHash();
 
         for(const auto &kv : keys){
             const auto &k=kv.first;
@@ -178,8 +321,10 @@ struct BitHash
             unsigned h=(*this)(*it);
             //std::cerr<<"  "<<k<<" : "<<h<<"\n";
 
-            auto i=hits.insert(h);
-            if(!i.second)
+            if(maxHash>0 && h>=maxHash)
+                return false;
+
+            if(++hits[h] > groupSize)
                 return false;
 
             ++it;
@@ -194,11 +339,11 @@ struct BitHash
         return true;
     }
 
-    std::vector<int> distance(const BitHash &bh) const
+    int distance(const BitHash &bh) const
     {
         int d=0;
         for(unsigned i=0; i<bh.tables.size(); i++){
-            assert(tables[i].taps==bh.tables[i].taps);
+            assert(tables[i].selectors==bh.tables[i].selectors);
             const auto &ta=tables[i].lut;
             const auto &tb=bh.tables[i].lut;
             for(unsigned j=0; j<ta.size(); j++){
@@ -209,6 +354,52 @@ struct BitHash
     }
 };
 
+/*! BitHash::find_stash for any hash with operator()(const bit_vector &),
+    for the structures built on top of BitHash and for BitHash itself. */
+template<class THash>
+std::vector<bit_vector> find_stash_of(const THash &h, const key_value_set &keys, unsigned groupSize)
+{
+    std::vector<bit_vector> res;
+    std::map<unsigned,unsigned> hits;
+    unsigned maxHash=keys.getMaxHash();
+
+    for(const auto &kv : keys){
+        const auto &k=kv.first;
+
+        auto it=k.variants_begin();
+        unsigned hv=h(*it);
+
+        bool ok = !(maxHash>0 && hv>=maxHash);
+
+        ++it;
+        auto end=k.variants_end();
+        while(ok && it!=end){
+            ok = h(*it)==hv;
+            ++it;
+        }
+
+        if(ok && hits[hv]<groupSize){
+            hits[hv]++;
+        }else{
+            res.push_back(k);
+        }
+    }
+    return res;
+}
+
+/*! The stash a hardware writer has to build, which must fit in what the
+    keys allow. Anything bigger means the hash is not a solution, and would
+    otherwise turn into an arbitrarily long chain of direct compares. */
+template<class THash>
+std::vector<bit_vector> find_checked_stash(const THash &h, const key_value_set &keys, unsigned groupSize=1)
+{
+    auto res=h.find_stash(keys, groupSize);
+    if(res.size() > keys.getMaxStash()){
+        throw std::runtime_error("Hash leaves "+std::to_string(res.size())+" keys to stash, but only "
+            +std::to_string(keys.getMaxStash())+" are allowed (check --stash and --group-size match the solve).");
+    }
+    return res;
+}
 
 uint64_t hashForLutEntry(unsigned lutIndex, unsigned lutOffset, int value )
 {
@@ -248,44 +439,69 @@ uint64_t hash(const BitHash &bh)
     return acc;
 }
 
-BitHash parse_bit_hash(std::istream &src)
+//! Read the next word, which must be str, and give back src for the fields after it
+std::istream &expect_token(std::istream &src, const char *str)
 {
-    auto expect=[&](const char *str) -> std::istream &
-    {
-        std::string tmp;
-        src>>tmp;
-        if(tmp.empty() || tmp!=str)
-            throw std::runtime_error(std::string("Expected string '")+str+"' but got '"+tmp+"'");
-        return src;
-    };
+    std::string tmp;
+    src>>tmp;
+    if(tmp.empty() || tmp!=str)
+        throw std::runtime_error(std::string("Expected string '")+str+"' but got '"+tmp+"'");
+    return src;
+}
 
+BitHash parse_bit_hash(std::istream &src)
+{
     BitHash res;
 
-    expect("BitHashBegin")>>res.wO>>res.wI;
+    expect_token(src, "BitHashBegin")>>res.wO>>res.wI;
     for(unsigned i=0;i<res.wO;i++){
         res.tables.push_back(BitHash::table{});
         auto &t = res.tables.back();
         unsigned idx, wa;
-        expect("table")>>idx>>wa;
+        expect_token(src, "table")>>idx>>wa;
         if(idx!=i)
             throw std::runtime_error("Persisted bit hash is corrupt.");
 
         t.selectors.resize(wa);
         t.lut.resize(1<<wa);
 
-        expect("sel");
+        expect_token(src, "sel");
 
         for(unsigned j=0;j<t.selectors.size();j++){
             src>>t.selectors[j];
         }
 
         bit_vector bv;
-        expect("lut")>>bv;
+        expect_token(src, "lut")>>bv;
         for(unsigned j=0;j<t.lut.size();j++){
             t.lut[j]=bv[j];
         }
     }
-    expect("BitHashEnd");
+
+    // The premix is optional, so the next word is either premix or the end
+    std::string tmp;
+    src>>tmp;
+    if(tmp=="premix"){
+        unsigned wM;
+        src>>wM;
+        res.premix.resize(wM);
+        for(unsigned j=0;j<wM;j++){
+            unsigned idx, n;
+            expect_token(src, "mix")>>idx>>n;
+            if(idx!=j)
+                throw std::runtime_error("Persisted bit hash is corrupt.");
+            expect_token(src, "sel");
+            res.premix[j].resize(n);
+            for(unsigned k=0;k<n;k++){
+                src>>res.premix[j][k];
+                if(res.premix[j][k]>=res.wI)
+                    throw std::runtime_error("Persisted bit hash is corrupt.");
+            }
+        }
+        src>>tmp;
+    }
+    if(tmp!="BitHashEnd")
+        throw std::runtime_error("Expected string 'BitHashEnd' but got '"+tmp+"'");
 
     return res;
 }
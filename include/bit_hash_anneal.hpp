@@ -19,9 +19,27 @@
  *
  * - A per-key entry containing the current hash
  *
- * - A per-hash entry containing the current count of keys that map to it
+ * - A per-hash entry containing the current count of good keys that map
+ *   to it, where a key is good if it is in range and all of its variants
+ *   agree (see below)
  *
  * - A histogram of the number of hash with each collision cout
+ *
+ * - A per-hash list of the keys currently in it, plus a list of the
+ *   hashes that currently hold more than one key, so that collisions
+ *   can be found without scanning
+ *
+ * - A list of the keys whose hash is not below kvs.getMaxHash(), so that
+ *   minimal (or partially minimal) hashes can be searched for
+ *
+ * Ternary keys are expanded into their concrete variants. The first variant
+ * of each key represents it in everything above, while the other variants
+ * are tracked separately, along with the ones which currently hash
+ * differently from their representative.
+ *
+ * The score is the number of keys find_stash would give, less the stash
+ * that kvs allows: every key which is out of range or has a disagreeing
+ * variant, plus the good keys beyond groupSize in each hash.
  */
 struct EntryToKey
 {
@@ -35,7 +53,7 @@ struct EntryToKey
         int *pBit;     // Direct pointer into table entries
         unsigned mask; // This is what will be added or removed for each
         std::vector<unsigned> keys; // Offsets of all keys that depend on this
-
+        std::vector<unsigned> variants; // Offsets of all extra variants that depend on this
     };
     std::vector<bit_info> bits;
     std::vector<unsigned> keys;
@@ -44,18 +62,46 @@ struct EntryToKey
     std::vector<bool> packedBits;
     double currScore;
 
+    std::vector<unsigned> keyBits; // keyBits[ki*wO+ti] is the bit used by key ki in table ti
+    std::vector<std::vector<unsigned> > buckets; // Maps: Hash -> Keys in hash
+    std::vector<unsigned> bucketPos; // Offset of each key within its bucket
+    std::vector<unsigned> shared; // Hashes which contain more than one key
+    std::vector<int> sharedPos; // Offset of each hash within shared, or -1
+
+    std::vector<unsigned> tableBase; // Index of the first bit of each table
+    std::vector<bit_vector> keyValues; // Concrete representative of each key, needed when selectors change
+    std::vector<bit_vector> groupValues; // The original (possibly ternary) key
+
+    // Variants of ternary keys other than the representative
+    std::vector<bit_vector> variantValues;
+    std::vector<unsigned> variantKey; // Key index that each variant belongs to
+    std::vector<unsigned> variantHashes; // Current hash of each variant
+    std::vector<unsigned> variantBits; // variantBits[vi*wO+ti] is the bit used by variant vi in table ti
+    std::vector<std::vector<unsigned> > keyVariants; // Maps: Key -> Variants
+    std::vector<unsigned> disagree; // Variants which currently hash differently to their key
+    std::vector<int> disagreePos; // Offset of each variant within disagree, or -1
+
+    unsigned hashLimit; // Keys must have hashes strictly less than this
+    std::vector<unsigned> outOfRange; // Keys with hash >= hashLimit
+    std::vector<int> outOfRangePos; // Offset of each key within outOfRange, or -1
+
+    std::vector<unsigned> keyDisagree; // Number of disagreeing variants of each key
+    std::vector<bool> keyGood; // Whether each key is currently counted in hashes
+    unsigned nBad; // Keys which are not good, so must be stashed
+
     EntryToKey(BitHash &_bh, const key_value_set &_kvs)
         : bh(_bh)
         , kvs(_kvs)
     {
-        // Build the linear entries, plus a mapping of (ti,li) to bit index
-        std::map<std::pair<unsigned,unsigned>, unsigned> pairToBit;
+        if(!bh.premix.empty())
+            throw std::runtime_error("EntryToKey : hash has a premix, so use premixKeys of the keys instead.");
 
+        // Build the linear entries. Each table occupies a contiguous range of bits
         unsigned ti=0;
         for(auto &t : bh.tables){
+            tableBase.push_back(bits.size());
             unsigned li=0;
             for(int & i : t.lut){
-                pairToBit[std::make_pair(ti, li)] = bits.size();
                 bit_info b;
                 b.table=ti;
                 b.offset=li;
@@ -67,25 +113,35 @@ struct EntryToKey
             ti++;
         }
 
-        hashes.resize(1<<bh.wO); // Maps:  Hash -> NumKeysInHash
-        // Work out which entries are affected by each bit
-
         for (const auto &kv : kvs) {
-            unsigned ki = keys.size();
+            unsigned ki=keyValues.size();
+            auto it=kv.first.variants_begin();
+            keyValues.push_back(*it);
+            groupValues.push_back(kv.first);
+            keyVariants.push_back(std::vector<unsigned>());
+            ++it;
+            for(auto end=kv.first.variants_end(); it!=end; ++it){
+                keyVariants[ki].push_back(variantValues.size());
+                variantValues.push_back(*it);
+                variantKey.push_back(ki);
+            }
+        }
+        variantHashes.resize(variantValues.size());
+        variantBits.resize(variantValues.size()*bh.wO);
+        disagreePos.resize(variantValues.size());
+        keyDisagree.resize(keyValues.size());
+        keyGood.resize(keyValues.size());
 
-            // Loop over each output bit (i.e. lut output)
-            for (unsigned ti = 0; ti < bh.wO; ti++) {
-                // Find the address of the selected bit within the lut.
-                unsigned li = bh.tables[ti].address(kv.first); // Implies concrete key
+        hashes.resize(1<<bh.wO); // Maps:  Hash -> NumKeysInHash
+        keys.resize(keyValues.size());
+        keyBits.resize(keyValues.size()*bh.wO);
 
-                unsigned bi = pairToBit.at(std::make_pair(ti, li));
-                bits.at(bi).keys.push_back(ki);
-            }
+        buckets.resize(1<<bh.wO);
+        bucketPos.resize(keys.size());
+        sharedPos.resize(1<<bh.wO);
 
-            unsigned h = bh(kv.first);
-            keys.push_back(h);
-            hashes.at(h)++;
-        }
+        hashLimit=getHashLimit(bh, kvs);
+        outOfRangePos.resize(keys.size());
         //fprintf(stderr, "  nKeys = %u, sumHashes=%u", (unsigned)keys.size(), std::accumulate(hashes.begin(),hashes.end(),0));
 
 #if 0
@@ -142,26 +198,46 @@ struct EntryToKey
             c=0;
         }
 
+        // The selectors may have changed too, so work out which keys use each bit
+        for(unsigned ti=0; ti<bh.wO; ti++){
+            linkTable(ti);
+        }
+
         for(unsigned i=0;i<bitCount();i++){
             auto &bi = bits[i];
             bits[i].pBit=&bh.tables[bi.table].lut[bi.offset];
             packedBits[i] = *bits[i].pBit;
         }
 
-        unsigned ki=0;
-        for (const auto &kv : kvs) {
-            unsigned h = bh(kv.first);
+        for(auto &b : buckets){
+            b.clear();
+        }
+        shared.clear();
+        std::fill(sharedPos.begin(), sharedPos.end(), -1);
+        outOfRange.clear();
+        std::fill(outOfRangePos.begin(), outOfRangePos.end(), -1);
+
+        // Every hash starts empty, and every key starts off bad
+        counts.assign(1, hashes.size());
+        std::fill(keyGood.begin(), keyGood.end(), false);
+        std::fill(keyDisagree.begin(), keyDisagree.end(), 0);
+        nBad=keyValues.size();
+
+        for (unsigned ki=0; ki<keyValues.size(); ki++) {
+            unsigned h = bh(keyValues[ki]);
             keys[ki]=h;
-            hashes.at(h)++;
-            ki++;
+            bucketAdd(ki);
+        }
+
+        disagree.clear();
+        std::fill(disagreePos.begin(), disagreePos.end(), -1);
+        for (unsigned vi=0; vi<variantValues.size(); vi++) {
+            variantHashes[vi]=bh(variantValues[vi]);
+            updateDisagree(vi);
         }
 
-        // Work out how many hashes have the same count
-        counts.resize(0); // Start off empty
-        for (auto c : hashes) {
-            if (c >= counts.size())
-                counts.resize(c + 1);
-            counts[c]++;
+        for (unsigned ki=0; ki<keyValues.size(); ki++) {
+            updateGood(ki);
         }
 
         assert(evalFull(bh,kvs)==eval());
@@ -170,10 +246,195 @@ struct EntryToKey
     unsigned bitCount() const
     { return bits.size(); }
 
+    unsigned keyCount() const
+    { return keys.size(); }
+
     const std::vector<bool> &getBits() const
     {return packedBits; }
 
+    //! Index of the lut bit which key ki currently reads from table ti
+    unsigned getKeyBit(unsigned ki, unsigned ti) const
+    { return keyBits[ki*bh.wO+ti]; }
+
+    //! The key itself for key index ki, which may be ternary
+    const bit_vector &getKey(unsigned ki) const
+    { return groupValues[ki]; }
+
+    //! Variants (other than the representative) which hash differently to their key
+    const std::vector<unsigned> &getDisagreeingVariants() const
+    { return disagree; }
+
+    //! Key index which variant vi belongs to
+    unsigned getVariantKey(unsigned vi) const
+    { return variantKey[vi]; }
+
+    //! Current hash of variant vi
+    unsigned getVariantHash(unsigned vi) const
+    { return variantHashes[vi]; }
+
+    //! Index of the lut bit which variant vi currently reads from table ti
+    unsigned getVariantBit(unsigned vi, unsigned ti) const
+    { return variantBits[vi*bh.wO+ti]; }
+
+    //! All keys which currently map to hash h
+    const std::vector<unsigned> &getBucket(unsigned h) const
+    { return buckets[h]; }
+
+    //! All hashes which currently contain more than one key
+    const std::vector<unsigned> &getSharedHashes() const
+    { return shared; }
+
+    //! All keys which currently have a hash >= kvs.getMaxHash()
+    const std::vector<unsigned> &getOutOfRangeKeys() const
+    { return outOfRange; }
+
+    //! Exclusive upper bound on hashes, which is 2^wO if maxHash is not set
+    static unsigned getHashLimit(const BitHash &bh, const key_value_set &kvs)
+    {
+        unsigned m=kvs.getMaxHash();
+        if(m==0 || m>(1u<<bh.wO))
+            return 1u<<bh.wO;
+        return m;
+    }
+
+private:
+    void bucketAdd(unsigned ki)
+    {
+        unsigned h=keys[ki];
+        auto &b=buckets[h];
+        bucketPos[ki]=b.size();
+        b.push_back(ki);
+        if(b.size()==2){
+            sharedPos[h]=shared.size();
+            shared.push_back(h);
+        }
+        if(h>=hashLimit){
+            outOfRangePos[ki]=outOfRange.size();
+            outOfRange.push_back(ki);
+        }
+    }
+
+    void bucketRemove(unsigned ki)
+    {
+        unsigned h=keys[ki];
+        auto &b=buckets[h];
+        unsigned last=b.back();
+        b[bucketPos[ki]]=last;
+        bucketPos[last]=bucketPos[ki];
+        b.pop_back();
+        if(b.size()==1){
+            unsigned lastHash=shared.back();
+            shared[sharedPos[h]]=lastHash;
+            sharedPos[lastHash]=sharedPos[h];
+            shared.pop_back();
+            sharedPos[h]=-1;
+        }
+        if(h>=hashLimit){
+            unsigned lastKey=outOfRange.back();
+            outOfRange[outOfRangePos[ki]]=lastKey;
+            outOfRangePos[lastKey]=outOfRangePos[ki];
+            outOfRange.pop_back();
+            outOfRangePos[ki]=-1;
+        }
+    }
+
+    // Count one more or one fewer good key in hash h, keeping the histogram in step
+    void hashAdd(unsigned h)
+    {
+        unsigned collisions=hashes[h]++;
+        counts[collisions]--;
+        if(collisions+1==counts.size()){
+            counts.resize(collisions+2);
+        }
+        counts[collisions+1]++;
+    }
+
+    void hashRemove(unsigned h)
+    {
+        unsigned collisions=hashes[h]--;
+        counts[collisions]--;
+        counts[collisions-1]++;
+        if(counts[collisions]==0 && collisions+1==counts.size()){
+            counts.resize(collisions);
+        }
+    }
+
+    // Count key ki in its hash if it is good, or as bad otherwise
+    void updateGood(unsigned ki)
+    {
+        bool good = keys[ki]<hashLimit && keyDisagree[ki]==0;
+        if(good==keyGood[ki])
+            return;
+        keyGood[ki]=good;
+        if(good){
+            hashAdd(keys[ki]);
+            nBad--;
+        }else{
+            hashRemove(keys[ki]);
+            nBad++;
+        }
+    }
+
+    // Move key ki from its current hash to the hash h
+    void moveKey(unsigned ki, unsigned h)
+    {
+        // Take it out of the counts while it moves
+        if(keyGood[ki]){
+            hashRemove(keys[ki]);
+            keyGood[ki]=false;
+            nBad++;
+        }
+
+        bucketRemove(ki);
+        keys[ki] = h;
+        bucketAdd(ki);
+
+        updateGood(ki);
+    }
+
+    // Keep the disagree list in step with the hash of variant vi
+    void updateDisagree(unsigned vi)
+    {
+        unsigned ki=variantKey[vi];
+        bool differs = variantHashes[vi]!=keys[ki];
+        bool listed = disagreePos[vi]!=-1;
+        if(differs && !listed){
+            disagreePos[vi]=disagree.size();
+            disagree.push_back(vi);
+            keyDisagree[ki]++;
+            updateGood(ki);
+        }else if(!differs && listed){
+            unsigned last=disagree.back();
+            disagree[disagreePos[vi]]=last;
+            disagreePos[last]=disagreePos[vi];
+            disagree.pop_back();
+            disagreePos[vi]=-1;
+            keyDisagree[ki]--;
+            updateGood(ki);
+        }
+    }
+
+    // Rebuild the bit -> key lists for one table from its current selectors
+    void linkTable(unsigned ti)
+    {
+        const auto &t=bh.tables[ti];
+        for(unsigned li=0; li<t.lut.size(); li++){
+            bits[tableBase[ti]+li].keys.clear();
+            bits[tableBase[ti]+li].variants.clear();
+        }
+        for(unsigned ki=0; ki<keyValues.size(); ki++){
+            unsigned bi=tableBase[ti] + t.address(keyValues[ki]); // Implies concrete key
+            bits[bi].keys.push_back(ki);
+            keyBits[ki*bh.wO+ti]=bi;
+        }
+        for(unsigned vi=0; vi<variantValues.size(); vi++){
+            unsigned bi=tableBase[ti] + t.address(variantValues[vi]);
+            bits[bi].variants.push_back(vi);
+            variantBits[vi*bh.wO+ti]=bi;
+        }
+    }
 
+public:
     void flipBit(int i)
     {
         const auto &info=bits.at(i);
@@ -184,62 +445,88 @@ struct EntryToKey
         packedBits[i]=nb;
 
         // Update all the hashes
+        for(unsigned vi : info.variants){
+            variantHashes[vi] ^= info.mask;
+            updateDisagree(vi);
+        }
         for(unsigned ki : info.keys){
-            unsigned &key=keys[ki];
-
-            // Remove the old key
-            unsigned collisions=hashes[key]--;
-            counts[collisions]--;
-            if(counts[collisions]==0 && collisions+1==counts.size()){
-                counts.resize(collisions);
+            moveKey(ki, keys[ki] ^ info.mask); // Flip the bit in the hash
+            for(unsigned vi : keyVariants[ki]){
+                updateDisagree(vi);
             }
-            counts[collisions-1]++;
+        }
+    }
+
+    /* Replace selector si of table ti with input bit ib. The lut contents
+     * stay the same, but every key may now read a different lut entry, so
+     * the bit lists for that table are rebuilt and any keys whose output
+     * bit changed are moved. Swapping the old input back undoes the move.
+     */
+    void swapSelector(unsigned ti, unsigned si, unsigned ib)
+    {
+        auto &t=bh.tables[ti];
+        assert(std::find(t.selectors.begin(), t.selectors.end(), ib)==t.selectors.end());
+        t.selectors.at(si)=ib;
 
-            key ^= info.mask; // Flip the bit in the hash
+        linkTable(ti);
 
-            // Add the new key
-            collisions=++hashes[key];
-            counts[collisions-1]--;
-            if(collisions==counts.size()){
-                counts.resize(collisions+1);
+        for(unsigned ki=0; ki<keyValues.size(); ki++){
+            unsigned bit=*bits[keyBits[ki*bh.wO+ti]].pBit;
+            if( ((keys[ki]>>ti)&1) != bit ){
+                moveKey(ki, keys[ki] ^ (1u<<ti));
             }
-            counts[collisions]++;
-
         }
-
-
+        for(unsigned vi=0; vi<variantValues.size(); vi++){
+            unsigned bit=*bits[variantBits[vi*bh.wO+ti]].pBit;
+            variantHashes[vi] = (variantHashes[vi] & ~(1u<<ti)) | (bit<<ti);
+        }
+        for(unsigned vi=0; vi<variantValues.size(); vi++){
+            updateDisagree(vi);
+        }
     }
 
     double eval(int groupSize=1) const
     {
-        double acc=0;
-        for(int i=groupSize+1;i<counts.size();i++){
-            //fprintf(stderr, "  Counts[%u] = %u\n", i, counts[i]);
-            acc += counts[i] * (i - groupSize); //*(i-1);
-
+        double acc=nBad;
+        for(unsigned i=groupSize+1;i<counts.size();i++){
+            acc += counts[i] * (i - groupSize);
         }
-        return acc;
+        // Up to getMaxStash() displaced keys are free, as they go in the stash
+        return std::max(0.0, acc - kvs.getMaxStash());
     }
 
+    //! The same as eval, from scratch, counting keys as find_stash_of does
     static double evalFull(const BitHash &bh, const key_value_set &kvs, int groupSize=1)
     {
         std::vector<unsigned> hits(1<<bh.wO, 0);
+        unsigned limit=getHashLimit(bh, kvs);
 
+        double acc=0;
         for(const auto &kv : kvs){
-            const auto &k=kv.first;
+            auto it=kv.first.variants_begin();
+
+            unsigned h=bh(*it);
+            bool ok = h<limit;
 
-            unsigned h=bh(k);
+            // Every other variant must agree with the first
+            ++it;
+            for(auto end=kv.first.variants_end(); ok && it!=end; ++it){
+                ok = bh(*it)==h;
+            }
 
-            ++hits[h];
+            if(ok){
+                ++hits[h];
+            }else{
+                acc++;
+            }
         }
 
-        double acc=0;
         for(unsigned i=0;i<hits.size();i++){
-            if(hits[i] > groupSize ) {
+            if(hits[i] > (unsigned)groupSize) {
                 acc += (hits[i] - groupSize);
             }
         }
-        return acc;
+        return std::max(0.0, acc - kvs.getMaxStash());
     }
 
     std::vector<int> getBitsFor(const BitHash &x)
@@ -324,6 +611,34 @@ BitHash perturbHash(TRng &rng, const BitHash &x, double swapProportion)
     return bh;
 }
 
+/* Choose a tap move for table ti, which replaces selector slot si with the
+ * input bit ib (which the table does not already tap). If ka!=kb then only
+ * inputs on which both keys are defined and differ are considered, so if the
+ * two keys currently read the same address in the table they will read
+ * different ones afterwards. Returns false if there is no suitable input.
+ */
+template<class TRng>
+bool chooseTapMove(TRng &rng, const EntryToKey &et, unsigned ti, unsigned ka, unsigned kb, unsigned &si, unsigned &ib)
+{
+    const auto &t=et.bh.tables[ti];
+    const auto &a=et.getKey(ka), &b=et.getKey(kb);
+
+    std::vector<unsigned> options;
+    for(unsigned i=0; i<et.bh.wI; i++){
+        if(std::find(t.selectors.begin(), t.selectors.end(), i)!=t.selectors.end())
+            continue;
+        if(ka!=kb && (a[i]==-1 || b[i]==-1 || a[i]==b[i]))
+            continue;
+        options.push_back(i);
+    }
+    if(options.empty() || t.selectors.empty())
+        return false;
+
+    si=rng()%t.selectors.size();
+    ib=options[rng()%options.size()];
+    return true;
+}
+
 void greedyOneBit(EntryToKey &et, int groupSize, bool ignoreCurrent=false)
 {
     double eBest=ignoreCurrent ? DBL_MAX : et.eval(groupSize);
@@ -33,6 +33,12 @@ struct cnf_problem
 {
     // Mapping from (outputBit,lutAddr) to CNF variable
     std::map<std::pair<unsigned,unsigned>, int> lutToVariable;
+    // If built with allowStash, one literal per key (in key order) which
+    // releases that key from all constraints when true
+    std::vector<Minisat::Lit> stashLits;
+    // If built with to_cnf_mux, mapping from (outputBit,selector) to the
+    // (input,variable) pairs it can choose between
+    std::map<std::pair<unsigned,unsigned>, std::vector<std::pair<unsigned,int> > > selectorToVariables;
     // Vector of CNF style clauses
     //std::vector<std::vector<int> > clauses;
 
@@ -76,10 +82,22 @@ BitHash substitute(const BitHash &bh, const cnf_problem &cnf, const std::map<int
             res.tables.at(iO).lut.at(addr)=it->second;
         }
     }
+    for(const auto &sel : cnf.selectorToVariables){
+        for(const auto &cand : sel.second){
+            auto it=solution.find(cand.second);
+            if(it!=solution.end() && it->second==1){
+                res.tables.at(sel.first.first).selectors.at(sel.first.second)=cand.first;
+            }
+        }
+    }
     return res;
 }
 
-std::map<int,int> minisat_solve(cnf_problem &problem, int verbosity=0)
+//! Solve under the given assumptions. The solver (and anything it has learnt)
+//! can be re-used afterwards with different assumptions. If confBudget is
+//! non-negative then minisat gives up (returning no solution) after that
+//! many conflicts.
+std::map<int,int> minisat_solve(cnf_problem &problem, const Minisat::vec<Minisat::Lit> &assumps, int verbosity=0, int64_t confBudget=-1)
 {
     using namespace Minisat;
 
@@ -92,7 +110,14 @@ std::map<int,int> minisat_solve(cnf_problem &problem, int verbosity=0)
 
     //printStats(S);
 
-    bool ret = S.solve();
+    bool ret;
+    if(confBudget<0){
+        ret = S.solve(assumps);
+    }else{
+        S.setConfBudget(confBudget);
+        ret = S.solveLimited(assumps)==l_True;
+        S.budgetOff();
+    }
 
     //printStats(S);
 
@@ -116,116 +141,146 @@ std::map<int,int> minisat_solve(cnf_problem &problem, int verbosity=0)
     }
 };
 
-/*
- * If we have the key  0b01x, then we need to make sure that
- *   hash(0b0100) == hash(0b011).
- *
- * One way of forcing it is to say that the version with all x values
- * replaced with 0 is the canonical version. The standard pair-wise key
- * non-equality constraints then operate on the canonical versions.
- * We then add constraints that ensure that all non-canonical variants are
- * the same (form an equivalence class).
- *
- * for all k : equiv(k_0):
- *    hash(k) = hash(k_0)
- *
- *
- */
-
+std::map<int,int> minisat_solve(cnf_problem &problem, int verbosity=0, int64_t confBudget=-1)
+{
+    Minisat::vec<Minisat::Lit> noAssumps;
+    return minisat_solve(problem, noAssumps, verbosity, confBudget);
+}
 
-template<class TKeyCont>
-void to_cnf(
-        const BitHash &bh,
-        const TKeyCont &keys,
+/* Add the constraints between hashes to the problem. Each hash has one entry
+ * per output bit, using the encoding from to_cnf's calcHash: 0 is false, -1
+ * is true, and a positive number is the (1-based) variable holding that bit.
+ * variantHashes[ki] are the hashes of the other variants of key ki.
+ */
+void hashes_to_cnf(
+        unsigned wO,
+        const std::vector<std::vector<int> > &hashes,
+        const std::vector<std::vector<std::vector<int> > > &variantHashes,
         cnf_problem &res,
-        unsigned maxHash=0
+        unsigned maxHash,
+        unsigned groupSize,
+        bool allowStash
 ) {
-
-    // Set up a mapping from bits in the table to variables in the CNF output
-    std::map<std::pair<unsigned,unsigned>,int > &bitMapping = res.lutToVariable;
-
-    // The thing we are going to build up.
     Minisat::Solver &sat=res.sat;
 
-    auto get_idx=[&](unsigned iO, unsigned iAddr) -> int
-    {
-        auto key=std::make_pair(iO,iAddr);
-
-        auto ins=bitMapping.insert(std::make_pair(key, bitMapping.size()+1));
-        if(ins.second){
-            sat.newVar();
+    res.stashLits.clear();
+    if(allowStash){
+        for(unsigned i=0; i<hashes.size(); i++){
+            res.stashLits.push_back(Minisat::mkLit(sat.newVar()));
         }
-        return ins.first->second;
+    }
+
+    // Add stash(k) to a clause, if stashing is allowed
+    auto relax=[&](Minisat::vec<Minisat::Lit> &lits, unsigned ki)
+    {
+        if(allowStash)
+            lits.push(res.stashLits[ki]);
     };
 
-    // Work out the hash values for a given key. The value might be
-    // partially known (if some table entries are already fixed), or
-    // partially unknown (if some entries still need to be determined).
-    //
-    // We will return:
-    // - false : 0 (same as in CNF)
-    // - true : -1 (not present in CNF, and will cause the elimination of a clause)
-    // - (iO,addr) : some strictly positive integer that appears in the output.
-    auto calcHash=[&](const bit_vector &key) -> std::vector<int> {
-        std::vector<int> res;
-        res.reserve(bh.wO);
-        for(unsigned iO=0; iO<bh.wO; iO++){
-            auto addr=bh.tables[iO].address(key);
-            auto bit=bh.tables[iO].lut.at(addr);
+    for(unsigned ki=0; ki<hashes.size(); ki++){
+        const auto &h0=hashes[ki];
 
-            if(bit==0){
-                res.push_back(0); // false
-            }else if(bit==1){
-                res.push_back(-1); // true
-            }else if(bit==-1){
-                res.push_back( get_idx(iO,addr) ); // Some unknown in the CNF
-            }else{
-                assert(0);
+        Minisat::vec<Minisat::Lit> lits;
+        for(const auto &hx : variantHashes[ki]){
+            // Need to assert that h0==hx. The hash entries use the same
+            // encoding as calcHash, so constants have to be handled here.
+            for(unsigned i=0;i<wO;i++){
+                int a=h0[i], b=hx[i];
+                if(a<=0 && b<=0){
+                    if(a!=b){
+                        lits.clear();
+                        relax(lits, ki);
+                        sat.addClause(lits); // Two fixed bits disagree, so no solution
+                    }
+                    continue;
+                }
+
+                if(b<=0){
+                    std::swap(a,b);
+                }
+                Minisat::Lit lb=Minisat::mkLit(b-1);
+
+                if(a<=0){
+                    // One fixed bit, so the other must match it
+                    lits.clear();
+                    lits.push( a==-1 ? lb : ~lb );
+                    relax(lits, ki);
+                    sat.addClause(lits);
+                }else{
+                    Minisat::Lit la=Minisat::mkLit(a-1);
+
+                    lits.clear();
+                    lits.push(la);
+                    lits.push(~lb);
+                    relax(lits, ki);
+                    sat.addClause(lits);
+
+                    lits.clear();
+                    lits.push(~la);
+                    lits.push(lb);
+                    relax(lits, ki);
+                    sat.addClause(lits);
+                }
             }
         }
-        return res;
-    };
-
-    std::vector<std::vector<int> > hashes;
-    hashes.reserve(keys.size());
-    for(const auto &k : keys){
-        auto it=k.variants_begin();
-        auto h0=calcHash(*it);
-        hashes.push_back(h0);
-        ++it;
+    }
 
+    if(groupSize>1){
+        // Each slot may hold up to groupSize keys, so instead of all pairs being
+        // different we say that slotHits[s][k] is true if key k has hash s, and
+        // then place a cardinality constraint on each slot. We only need the
+        // implication (hash==s) -> hit, as nothing is gained by the solver
+        // setting a hit that isn't there.
         Minisat::vec<Minisat::Lit> lits;
-        auto end=k.variants_end();
-        while(it!=end){
-            auto hx=calcHash(*it);
-            // Need to assert that h0==hx
-            //std::vector<int> tmp(2);
-            for(unsigned i=0;i<bh.wO;i++){
-                lits.clear();
-                lits.push(Minisat::mkLit(h0[i]));
-                lits.push(~Minisat::mkLit(hx[i]));
-                sat.addClause(lits);
-                //tmp[0]=h0[i];
-                //tmp[1]=-hx[i];
-                //clauses.push_back(tmp);
+        for(unsigned s=0; s<(1u<<wO); s++){
+            std::vector<Minisat::Lit> slotHits;
+            unsigned fixedHits=0;
 
+            for(unsigned ki=0; ki<hashes.size(); ki++){
+                const auto &h=hashes[ki];
                 lits.clear();
-                lits.push(~Minisat::mkLit(h0[i]));
-                lits.push(Minisat::mkLit(hx[i]));
+                bool possible=true;
+                for(unsigned iO=0; iO<wO; iO++){
+                    int want=(s>>iO)&1;
+                    int raw=h[iO];
+                    if(raw<=0){
+                        if( (raw==-1) != (want==1) ){
+                            possible=false; // A fixed bit already rules this slot out
+                            break;
+                        }
+                    }else{
+                        // Clause is satisfied if this bit differs from the slot
+                        Minisat::Lit l=Minisat::mkLit(raw-1);
+                        lits.push(want ? ~l : l);
+                    }
+                }
+                if(!possible)
+                    continue;
+                if(lits.size()==0 && !allowStash){
+                    fixedHits++;
+                    continue;
+                }
+
+                Minisat::Lit hit=Minisat::mkLit(sat.newVar());
+                lits.push(hit);
+                relax(lits, ki);
                 sat.addClause(lits);
-                //tmp[0]=-h0[i];
-                //tmp[1]=hx[i];
-                //clauses.push_back(tmp);
+                slotHits.push_back(hit);
             }
 
-            ++it;
+            if(fixedHits>groupSize){
+                lits.clear();
+                sat.addClause(lits); // Already too many keys fixed in this slot
+            }else{
+                requireAtMostK(sat, slotHits, groupSize-fixedHits);
+            }
         }
     }
 
     std::vector<std::vector<int> > acc;
     // Consider all pairs of keys
-    for(unsigned iK=0; iK<keys.size()-1; iK++){
-        for(unsigned jK=iK+1;jK<keys.size();jK++){
+    for(unsigned iK=0; groupSize==1 && iK+1<hashes.size(); iK++){
+        for(unsigned jK=iK+1;jK<hashes.size();jK++){
             assert(acc.size()==0);
 
             acc.push_back(std::vector<int>());
@@ -237,7 +292,7 @@ void to_cnf(
             auto iH=hashes.at(iK);
             auto jH=hashes.at(jK);
 
-            for(unsigned iO=0; iO<bh.wO; iO++){
+            for(unsigned iO=0; iO<wO; iO++){
                 // The two bits we are considering at this level
                 int iB=iH[iO], jB=jH[iO];
 
@@ -312,26 +367,142 @@ void to_cnf(
                     int var = std::abs(raw) - 1;
                     lits.push((raw > 0) ? Minisat::mkLit(var) : ~Minisat::mkLit(var));
                 }
+                relax(lits, iK);
+                relax(lits, jK);
                 sat.addClause(lits);
             }
             acc.clear();
         }
     }
 
-    // Enforce constraints on largest hash
-    if((maxHash>0) && (maxHash < (1<<bh.wO))){
-        bit_vector maxVal=to_bit_vector(maxHash);
+    // Enforce constraints on largest hash, which must be strictly less than maxHash
+    if((maxHash>0) && (maxHash < (1u<<wO))){
+        bit_vector maxVal=to_bit_vector(maxHash-1);
+
+        for(unsigned ki=0; ki<hashes.size(); ki++){
+            // Same encoding as calcHash, so fixed bits (as in LNS) become constants
+            std::vector<cnf_expr_t> bits;
+            for(int raw : hashes[ki]){
+                if(raw<=0){
+                    bits.push_back(cnf_expr_t(sat, raw==-1));
+                }else{
+                    bits.push_back(cnf_expr_t(sat, Minisat::mkLit(raw-1)));
+                }
+            }
+            if(allowStash){
+                auto ok=makeLessThanOrEqual(sat, bits, maxVal, bits.size()-1);
+                (ok | cnf_expr_t(sat, res.stashLits[ki])).requireTrue();
+            }else{
+                auto ok=makeLessThanOrEqual(sat, bits, maxVal, bits.size()-1);
+                if(ok.isFalse()){
+                    Minisat::vec<Minisat::Lit> none;
+                    sat.addClause(none); // Fixed bits are too big, so no solution
+                }else{
+                    ok.requireTrue();
+                }
+            }
+        }
+    }
+}
+
+/*
+ * If we have the key  0b01x, then we need to make sure that
+ *   hash(0b0100) == hash(0b011).
+ *
+ * One way of forcing it is to say that the version with all x values
+ * replaced with 0 is the canonical version. The standard pair-wise key
+ * non-equality constraints then operate on the canonical versions.
+ * We then add constraints that ensure that all non-canonical variants are
+ * the same (form an equivalence class).
+ *
+ * for all k : equiv(k_0):
+ *    hash(k) = hash(k_0)
+ *
+ * If allowStash is true then every key k also gets a literal stash(k),
+ * which is added to every clause that mentions k (pair, group, variant and
+ * maxHash constraints). A solution then describes a hash for the keys that
+ * are not stashed, and the number of stashed keys can be bounded with a
+ * cardinality constraint over res.stashLits.
+ */
+
+
+template<class TKeyCont>
+void to_cnf(
+        const BitHash &bh,
+        const TKeyCont &keys,
+        cnf_problem &res,
+        unsigned maxHash=0,
+        unsigned groupSize=1,
+        bool allowStash=false
+) {
+    if(!bh.premix.empty())
+        throw std::runtime_error("to_cnf : hash has a premix, so encode it on premixKeys of the keys instead.");
+
+    // Set up a mapping from bits in the table to variables in the CNF output
+    std::map<std::pair<unsigned,unsigned>,int > &bitMapping = res.lutToVariable;
 
-        std::vector<Minisat::Lit> lits(bh.wO);
-        for(const auto &hash : hashes){
-            for(int i=0;i<bh.wO;i++){
-                int raw=hash[i];
-                int var = std::abs(raw) - 1;
-                lits[i]=((raw > 0) ? Minisat::mkLit(var) : ~Minisat::mkLit(var));
+    // The thing we are going to build up.
+    Minisat::Solver &sat=res.sat;
+
+    auto get_idx=[&](unsigned iO, unsigned iAddr) -> int
+    {
+        auto key=std::make_pair(iO,iAddr);
+
+        // Variables are numbered from 1, and may be interleaved with other
+        // variables if to_cnf is called more than once on the same problem
+        auto ins=bitMapping.insert(std::make_pair(key, 0));
+        if(ins.second){
+            ins.first->second=sat.newVar()+1;
+        }
+        return ins.first->second;
+    };
+
+    // Work out the hash values for a given key. The value might be
+    // partially known (if some table entries are already fixed), or
+    // partially unknown (if some entries still need to be determined).
+    //
+    // We will return:
+    // - false : 0 (same as in CNF)
+    // - true : -1 (not present in CNF, and will cause the elimination of a clause)
+    // - (iO,addr) : some strictly positive integer that appears in the output.
+    auto calcHash=[&](const bit_vector &key) -> std::vector<int> {
+        std::vector<int> res;
+        res.reserve(bh.wO);
+        for(unsigned iO=0; iO<bh.wO; iO++){
+            auto addr=bh.tables[iO].address(key);
+            auto bit=bh.tables[iO].lut.at(addr);
+
+            if(bit==0){
+                res.push_back(0); // false
+            }else if(bit==1){
+                res.push_back(-1); // true
+            }else if(bit==-1){
+                res.push_back( get_idx(iO,addr) ); // Some unknown in the CNF
+            }else{
+                assert(0);
             }
-            requireLessThanOrEqual(sat, lits, maxVal);
+        }
+        return res;
+    };
+
+    std::vector<std::vector<int> > hashes;
+    std::vector<std::vector<std::vector<int> > > variantHashes;
+    hashes.reserve(keys.size());
+    variantHashes.reserve(keys.size());
+    for(const auto &k : keys){
+        auto it=k.variants_begin();
+        hashes.push_back(calcHash(*it));
+        ++it;
+
+        variantHashes.push_back(std::vector<std::vector<int> >());
+        auto end=k.variants_end();
+        while(it!=end){
+            variantHashes.back().push_back(calcHash(*it));
+            ++it;
         }
     }
+
+    hashes_to_cnf(bh.wO, hashes, variantHashes, res, maxHash, groupSize, allowStash);
 };
 
 #endif //HLS_PARSER_BIT_HASH_CNF_HPP
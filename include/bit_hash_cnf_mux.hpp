@@ -0,0 +1,222 @@
+#ifndef FPGA_PERFECT_HASH_BIT_HASH_CNF_MUX_HPP
+#define FPGA_PERFECT_HASH_BIT_HASH_CNF_MUX_HPP
+
+#include "bit_hash.hpp"
+#include "bit_hash_cnf.hpp"
+
+#include <tuple>
+
+/* Choose nCandidates inputs for every selector of every table, returned as
+ * candidates[table][selector]. The first candidate is always the selector's
+ * current input, so with one candidate this is the same as bh's shuffle.
+ */
+template<class TRng>
+std::vector<std::vector<std::vector<unsigned> > > makeTapCandidates(TRng &rng, const BitHash &bh, unsigned nCandidates)
+{
+    nCandidates=std::min(nCandidates, bh.wI);
+
+    std::vector<std::vector<std::vector<unsigned> > > res(bh.wO);
+    std::vector<unsigned> inputs(bh.wI);
+    for(unsigned ti=0; ti<bh.wO; ti++){
+        for(unsigned sel : bh.tables[ti].selectors){
+            for(unsigned i=0; i<bh.wI; i++){
+                inputs[i]=i;
+            }
+            std::swap(inputs[0], inputs[sel]);
+            for(unsigned i=1; i<nCandidates; i++){
+                std::swap(inputs[i], inputs[i+rng()%(bh.wI-i)]);
+            }
+            res[ti].push_back(std::vector<unsigned>(inputs.begin(), inputs.begin()+nCandidates));
+        }
+    }
+    return res;
+}
+
+/* Like to_cnf, but the solver also chooses the taps. Each selector gets a
+ * one-hot set of variables over its candidate inputs, so each address bit
+ * of a key is a multiplexer over that key's bits at the candidates. As the
+ * key bits are constants the address bit only depends on which of the
+ * candidates are 1, and keys with the same pattern share a variable. Each
+ * hash bit is then a lut lookup on those address bits, and keys with the
+ * same address bits share that too. Two selectors of one table may not
+ * choose the same input.
+ *
+ * All lut entries are free (the lut contents of bh are ignored), and the
+ * chosen taps are recovered by substitute using res.selectorToVariables.
+ */
+template<class TKeyCont>
+void to_cnf_mux(
+        const BitHash &bh,
+        const std::vector<std::vector<std::vector<unsigned> > > &candidates,
+        const TKeyCont &keys,
+        cnf_problem &res,
+        unsigned maxHash=0,
+        unsigned groupSize=1,
+        bool allowStash=false
+) {
+    using namespace Minisat;
+
+    if(!bh.premix.empty())
+        throw std::runtime_error("to_cnf_mux : hash has a premix, so encode it on premixKeys of the keys instead.");
+
+    Solver &sat=res.sat;
+
+    // One-hot selectors
+    std::vector<std::vector<std::vector<Lit> > > selLits(bh.wO);
+    for(unsigned ti=0; ti<bh.wO; ti++){
+        const auto &tc=candidates.at(ti);
+        for(unsigned si=0; si<tc.size(); si++){
+            auto &vars=res.selectorToVariables[std::make_pair(ti,si)];
+            std::vector<Lit> lits;
+            vec<Lit> any;
+            for(unsigned input : tc[si]){
+                lits.push_back(mkLit(sat.newVar()));
+                vars.push_back(std::make_pair(input, var(lits.back())+1));
+                any.push(lits.back());
+            }
+            sat.addClause(any);
+            requireAtMostK(sat, lits, 1);
+            // Start from the base shuffle (a polarity of false is tried as true first)
+            sat.setPolarity(var(lits[0]), false);
+            selLits[ti].push_back(lits);
+        }
+
+        for(unsigned si=0; si<tc.size(); si++){
+            for(unsigned sj=si+1; sj<tc.size(); sj++){
+                for(unsigned ci=0; ci<tc[si].size(); ci++){
+                    for(unsigned cj=0; cj<tc[sj].size(); cj++){
+                        if(tc[si][ci]==tc[sj][cj])
+                            sat.addClause(~selLits[ti][si][ci], ~selLits[ti][sj][cj]);
+                    }
+                }
+            }
+        }
+
+        for(unsigned addr=0; addr<(1u<<tc.size()); addr++){
+            auto ins=res.lutToVariable.insert(std::make_pair(std::make_pair(ti,addr), 0));
+            if(ins.second){
+                ins.first->second=sat.newVar()+1;
+            }
+        }
+    }
+
+    // Address bits use the same encoding as hash bits in to_cnf: 0 is false,
+    // -1 is true, otherwise the 1-based variable.
+    std::map<std::tuple<unsigned,unsigned,unsigned>,int> addrBits;
+    auto getAddrBit=[&](unsigned ti, unsigned si, const bit_vector &key) -> int
+    {
+        const auto &cands=candidates[ti][si];
+        unsigned pattern=0;
+        for(unsigned ci=0; ci<cands.size(); ci++){
+            if(key[cands[ci]]==1)
+                pattern|=1u<<ci;
+        }
+        if(pattern==0)
+            return 0;
+        if(pattern==(1u<<cands.size())-1)
+            return -1;
+
+        auto ins=addrBits.insert(std::make_pair(std::make_tuple(ti,si,pattern), 0));
+        if(ins.second){
+            // x <-> (one of the candidates which are 1 is selected)
+            Lit x=mkLit(sat.newVar());
+            vec<Lit> lits;
+            lits.push(~x);
+            for(unsigned ci=0; ci<cands.size(); ci++){
+                if((pattern>>ci)&1){
+                    sat.addClause(~selLits[ti][si][ci], x);
+                    lits.push(selLits[ti][si][ci]);
+                }
+            }
+            sat.addClause(lits);
+            ins.first->second=var(x)+1;
+        }
+        return ins.first->second;
+    };
+
+    std::map<std::pair<unsigned,std::vector<int> >,int> hashBits;
+    auto getHashBit=[&](unsigned ti, const std::vector<int> &addr) -> int
+    {
+        auto ins=hashBits.insert(std::make_pair(std::make_pair(ti,addr), 0));
+        if(!ins.second)
+            return ins.first->second;
+
+        bool fixed=true;
+        unsigned fixedAddr=0;
+        for(unsigned i=0; i<addr.size(); i++){
+            fixed = fixed && addr[i]<=0;
+            if(addr[i]==-1)
+                fixedAddr|=1u<<i;
+        }
+        if(fixed){
+            ins.first->second=res.lutToVariable.at(std::make_pair(ti,fixedAddr));
+            return ins.first->second;
+        }
+
+        // (addr==a) -> (y <-> lut[a]), for every a the constant bits allow
+        Lit y=mkLit(sat.newVar());
+        vec<Lit> lits;
+        for(unsigned a=0; a<(1u<<addr.size()); a++){
+            lits.clear();
+            bool possible=true;
+            for(unsigned i=0; i<addr.size() && possible; i++){
+                int want=(a>>i)&1;
+                if(addr[i]<=0){
+                    possible = (addr[i]==-1)==(want==1);
+                }else{
+                    Lit l=mkLit(addr[i]-1);
+                    lits.push(want ? ~l : l);
+                }
+            }
+            if(!possible)
+                continue;
+
+            Lit lut=mkLit(res.lutToVariable.at(std::make_pair(ti,a))-1);
+            lits.push(~y);
+            lits.push(lut);
+            sat.addClause(lits);
+            lits.pop();
+            lits.pop();
+            lits.push(y);
+            lits.push(~lut);
+            sat.addClause(lits);
+        }
+        ins.first->second=var(y)+1;
+        return ins.first->second;
+    };
+
+    auto calcHash=[&](const bit_vector &key) -> std::vector<int> {
+        std::vector<int> hash;
+        hash.reserve(bh.wO);
+        std::vector<int> addr;
+        for(unsigned ti=0; ti<bh.wO; ti++){
+            addr.clear();
+            for(unsigned si=0; si<candidates[ti].size(); si++){
+                addr.push_back(getAddrBit(ti, si, key));
+            }
+            hash.push_back(getHashBit(ti, addr));
+        }
+        return hash;
+    };
+
+    std::vector<std::vector<int> > hashes;
+    std::vector<std::vector<std::vector<int> > > variantHashes;
+    hashes.reserve(keys.size());
+    variantHashes.reserve(keys.size());
+    for(const auto &k : keys){
+        auto it=k.variants_begin();
+        hashes.push_back(calcHash(*it));
+        ++it;
+
+        variantHashes.push_back(std::vector<std::vector<int> >());
+        auto end=k.variants_end();
+        while(it!=end){
+            variantHashes.back().push_back(calcHash(*it));
+            ++it;
+        }
+    }
+
+    hashes_to_cnf(bh.wO, hashes, variantHashes, res, maxHash, groupSize, allowStash);
+};
+
+#endif //FPGA_PERFECT_HASH_BIT_HASH_CNF_MUX_HPP
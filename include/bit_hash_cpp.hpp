@@ -7,6 +7,8 @@
 
 #include "key_value_set.hpp"
 
+#include <set>
+
 void write_cpp_hash(const BitHash &bh, std::string name, std::string indent, std::ostream &dst)
 {
     dst<<indent<<"unsigned "<<name<<"_hash(unsigned x){\n";
@@ -21,6 +23,19 @@ void write_cpp_hash(const BitHash &bh, std::string name, std::string indent, std
         }
         dst<<"};\n";
     }
+    if(!bh.premix.empty()){
+        dst<<indent<<"  // Premix, one XOR level\n";
+        dst<<indent<<"  unsigned mixed = 0";
+        for(unsigned j=0;j<bh.premix.size();j++){
+            dst<<"\n"<<indent<<"    | ((0";
+            for(unsigned b : bh.premix[j]){
+                dst<<" ^ (x>>"<<b<<")";
+            }
+            dst<<") & 1)<<"<<j;
+        }
+        dst<<";\n";
+        dst<<indent<<"  x = mixed;\n";
+    }
     dst<<indent<<"  // Addresses and bits\n";
     for(unsigned i=0;i<bh.tables.size();i++){
         const auto &t = bh.tables[i];
@@ -41,63 +56,111 @@ void write_cpp_hash(const BitHash &bh, std::string name, std::string indent, std
     dst<<indent<<"}\n";
 }
 
-void write_cpp_hit(const BitHash &bh, const key_value_set &keys, std::string name, std::string indent, std::ostream &dst)
+/* The hit, lookup and test writers only need wI, wO, operator() and
+ * find_stash from the hash, so also work for the other kinds of hash.
+ *
+ * With groupSize>1 each hash owns groupSize consecutive entries of the
+ * tables, filled in key order, and name_entry gives the entry a key is in
+ * (or -1), which both name_hit and name_lookup go through. */
+template<class THash>
+void write_cpp_hit(const THash &bh, const key_value_set &keys, std::string name, std::string indent, std::ostream &dst, unsigned groupSize=1)
 {
     if(bh.wI > 32){
         throw std::runtime_error("This is not tested (and may not work) for very large input bit widths.");
     }
 
     // Set up sentinel values which can never be equal to any input key
-    std::vector<unsigned> tags(1<<bh.wO, 1<<bh.wI);
-    std::vector<unsigned> masks(1<<bh.wO, 0);
+    unsigned nEntries=(1u<<bh.wO)*groupSize;
+    std::vector<unsigned> tags(nEntries, 1<<bh.wI);
+    std::vector<unsigned> masks(nEntries, 0);
+    std::vector<unsigned> fill(1u<<bh.wO, 0);
+
+    // Keys which don't fit in the table are matched directly instead
+    auto stash=find_checked_stash(bh, keys, groupSize);
+    std::set<bit_vector> stashed(stash.begin(), stash.end());
 
     // Mark out the valid tags
     for(auto kv : keys){
+        if(stashed.count(kv.first))
+            continue;
         auto key=* kv.first.variants_begin();
         auto hash=bh(key);
         std::cerr<<"  key="<<key<<" = "<<to_unsigned(key)<<"\n";
-        tags.at(hash)=to_unsigned(key);
+        unsigned entry=hash*groupSize + fill.at(hash)++;
+        tags.at(entry)=to_unsigned(key);
 
-        masks.at(hash)=to_unsigned(key.get_concrete_mask(bh.wI));
+        masks.at(entry)=to_unsigned(key.get_concrete_mask(bh.wI));
     }
 
+    auto writeTables=[&](std::string in)
+    {
+        dst<<indent<<in<<"static const unsigned tags["<<nEntries<<"] = {\n";
+        for(unsigned i=0;i<tags.size();i++){
+            dst<<indent<<in<<"  "<<tags[i];
+            if(i!=tags.size()-1)
+                dst<<",";
+            dst<<"\n";
+        }
+        dst<<indent<<in<<"};\n";
+        if(!keys.has_concrete_keys()){
+            dst<<indent<<in<<"static const unsigned masks["<<nEntries<<"] = {\n";
+            for(unsigned i=0;i<masks.size();i++){
+                dst<<indent<<in<<"  "<<masks[i];
+                if(i!=masks.size()-1)
+                    dst<<",";
+                dst<<"\n";
+            }
+            dst<<indent<<in<<"};\n";
+        }
+    };
+
     dst << indent << "unsigned " << name << "_hash(unsigned x);\n";
     dst<<"\n";
-    dst<<indent<<"bool "<<name<<"_hit(unsigned x){\n";
-    dst<<indent<<"  static const unsigned tags["<<(1<<bh.wO)<<"] = {\n";
-    for(unsigned i=0;i<tags.size();i++){
-        dst<<indent<<"    "<<tags[i];
-        if(i!=tags.size()-1)
-            dst<<",";
+    if(groupSize>1){
+        dst<<indent<<"int "<<name<<"_entry(unsigned x){\n";
+        writeTables("  ");
+        dst<<indent<<"  unsigned hash="<<name<<"_hash(x);\n";
+        dst<<indent<<"  for(unsigned i=hash*"<<groupSize<<"u; i<(hash+1)*"<<groupSize<<"u; i++){\n";
+        if(keys.has_concrete_keys()) {
+            dst<<indent<<"    if(tags[i]==x) return i;\n";
+        }else{
+            dst<<indent<<"    if(tags[i]==(x&masks[i])) return i;\n";
+        }
+        dst<<indent<<"  }\n";
+        dst<<indent<<"  return -1;\n";
+        dst<<indent<<"}\n";
         dst<<"\n";
     }
-    dst<<indent<<"  };\n";
-    if(!keys.has_concrete_keys()){
-        dst<<indent<<"  static const unsigned masks["<<(1<<bh.wO)<<"] = {\n";
-        for(unsigned i=0;i<masks.size();i++){
-            dst<<indent<<"    "<<masks[i];
-            if(i!=masks.size()-1)
-                dst<<",";
-            dst<<"\n";
-        }
-        dst<<indent<<"  };\n";
+    dst<<indent<<"bool "<<name<<"_hit(unsigned x){\n";
+    if(groupSize==1){
+        writeTables("  ");
     }
-    dst<<indent<<"  unsigned hash="<<name<<"_hash(x);\n";
-    dst<<indent<<"  unsigned tag=tags[hash];\n";
-    if(keys.has_concrete_keys()) {
-        dst << indent << "  return tag==x;\n";
+    for(const auto &k : stash){
+        dst<<indent<<"  if((x&"<<to_unsigned(k.get_concrete_mask(bh.wI))<<"u)=="<<to_unsigned(*k.variants_begin())<<"u) return true;\n";
+    }
+    if(groupSize>1){
+        dst<<indent<<"  return "<<name<<"_entry(x)>=0;\n";
     }else{
-        dst<<indent<<"  unsigned mask=masks[hash];\n";
-        dst << indent << "  return tag==(x&mask);\n";
+        dst<<indent<<"  unsigned hash="<<name<<"_hash(x);\n";
+        dst<<indent<<"  unsigned tag=tags[hash];\n";
+        if(keys.has_concrete_keys()) {
+            dst << indent << "  return tag==x;\n";
+        }else{
+            dst<<indent<<"  unsigned mask=masks[hash];\n";
+            dst << indent << "  return tag==(x&mask);\n";
+        }
     }
     dst<<indent<<"}\n";
 
 }
 
-void write_cpp_lookup(const BitHash &bh, const key_value_set &keys, std::string name, std::string indent, std::ostream &dst)
+template<class THash>
+void write_cpp_lookup(const THash &bh, const key_value_set &keys, std::string name, std::string indent, std::ostream &dst, unsigned groupSize=1)
 {
     // Fill with (hopefully) poison values
-    std::vector<uint64_t> values(1<<bh.wO, 0xFFFFFFFFFFFFFFFFull);
+    unsigned nEntries=(1u<<bh.wO)*groupSize;
+    std::vector<uint64_t> values(nEntries, 0xFFFFFFFFFFFFFFFFull);
+    std::vector<unsigned> fill(1u<<bh.wO, 0);
 
     unsigned wV = keys.getKeyWidth();
     bool minimalHash=false;
@@ -106,25 +169,36 @@ void write_cpp_lookup(const BitHash &bh, const key_value_set &keys, std::string
         wV=(unsigned)ceil(log2(keys.size()));
     }
 
-    // Fill in the valid keys
+    auto stash=find_checked_stash(bh, keys, groupSize);
+    std::set<bit_vector> stashed(stash.begin(), stash.end());
+    std::vector<uint64_t> stashValues;
+
+    // Fill in the valid keys, in the same entries as write_cpp_hit
     unsigned pi=0;
     for(auto kv : keys){
         auto key=*kv.first.variants_begin();
-        auto hash=bh(key);
-        if(minimalHash){
-            values.at(hash) = pi;
-            pi++;
-        }else {
-            values.at(hash) = to_unsigned(kv.second);
+        uint64_t value = minimalHash ? pi : to_unsigned(kv.second);
+        pi++;
+        if(stashed.count(kv.first)){
+            // find_stash returns keys in the same order we visit them
+            stashValues.push_back(value);
+            std::cerr<<"  key="<<key<<" = "<<to_unsigned(key)<<", value="<<value<<" (stash)\n";
+            continue;
         }
-        std::cerr<<"  key="<<key<<" = "<<to_unsigned(key)<<", value="<<values[hash]<<"\n";
+        auto hash=bh(key);
+        unsigned entry=hash*groupSize + fill.at(hash)++;
+        values.at(entry) = value;
+        std::cerr<<"  key="<<key<<" = "<<to_unsigned(key)<<", value="<<values[entry]<<"\n";
 
     }
 
     dst << indent << "unsigned " << name << "_hash(unsigned x);\n";
+    if(groupSize>1){
+        dst << indent << "int " << name << "_entry(unsigned x);\n";
+    }
     dst<<"\n";
     dst<<indent<<"unsigned long long "<<name<<"_lookup(unsigned x){\n";
-    dst<<indent<<"  static const unsigned long long values["<<(1<<bh.wO)<<"] = {\n";
+    dst<<indent<<"  static const unsigned long long values["<<nEntries<<"] = {\n";
     for(unsigned i=0;i<values.size();i++){
         dst<<indent<<"    "<<values[i]<<"ull";
         if(i!=values.size()-1)
@@ -132,12 +206,21 @@ void write_cpp_lookup(const BitHash &bh, const key_value_set &keys, std::string
         dst<<"\n";
     }
     dst<<indent<<"  };\n";
-    dst<<indent<<"  unsigned long long value=values["<<name<<"_hash(x)];\n";
+    for(unsigned i=0;i<stash.size();i++){
+        dst<<indent<<"  if((x&"<<to_unsigned(stash[i].get_concrete_mask(bh.wI))<<"u)=="<<to_unsigned(*stash[i].variants_begin())<<"u) return "<<stashValues[i]<<"ull;\n";
+    }
+    if(groupSize>1){
+        dst<<indent<<"  int entry="<<name<<"_entry(x);\n";
+        dst<<indent<<"  unsigned long long value= entry<0 ? 0xFFFFFFFFFFFFFFFFull : values[entry];\n";
+    }else{
+        dst<<indent<<"  unsigned long long value=values["<<name<<"_hash(x)];\n";
+    }
     dst<<indent<<"  return value;\n";
     dst<<indent<<"}\n";
 }
 
-void write_cpp_test(const BitHash &bh, const key_value_set &keys, std::string name, std::string indent, std::ostream &dst)
+template<class THash>
+void write_cpp_test(const THash &bh, const key_value_set &keys, std::string name, std::string indent, std::ostream &dst)
 {
     std::vector<std::tuple<bit_vector,bit_vector,bit_vector> > values;
 
@@ -8,6 +8,9 @@
 #include "bit_hash.hpp"
 #include "bit_hash_anneal.hpp"
 
+#include <atomic>
+#include <memory>
+
 template<class TSig>
 TSig toSignature(const EntryToKey &x)
 {
@@ -288,6 +291,242 @@ public:
 };
 
 
+/* Flattened access to the component hashes of a (possibly composite)
+ * signature, so that the blocked set can spread them across one block.
+ */
+template<class TSig>
+struct bit_sig_components
+{
+    static const unsigned count=1;
+
+    static void hashes(const TSig &sig, uint32_t *dst)
+    { dst[0]=sig.hash(); }
+
+    static void hashes_with_flip(const TSig &sig, unsigned flip, uint32_t *dst)
+    { dst[0]=sig.hash_with_flip(flip); }
+};
+
+template<class TFirst,class TRest>
+struct bit_sig_components<bit_sig_multi<TFirst,TRest> >
+{
+    static const unsigned count=bit_sig_components<TFirst>::count+bit_sig_components<TRest>::count;
+
+    static void hashes(const bit_sig_multi<TFirst,TRest> &sig, uint32_t *dst)
+    {
+        bit_sig_components<TFirst>::hashes(sig.first, dst);
+        bit_sig_components<TRest>::hashes(sig.rest, dst+bit_sig_components<TFirst>::count);
+    }
+
+    static void hashes_with_flip(const bit_sig_multi<TFirst,TRest> &sig, unsigned flip, uint32_t *dst)
+    {
+        bit_sig_components<TFirst>::hashes_with_flip(sig.first, flip, dst);
+        bit_sig_components<TRest>::hashes_with_flip(sig.rest, flip, dst+bit_sig_components<TFirst>::count);
+    }
+};
+
+/* A counting filter like bit_sig_multi_set, but blocked so that all the
+ * probes for one signature land in the same 64 byte cache line. The first
+ * component hash chooses the block, and each component then chooses one
+ * counter within it.
+ *
+ * Counters are atomic so that several search threads can share one set.
+ * They saturate at 255 rather than wrapping; a saturated counter is never
+ * decremented again, which can only cause false positives.
+ */
+template<class TSig>
+class bit_sig_blocked_set
+{
+public:
+    static const unsigned BlockSize=64;
+    static const unsigned Probes=bit_sig_components<TSig>::count;
+
+    /* Everything needed to add or remove a signature later on, which is
+     * much smaller than the signature itself. */
+    struct probe_t
+    {
+        uint32_t block;
+        uint8_t slots[Probes];
+    };
+
+private:
+    struct block_t
+    {
+        std::atomic<uint8_t> counts[BlockSize];
+    };
+
+    unsigned m_log2Blocks;
+    unsigned m_shift;
+    std::unique_ptr<char[]> m_storage;
+    block_t *m_blocks;
+
+    probe_t makeProbe(const uint32_t *hashes) const
+    {
+        probe_t res;
+        // Multiplicative mix, as the component hashes may not have good high bits
+        res.block=m_log2Blocks==0 ? 0 : uint32_t(hashes[0]*2654435761u)>>m_shift;
+        for(unsigned i=0; i<Probes; i++){
+            res.slots[i]=hashes[i]%BlockSize;
+        }
+        return res;
+    }
+
+    bool containsProbe(const probe_t &p) const
+    {
+        const block_t &b=m_blocks[p.block];
+        for(unsigned i=0; i<Probes; i++){
+            if(b.counts[p.slots[i]].load(std::memory_order_relaxed)==0)
+                return false;
+        }
+        return true;
+    }
+
+public:
+    bit_sig_blocked_set(unsigned log2Blocks)
+        : m_log2Blocks(log2Blocks)
+        , m_shift(32-log2Blocks)
+    {
+        size_t n=size_t(1)<<log2Blocks;
+        size_t bytes=n*sizeof(block_t);
+
+        // new[] does not have to honour over-alignment in C++11
+        size_t space=bytes+BlockSize;
+        m_storage.reset(new char[space]);
+        void *p=m_storage.get();
+        if(!std::align(BlockSize, bytes, p, space))
+            throw std::runtime_error("bit_sig_blocked_set : couldn't align storage.");
+        m_blocks=(block_t*)p;
+
+        for(size_t i=0; i<n; i++){
+            block_t *b=new (m_blocks+i) block_t;
+            for(unsigned j=0; j<BlockSize; j++){
+                b->counts[j].store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bit_sig_blocked_set(const bit_sig_blocked_set &) = delete;
+    void operator=(const bit_sig_blocked_set &) = delete;
+
+    probe_t probe(const TSig &sig) const
+    {
+        uint32_t hashes[Probes];
+        bit_sig_components<TSig>::hashes(sig, hashes);
+        return makeProbe(hashes);
+    }
+
+    bool contains(const TSig &sig) const
+    { return containsProbe(probe(sig)); }
+
+    bool contains_with_flip(const TSig &sig, unsigned flip) const
+    {
+        uint32_t hashes[Probes];
+        bit_sig_components<TSig>::hashes_with_flip(sig, flip, hashes);
+        return containsProbe(makeProbe(hashes));
+    }
+
+    void add(const probe_t &p)
+    {
+        block_t &b=m_blocks[p.block];
+        for(unsigned i=0; i<Probes; i++){
+            std::atomic<uint8_t> &c=b.counts[p.slots[i]];
+            uint8_t v=c.load(std::memory_order_relaxed);
+            while(v<255 && !c.compare_exchange_weak(v, v+1, std::memory_order_relaxed)){
+                // v is reloaded on failure
+            }
+        }
+    }
+
+    void remove(const probe_t &p)
+    {
+        block_t &b=m_blocks[p.block];
+        for(unsigned i=0; i<Probes; i++){
+            std::atomic<uint8_t> &c=b.counts[p.slots[i]];
+            uint8_t v=c.load(std::memory_order_relaxed);
+            while(v>0 && v<255 && !c.compare_exchange_weak(v, v-1, std::memory_order_relaxed)){
+                // v is reloaded on failure
+            }
+            assert(v>0);
+        }
+    }
+
+    void add(const TSig &sig)
+    { add(probe(sig)); }
+
+    void remove(const TSig &sig)
+    { remove(probe(sig)); }
+
+    double load() const
+    {
+        double n=0;
+        size_t nBlocks=size_t(1)<<m_log2Blocks;
+        for(size_t i=0; i<nBlocks; i++){
+            for(unsigned j=0; j<BlockSize; j++){
+                if(m_blocks[i].counts[j].load(std::memory_order_relaxed)>0)
+                    n++;
+            }
+        }
+        return n/(nBlocks*BlockSize);
+    }
+};
+
+/* Ages entries out of a shared bit_sig_blocked_set, keeping the most recent
+ * maxSize entries added through it. Each search thread should have its own
+ * ring, and only the compact probe records are stored.
+ */
+template<class TSig>
+class bit_sig_tabu_ring
+{
+public:
+    typedef bit_sig_blocked_set<TSig> set_t;
+private:
+    set_t &m_set;
+    std::vector<typename set_t::probe_t> m_ring;
+    size_t m_next;
+    size_t m_size;
+public:
+    bit_sig_tabu_ring(set_t &set, size_t maxSize)
+        : m_set(set)
+        , m_ring(maxSize)
+        , m_next(0)
+        , m_size(0)
+    {
+        assert(maxSize>0);
+    }
+
+    ~bit_sig_tabu_ring()
+    { clear(); }
+
+    bit_sig_tabu_ring(const bit_sig_tabu_ring &) = delete;
+    void operator=(const bit_sig_tabu_ring &) = delete;
+
+    void add(const TSig &sig)
+    {
+        if(m_size==m_ring.size()){
+            m_set.remove(m_ring[m_next]);
+        }else{
+            m_size++;
+        }
+        m_ring[m_next]=m_set.probe(sig);
+        m_set.add(m_ring[m_next]);
+        m_next=(m_next+1)%m_ring.size();
+    }
+
+    void clear()
+    {
+        size_t i=(m_next+m_ring.size()-m_size)%m_ring.size();
+        while(m_size>0){
+            m_set.remove(m_ring[i]);
+            i=(i+1)%m_ring.size();
+            m_size--;
+        }
+        m_next=0;
+    }
+
+    size_t size() const
+    { return m_size; }
+};
+
+
 
 /*
 struct packed_bits
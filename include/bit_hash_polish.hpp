@@ -7,6 +7,7 @@
 
 #include "bit_hash_cnf.hpp"
 #include "bit_hash_anneal.hpp"
+#include "premix.hpp"
 
 /* In a non-working solution, we are going to get a few clashes, but hopefully a
  * small number. If we have wO bits, and there are nC clashing pairs, then in the
@@ -21,18 +22,29 @@
  * solution - we area already likely to be stuck in some local minima.
  * */
 
-/* Calculate a list of keys which clash, plus the number of clashes they are involved in */
+/* Calculate a list of keys which clash, plus the number of clashes they are involved in.
+ * A ternary key is counted in every hash that one of its variants reaches, and
+ * also clashes with itself if its variants do not all agree. */
 std::vector<std::pair<bit_vector,int> > find_clashing_keys(const BitHash &bh, const key_value_set &problem)
 {
     std::vector<std::vector<bit_vector> > hits(1<<bh.wO);
 
+    std::map<bit_vector,int> clashes;
+
     for(const auto &kv : problem)
     {
-        unsigned h=bh(kv.first);
-        hits[h].push_back(kv.first);
+        std::set<unsigned> hs;
+        for(auto it=kv.first.variants_begin(); it!=kv.first.variants_end(); ++it){
+            hs.insert(bh(*it));
+        }
+        for(unsigned h : hs){
+            hits[h].push_back(kv.first);
+        }
+        if(hs.size() > 1){
+            clashes[kv.first] += hs.size()-1;
+        }
     }
 
-    std::map<bit_vector,int> clashes;
     for(const auto &h : hits){
         if(h.size() > 1){
             for(const auto &k : h){
@@ -57,9 +69,15 @@ std::vector<std::pair<std::pair<int,int>,int> > find_clashing_entries(const BitH
 
     for(const auto &kh : keys){
         for(unsigned ti=0;ti<bh.tables.size();ti++){
-            unsigned li=bh.tables[ti].address(kh.first);
+            // Ternary keys may read several entries of each table
+            std::set<unsigned> lis;
+            for(auto it=kh.first.variants_begin(); it!=kh.first.variants_end(); ++it){
+                lis.insert(bh.tables[ti].address(*it));
+            }
 
-            hits[std::make_pair(ti,li)] += kh.second;
+            for(unsigned li : lis){
+                hits[std::make_pair(ti,li)] += kh.second;
+            }
         }
     }
 
@@ -71,14 +89,52 @@ std::vector<std::pair<std::pair<int,int>,int> > find_clashing_entries(const BitH
     return res;
 };
 
-template<class TRng>
-BitHash bit_hash_polish(TRng &rng, const BitHash &bh, const key_value_set &problem, int verbose)
+/* Find the keys which read any of the given lut entries, and return every entry
+ * that those keys read (i.e. the neighbourhood of the entries). */
+std::vector<std::pair<std::pair<int,int>,int> > find_entry_neighbours(const BitHash &bh, const key_value_set &problem, const std::set<std::pair<int,int> > &entries)
 {
-    std::uniform_real_distribution<> udist;
+    std::vector<std::pair<bit_vector,int> > keys;
+    for(const auto &kv : problem){
+        bool hit=false;
+        for(auto it=kv.first.variants_begin(); it!=kv.first.variants_end() && !hit; ++it){
+            for(unsigned ti=0; ti<bh.tables.size() && !hit; ti++){
+                hit=entries.count(std::make_pair((int)ti, (int)bh.tables[ti].address(*it)))>0;
+            }
+        }
+        if(hit){
+            keys.push_back(std::make_pair(kv.first, 1));
+        }
+    }
+    return find_clashing_entries(bh, keys);
+}
 
+/* Unbind the clashing entries and re-solve with everything else held fixed.
+ * If that fails, minisat's final conflict tells us which of the fixed entries
+ * were actually involved, so those are unbound for the next round (along with
+ * all the entries of the keys which read them, if expandCore is set). Each
+ * round frees at least one more entry, so this stops once the problem is
+ * solved, or the conflict no longer involves any fixed entries (in which case
+ * there is no solution with this shuffle).
+ *
+ * With a premix the tables only see the mixed keys, so those are polished
+ * and the premix is put back in front.
+ */
+template<class TRng>
+BitHash bit_hash_polish(TRng &rng, const BitHash &bh, const key_value_set &problem, int verbose, bool expandCore=false)
+{
     if(bh.is_solution(problem))
         return bh;
 
+    if(!bh.premix.empty()){
+        BitHash inner(bh);
+        inner.wI=bh.premix.size();
+        inner.premix.clear();
+        auto res=bit_hash_polish(rng, inner, premixKeys(bh.premix, problem), verbose, expandCore);
+        res.wI=bh.wI;
+        res.premix=bh.premix;
+        return res;
+    }
+
     unsigned nEntries=0;
     for(const auto &t : bh.tables){
         nEntries+=t.lut.size();
@@ -104,52 +160,82 @@ BitHash bit_hash_polish(TRng &rng, const BitHash &bh, const key_value_set &probl
         }
     }
 
-    double extra=0.01;
-    while(extra<1) {
-        double todo=extra*nEntries;
+    // Encode the whole problem once, with every lut entry free. Keeping a bit
+    // at its current value is then just an assumption, so widening the set of
+    // unbound bits only drops assumptions, and the solver keeps what it has
+    // learnt from earlier rounds.
+    BitHash free(bh);
+    for(auto &t : free.tables){
+        std::fill(t.lut.begin(), t.lut.end(), -1);
+    }
+    cnf_problem prob;
+    to_cnf(free, problem.keys(), prob, problem.getMaxHash(), 1, problem.getMaxStash()>0);
+    if(problem.getMaxStash()>0){
+        requireAtMostK(prob.sat, prob.stashLits, problem.getMaxStash());
+    }
 
-        if(verbose > 0){
-            std::cerr<<"   trying with clash = "<< clashBits.size() / (double)nEntries <<" extra = "<<extra<<"\n";
-        }
+    // Maps: CNF variable -> (table,lutBit)
+    std::vector<std::pair<int,int> > varToEntry(prob.sat.nVars(), std::make_pair(-1,-1));
+    for(const auto &bit : prob.lutToVariable){
+        varToEntry[bit.second-1]=std::make_pair((int)bit.first.first, (int)bit.first.second);
+    }
 
-        double done=0.0;
+    std::set<std::pair<int,int> > unbound;
+    for(const auto &x : clashBits){
+        unbound.insert(x.first);
+    }
 
-        BitHash res(bh);
+    Minisat::vec<Minisat::Lit> assumps;
 
-        for(unsigned i=0; i< clashBits.size(); i++){
-            auto x = clashBits[i];
-            res.tables[x.first.first].lut[x.first.second] = -1;
-            done++;
-            if(done>= todo)
-                break;
+    unsigned round=0;
+    while(1) {
+        if(verbose > 0){
+            std::cerr<<"   round "<<round<<", unbound = "<< unbound.size() / (double)nEntries <<"\n";
         }
 
-
-        for(auto &t: res.tables){
-            for(auto &b : t.lut){
-                if(udist(rng) < extra){
-                    b=-1;
-                    done++;
-                }
-                if(done>=todo)
-                    break;
+        assumps.clear();
+        for(const auto &bit : prob.lutToVariable){
+            if(unbound.count(std::make_pair((int)bit.first.first, (int)bit.first.second))==0){
+                int v=bh.tables[bit.first.first].lut[bit.first.second];
+                assumps.push(Minisat::mkLit(bit.second-1, v==0));
             }
         }
 
-        cnf_problem prob;
-        to_cnf(res, problem.keys(), prob);
-        auto sol = minisat_solve(prob);
+        auto sol = minisat_solve(prob, assumps);
         if (verbose > 0) {
-            std::cerr << "  CNF solution " << (sol.empty() ? "Failed" : "Succeeded") << "\n";
+            std::cerr << "  CNF solution with "<<assumps.size()<<" fixed bits " << (sol.empty() ? "Failed" : "Succeeded") << "\n";
         }
 
         if (!sol.empty()) {
-            res = substitute(res, prob, sol);
+            return substitute(free, prob, sol);
+        }
 
-            return res;
+        // The final conflict is a clause over the negated assumptions
+        std::set<std::pair<int,int> > core;
+        const auto &conflict=prob.sat.conflict;
+        for(int i=0; i<conflict.size(); i++){
+            auto e=varToEntry.at(Minisat::var(conflict[i]));
+            if(e.first!=-1 && unbound.count(e)==0){
+                core.insert(e);
+            }
+        }
+        if(core.empty()){
+            if(verbose>0){
+                std::cerr<<"  Conflict does not involve any fixed bits, giving up.\n";
+            }
+            break;
+        }
+        if(verbose>0){
+            std::cerr<<"  Core contains "<<core.size()<<" fixed bits\n";
         }
 
-        extra=extra*1.5;
+        unbound.insert(core.begin(), core.end());
+        if(expandCore){
+            for(const auto &x : find_entry_neighbours(bh, problem, core)){
+                unbound.insert(x.first);
+            }
+        }
+        round++;
     }
 
     return bh;
@@ -9,9 +9,9 @@
 
 #include <cfloat>
 
-void randomised_greedy(EntryToKey &et, int groupSize)
+template<class TRng>
+void randomised_greedy(TRng &urng, EntryToKey &et, int groupSize)
 {
-    auto &urng = solve_context::rng();
     std::uniform_real_distribution<> udist;
 
     for(int i=0;i<et.bitCount();i++){
@@ -82,24 +82,38 @@ void randomised_greedy(EntryToKey &et, int groupSize)
     et.sync();
 }
 
-void relink_path(EntryToKey &et, const BitHash &dst, int groupSize)
+void randomised_greedy(EntryToKey &et, int groupSize)
 {
-    auto &urng = solve_context::rng();
+    randomised_greedy(solve_context::rng(), et, groupSize);
+}
 
-    double eTotalBest=et.eval(groupSize);
-    BitHash bTotalBest=et.bh;
+/* Walk from the current point towards dst, greedily flipping whichever of
+ * the remaining differing bits gives the best score, and finish at the best
+ * point seen along the way.
+ *
+ * Only bits in the difference set are ever flipped, and each flip makes that
+ * bit agree with dst, so the set just shrinks by one (swap-remove) at each
+ * step. The best point is kept as a position in the path (plus at most one
+ * extra trial flip), and is recovered by undoing flips from the end.
+ */
+template<class TRng>
+void relink_path(TRng &urng, EntryToKey &et, const BitHash &dst, int groupSize)
+{
+    std::vector<int> differences=et.getDifferenceIndices(dst);
 
-    while(1){
-        std::vector<int> differences=et.getDifferenceIndices(dst);
-        //fprintf(stderr, "  distance = %d\n", differences.size());
+    std::vector<int> path;
+    path.reserve(differences.size());
 
-        if(differences.size()==0)
-            break;
+    double eTotalBest=et.eval(groupSize);
+    unsigned bestLength=0;
+    int bestExtra=-1;
 
-        double eBest=DBL_MAX;
+    // We may have multiple equivalent solutions
+    std::vector<unsigned> flipBest;
 
-        // We may have multiple equivalent solutions
-        std::vector<int> flipBest;
+    while(differences.size()>0){
+        double eBest=DBL_MAX;
+        flipBest.clear();
 
         for(unsigned i=0; i<differences.size(); i++){
             int d=differences[i];
@@ -110,28 +124,46 @@ void relink_path(EntryToKey &et, const BitHash &dst, int groupSize)
             if(eCurr < eBest){
                 eBest = eCurr;
                 flipBest.clear();
-                flipBest.push_back(d);
+                flipBest.push_back(i);
             }else if(eCurr==eBest){
-                flipBest.push_back(d);
+                flipBest.push_back(i);
             }
 
-            if(eBest < eTotalBest){
-                eTotalBest=eBest;
-                bTotalBest=et.bh;
+            if(eCurr < eTotalBest){
+                eTotalBest=eCurr;
+                bestLength=path.size();
+                bestExtra=d;
             }
 
             et.flipBit(d);
         }
 
+        unsigned sel=flipBest[urng()%flipBest.size()];
+        int d=differences[sel];
+        differences[sel]=differences.back();
+        differences.pop_back();
 
+        et.flipBit(d);
+        path.push_back(d);
 
-        int sel=urng()%flipBest.size();
-        int i=flipBest.at(sel);
-        et.flipBit(i);
+        if(bestExtra==d && bestLength+1==path.size()){
+            bestExtra=-1;
+            bestLength=path.size();
+        }
     }
 
-    et.bh=bTotalBest;
-    et.sync();
+    while(path.size()>bestLength){
+        et.flipBit(path.back());
+        path.pop_back();
+    }
+    if(bestExtra!=-1){
+        et.flipBit(bestExtra);
+    }
+}
+
+void relink_path(EntryToKey &et, const BitHash &dst, int groupSize)
+{
+    relink_path(solve_context::rng(), et, dst, groupSize);
 }
 
 
@@ -7,6 +7,24 @@
 
 #include "key_value_set.hpp"
 
+#include <set>
+
+//! Condition which is true when the input key matches stashed key k
+std::string vhdl_stash_match(const bit_vector &k, unsigned wI)
+{
+    unsigned tag=to_unsigned(*k.variants_begin());
+    unsigned mask=to_unsigned(k.get_concrete_mask(wI));
+    std::string res="(key and \"";
+    for(int i=wI-1;i>=0;i--){
+        res+=((mask>>i)&1) ? '1' : '0';
+    }
+    res+="\") = \"";
+    for(int i=wI-1;i>=0;i--){
+        res+=((tag>>i)&1) ? '1' : '0';
+    }
+    return res+"\"";
+}
+
 void write_vhdl_hash(const BitHash &bh, std::string name, std::string indent, std::ostream &dst)
 {
     unsigned wI=bh.wI, wO=bh.wO;
@@ -39,13 +57,32 @@ void write_vhdl_hash(const BitHash &bh, std::string name, std::string indent, st
         dst<<indent<<"  signal addr_"<<i<<" : std_logic_vector("<<(t.selectors.size()-1)<<" downto 0);\n";
         dst<<indent<<"  signal bit_"<<i<<" : std_logic;\n";
     }
+    // With a premix the tables read the mixed bits rather than the key
+    std::string src="key";
+    if(!bh.premix.empty()){
+        src="mixed";
+        dst<<indent<<"  signal mixed : std_logic_vector("<<(bh.premix.size()-1)<<" downto 0);\n";
+    }
     dst<<indent<<"begin\n";
+    if(!bh.premix.empty()){
+        dst<<indent<<"  -- Premix, one XOR level\n";
+        for(unsigned j=0;j<bh.premix.size();j++){
+            dst<<indent<<"  mixed("<<j<<") <= ";
+            if(bh.premix[j].empty()){
+                dst<<"'0'";
+            }
+            for(unsigned k=0;k<bh.premix[j].size();k++){
+                dst<<(k==0?"":" xor ")<<"key("<<bh.premix[j][k]<<")";
+            }
+            dst<<";\n";
+        }
+    }
     dst<<indent<<"  -- Addresses and bits\n";
     for(unsigned i=0;i<bh.tables.size();i++){
         const auto &t = bh.tables[i];
         dst<<indent<<"  addr_"<<i<<" <= ";
         for(int j=t.selectors.size()-1;j>=0;j--){
-            dst<<"key("<<t.selectors[j]<<")";
+            dst<<src<<"("<<t.selectors[j]<<")";
             if(j!=0)
                 dst<<" & ";
         }
@@ -63,25 +100,43 @@ void write_vhdl_hash(const BitHash &bh, std::string name, std::string indent, st
     dst<<indent<<"end RTL;\n";
 }
 
-void write_vhdl_hit(const BitHash &bh, const key_value_set &keys, std::string name, std::string indent, std::ostream &dst)
+/* The hit, lookup and test writers only need wI, wO, operator() and
+ * find_stash from the hash, so also work for the other kinds of hash.
+ *
+ * With groupSize>1 each hash owns groupSize consecutive entries of the
+ * tables, filled in key order, and the hit entity compares all of them side
+ * by side. It then has an extra entry port giving the matching entry, which
+ * name_lookup reads its value with. */
+template<class THash>
+void write_vhdl_hit(const THash &bh, const key_value_set &keys, std::string name, std::string indent, std::ostream &dst, unsigned groupSize=1)
 {
     unsigned wI=bh.wI, wO=bh.wO;
+    unsigned nEntries=(1u<<wO)*groupSize;
+    unsigned wN=(unsigned)ceil(log2(nEntries));
 
     // Set up sentinel values which can never be equal to any input key
-    std::vector<unsigned> tags(1<<wO, 1<<wI);
-    std::vector<unsigned> masks(1<<wO, 0);
+    std::vector<unsigned> tags(nEntries, 1<<wI);
+    std::vector<unsigned> masks(nEntries, 0);
+    std::vector<unsigned> fill(1u<<wO, 0);
 
     bool hasMask=!keys.has_concrete_keys();
     unsigned wEntry=1 + (hasMask ? 2*wI : wI);
 
+    // Keys which don't fit in the table are matched directly instead
+    auto stash=find_checked_stash(bh, keys, groupSize);
+    std::set<bit_vector> stashed(stash.begin(), stash.end());
+
     // Mark out the valid tags
     for(auto kv : keys){
+        if(stashed.count(kv.first))
+            continue;
         auto key=* kv.first.variants_begin();
         auto hash=bh(key);
         std::cerr<<"  key="<<key<<" = "<<to_unsigned(key)<<"\n";
-        tags.at(hash)=to_unsigned(key);
+        unsigned entry=hash*groupSize + fill.at(hash)++;
+        tags.at(entry)=to_unsigned(key);
 
-        masks.at(hash)=to_unsigned(key.get_concrete_mask(bh.wI));
+        masks.at(entry)=to_unsigned(key.get_concrete_mask(bh.wI));
     }
 
     dst<<indent<<"library ieee;\n";
@@ -92,6 +147,9 @@ void write_vhdl_hit(const BitHash &bh, const key_value_set &keys, std::string na
     dst<<indent<<"  port (\n";
     dst<<indent<<"    key : in std_logic_vector("<<(wI-1)<<" downto 0);\n";
     dst<<indent<<"    hit : out std_logic;\n";
+    if(groupSize>1){
+        dst<<indent<<"    entry : out std_logic_vector("<<(wN-1)<<" downto 0);\n";
+    }
     dst<<indent<<"    hash : out std_logic_vector("<<(wO-1)<<" downto 0)\n";
     dst<<indent<<"  );\n";
     dst<<indent<<"end "<<name<<"_hit;\n\n";
@@ -104,7 +162,7 @@ void write_vhdl_hit(const BitHash &bh, const key_value_set &keys, std::string na
     dst<<indent<<"    );\n";
     dst<<indent<<"  end component;\n";
 
-    dst<<indent<<"  type tag_array_t is array(0 to "<<((1<<wO)-1)<<") of std_logic_vector("<<(wEntry-1)<<" downto 0);\n";
+    dst<<indent<<"  type tag_array_t is array(0 to "<<(nEntries-1)<<") of std_logic_vector("<<(wEntry-1)<<" downto 0);\n";
     dst<<indent<<"  signal tags : tag_array_t := (\n";
     for(unsigned i=0;i<tags.size();i++){
         uint64_t val=(uint64_t(masks[i])<<(wI+1)) | tags[i];
@@ -119,26 +177,60 @@ void write_vhdl_hit(const BitHash &bh, const key_value_set &keys, std::string na
     }
     dst<<indent<<"  );\n";
     dst<<indent<<"  signal gotHash : std_logic_vector("<<(wO-1)<<" downto 0);\n";
-    dst<<indent<<"  signal tag : std_logic_vector("<<(wEntry-1)<<" downto 0);\n";
+    if(groupSize>1){
+        dst<<indent<<"  type group_array_t is array(0 to "<<(groupSize-1)<<") of std_logic_vector("<<(wEntry-1)<<" downto 0);\n";
+        dst<<indent<<"  signal grp_tags : group_array_t;\n";
+        dst<<indent<<"  signal match : std_logic_vector("<<(groupSize-1)<<" downto 0);\n";
+    }else{
+        dst<<indent<<"  signal tag : std_logic_vector("<<(wEntry-1)<<" downto 0);\n";
+    }
+    dst<<indent<<"  signal tableHit, stashHit : std_logic;\n";
     dst<<indent<<"begin\n";
     dst<<indent<<"   theHash : "<<name<<"_hash port map(key=>key,hash=>gotHash);\n";
     dst<<indent<<"\n";
-    dst<<indent<<"  tag <= tags(to_integer(unsigned(gotHash)));\n";
-    if(keys.has_concrete_keys()) {
-        dst << indent << "  hit <= '1' when tag = (\"0\"&key) else '0';\n";
+    if(groupSize>1){
+        for(unsigned i=0;i<groupSize;i++){
+            dst<<indent<<"  grp_tags("<<i<<") <= tags(to_integer(unsigned(gotHash))*"<<groupSize<<"+"<<i<<");\n";
+            if(hasMask){
+                dst<<indent<<"  match("<<i<<") <= '1' when grp_tags("<<i<<")("<<wI<<" downto 0) = (\"0\" & (key and grp_tags("<<i<<")("<<(wEntry-1)<<" downto "<<(wI+1)<<"))) else '0';\n";
+            }else{
+                dst<<indent<<"  match("<<i<<") <= '1' when grp_tags("<<i<<") = (\"0\"&key) else '0';\n";
+            }
+        }
+        dst<<indent<<"  tableHit <= '0' when match = ("<<(groupSize-1)<<" downto 0 => '0') else '1';\n";
+        dst<<indent<<"  entry <= ";
+        for(unsigned i=0;i<groupSize;i++){
+            dst<<"std_logic_vector(to_unsigned(to_integer(unsigned(gotHash))*"<<groupSize<<"+"<<i<<", "<<wN<<")) when match("<<i<<")='1' else\n"<<indent<<"           ";
+        }
+        dst<<"("<<(wN-1)<<" downto 0 => '0');\n";
     }else{
-        dst << indent << "  hit <= '1' when (key and mask) = tag else '0' ;\n";
+        dst<<indent<<"  tag <= tags(to_integer(unsigned(gotHash)));\n";
+        if(keys.has_concrete_keys()) {
+            dst << indent << "  tableHit <= '1' when tag = (\"0\"&key) else '0';\n";
+        }else{
+            dst << indent << "  tableHit <= '1' when (key and mask) = tag else '0' ;\n";
+        }
     }
+    dst<<indent<<"  stashHit <= ";
+    for(const auto &k : stash){
+        dst<<"'1' when "<<vhdl_stash_match(k, wI)<<" else\n"<<indent<<"              ";
+    }
+    dst<<"'0';\n";
+    dst<<indent<<"  hit <= tableHit or stashHit;\n";
     dst<<indent<<"  hash <= gotHash;\n";
     dst<<indent<<"end RTL;\n";
 }
 
-void write_vhdl_lookup(const BitHash &bh, const key_value_set &keys, std::string name, std::string indent, std::ostream &dst)
+template<class THash>
+void write_vhdl_lookup(const THash &bh, const key_value_set &keys, std::string name, std::string indent, std::ostream &dst, unsigned groupSize=1)
 {
     unsigned wI=bh.wI, wO=bh.wO;
+    unsigned nEntries=(1u<<wO)*groupSize;
+    unsigned wN=(unsigned)ceil(log2(nEntries));
 
     // Fill with (hopefully) poison values
-    std::vector<uint64_t> values(1<<bh.wO, 0xFFFFFFFFFFFFFFFFull);
+    std::vector<uint64_t> values(nEntries, 0xFFFFFFFFFFFFFFFFull);
+    std::vector<unsigned> fill(1u<<wO, 0);
 
     unsigned wV = keys.getKeyWidth();
     bool minimalHash=false;
@@ -147,17 +239,23 @@ void write_vhdl_lookup(const BitHash &bh, const key_value_set &keys, std::string
         wV=(unsigned)ceil(log2(keys.size()));
     }
 
-    // Fill in the valid keys
+    auto stash=find_checked_stash(bh, keys, groupSize);
+    std::set<bit_vector> stashed(stash.begin(), stash.end());
+    std::vector<uint64_t> stashValues;
+
+    // Fill in the valid keys, in the same entries as write_vhdl_hit
     unsigned pi=0;
     for(auto kv : keys){
         auto key=*kv.first.variants_begin();
-        auto hash=bh(key);
-        if(minimalHash){
-            values.at(hash) = pi;
-            pi++;
-        }else {
-            values.at(hash) = to_unsigned(kv.second);
+        uint64_t value = minimalHash ? pi : to_unsigned(kv.second);
+        pi++;
+        if(stashed.count(kv.first)){
+            // find_stash returns keys in the same order we visit them
+            stashValues.push_back(value);
+            continue;
         }
+        auto hash=bh(key);
+        values.at(hash*groupSize + fill.at(hash)++) = value;
     }
 
 
@@ -179,11 +277,14 @@ void write_vhdl_lookup(const BitHash &bh, const key_value_set &keys, std::string
     dst<<indent<<"    port (\n";
     dst<<indent<<"      key : in std_logic_vector("<<(wI-1)<<" downto 0);\n";
     dst<<indent<<"      hash : out std_logic_vector("<<(wO-1)<<" downto 0);\n";
+    if(groupSize>1){
+        dst<<indent<<"      entry : out std_logic_vector("<<(wN-1)<<" downto 0);\n";
+    }
     dst<<indent<<"      hit : out std_logic\n";
     dst<<indent<<"    );\n";
     dst<<indent<<"  end component;\n";
 
-    dst<<indent<<"  type value_array_t is array(0 to "<<((1<<wO)-1)<<") of std_logic_vector("<<(wV-1)<<" downto 0);\n";
+    dst<<indent<<"  type value_array_t is array(0 to "<<(nEntries-1)<<") of std_logic_vector("<<(wV-1)<<" downto 0);\n";
     dst<<indent<<"  signal values : value_array_t := (\n";
     for(unsigned i=0;i<values.size();i++){
         uint64_t val=values[i];
@@ -198,17 +299,35 @@ void write_vhdl_lookup(const BitHash &bh, const key_value_set &keys, std::string
     }
     dst<<indent<<"  );\n";
     dst<<indent<<"  signal gotHash : std_logic_vector("<<(wO-1)<<" downto 0);\n";
+    std::string index="gotHash";
+    if(groupSize>1){
+        index="gotEntry";
+        dst<<indent<<"  signal gotEntry : std_logic_vector("<<(wN-1)<<" downto 0);\n";
+    }
     //dst<<indent<<"  signal val : std_logic_vector("<<(wV-1)<<" downto 0);\n";
     dst<<indent<<"begin\n";
-    dst<<indent<<"   theHash : "<<name<<"_hit port map(key=>key,hash=>gotHash,hit=>hit);\n";
+    if(groupSize>1){
+        dst<<indent<<"   theHash : "<<name<<"_hit port map(key=>key,hash=>gotHash,entry=>gotEntry,hit=>hit);\n";
+    }else{
+        dst<<indent<<"   theHash : "<<name<<"_hit port map(key=>key,hash=>gotHash,hit=>hit);\n";
+    }
     dst<<indent<<"\n";
-    dst<<indent<<"  value <= values(to_integer(unsigned(gotHash)));\n";
+    dst<<indent<<"  value <= ";
+    for(unsigned i=0;i<stash.size();i++){
+        dst<<"\"";
+        for(int j=wV-1;j>=0;j--){
+            dst<<((stashValues[i]>>j)&1);
+        }
+        dst<<"\" when "<<vhdl_stash_match(stash[i], wI)<<" else\n"<<indent<<"           ";
+    }
+    dst<<"values(to_integer(unsigned("<<index<<")));\n";
     dst<<indent<<"  hash <= gotHash;\n";
     dst<<indent<<"end RTL;\n";
 }
 
 
-void write_vhdl_test(const BitHash &bh, const key_value_set &keys, std::string name, std::string indent, std::ostream &dst)
+template<class THash>
+void write_vhdl_test(const THash &bh, const key_value_set &keys, std::string name, std::string indent, std::ostream &dst)
 {
     unsigned wI=bh.wI, wO=bh.wO, wV=keys.getKeyWidth();
     unsigned wEntry=wI+wO+wV;
@@ -106,13 +106,16 @@ struct cnf_expr_t
     }
 };
 
-cnf_expr_t makeLessThanOrEqual(Minisat::Solver &s, const std::vector<Minisat::Lit> &x, const bit_vector &val, int i)
+/* x<=val, where x[0] is the LSB. The bits of x may be constants as well as
+ * literals, and constants are folded away rather than reaching the solver.
+ */
+cnf_expr_t makeLessThanOrEqual(Minisat::Solver &s, const std::vector<cnf_expr_t> &x, const bit_vector &val, int i)
 {
     if(i==0){ // LSB
         if(val[0]==1){
             return cnf_expr_t(s,true);
         }else if(val[0]==0){
-            return cnf_expr_t(s,~x[0]);
+            return ~x[0];
         }else{
             throw std::runtime_error("Bits must be concrete.");
         }
@@ -120,19 +123,94 @@ cnf_expr_t makeLessThanOrEqual(Minisat::Solver &s, const std::vector<Minisat::Li
         cnf_expr_t next=makeLessThanOrEqual(s, x, val, i-1);
 
         if(val[i]==1){
-            return cnf_expr_t(s,~x[i]) | next;
+            return ~x[i] | next;
         }else if(val[i]==0){
-            return cnf_expr_t(s,~x[i]) & next;
+            return ~x[i] & next;
         }else{
             throw std::runtime_error("Bits must be concrete.");
         }
     }
 }
 
-void requireLessThanOrEqual(Minisat::Solver &s, const std::vector<Minisat::Lit> &x, const bit_vector &val)
+void requireLessThanOrEqual(Minisat::Solver &s, const std::vector<cnf_expr_t> &x, const bit_vector &val)
 {
     auto ok=makeLessThanOrEqual(s, x, val, x.size()-1);
     ok.requireTrue();
 }
 
+/* Require that at most k of the literals in x are true, using the sequential
+ * counter encoding (Sinz, 2005). This needs k*(n-1) extra variables and
+ * about 2nk clauses. Register s[i][j] is true if at least j+1 of x[0..i]
+ * are true.
+ */
+void requireAtMostK(Minisat::Solver &s, const std::vector<Minisat::Lit> &x, unsigned k)
+{
+    unsigned n=x.size();
+    if(n<=k)
+        return;
+
+    if(k==0){
+        for(const auto &l : x){
+            s.addClause(~l);
+        }
+        return;
+    }
+
+    std::vector<std::vector<Minisat::Lit> > r(n-1, std::vector<Minisat::Lit>(k));
+    for(unsigned i=0; i<n-1; i++){
+        for(unsigned j=0; j<k; j++){
+            r[i][j]=Minisat::mkLit(s.newVar());
+        }
+    }
+
+    s.addClause(~x[0], r[0][0]);
+    for(unsigned j=1; j<k; j++){
+        s.addClause(~r[0][j]);
+    }
+
+    for(unsigned i=1; i<n-1; i++){
+        s.addClause(~x[i], r[i][0]);
+        s.addClause(~r[i-1][0], r[i][0]);
+        for(unsigned j=1; j<k; j++){
+            s.addClause(~x[i], ~r[i-1][j-1], r[i][j]);
+            s.addClause(~r[i-1][j], r[i][j]);
+        }
+        s.addClause(~x[i], ~r[i-1][k-1]);
+    }
+
+    s.addClause(~x[n-1], ~r[n-2][k-1]);
+}
+
+/* Build a sequential counter over x with k outputs, where out[j] is forced
+ * true if at least j+1 of x are true. Only that direction is encoded, so
+ * assuming ~out[j] means that at most j of x may be true, which allows a
+ * bound to be tightened incrementally with assumptions.
+ */
+std::vector<Minisat::Lit> makeSequentialCounter(Minisat::Solver &s, const std::vector<Minisat::Lit> &x, unsigned k)
+{
+    std::vector<Minisat::Lit> prev, curr(k);
+    if(k==0)
+        return prev;
+
+    for(unsigned i=0; i<x.size(); i++){
+        for(unsigned j=0; j<k; j++){
+            curr[j]=Minisat::mkLit(s.newVar());
+        }
+
+        s.addClause(~x[i], curr[0]);
+        for(unsigned j=0; j<k; j++){
+            if(!prev.empty()){
+                s.addClause(~prev[j], curr[j]);
+                if(j>0){
+                    s.addClause(~x[i], ~prev[j-1], curr[j]);
+                }
+            }
+        }
+
+        prev=curr;
+    }
+
+    return prev;
+}
+
 #endif //FPGA_PERFECT_HASH_CNF_HELPERS_HPP
@@ -0,0 +1,87 @@
+#ifndef FPGA_PERFECT_HASH_CONCENTRATED_HASH_HPP
+#define FPGA_PERFECT_HASH_CONCENTRATED_HASH_HPP
+
+#include "bit_hash.hpp"
+#include "key_value_set.hpp"
+
+/* A perfect hash behind a concentrator. The front stage brings the wI bit
+ * key down to front.wO bits, and only has to be injective on the key set,
+ * which is much easier than being perfect. The back stage is then a normal
+ * perfect hash of the narrower key. An XOR concentrator is held as a BitHash
+ * whose luts are parity functions, so both kinds are just a BitHash.
+ */
+struct ConcentratedHash
+{
+    unsigned wI;
+    unsigned wO;
+
+    BitHash front;
+    BitHash back;
+
+    unsigned operator()(unsigned x) const
+    { return back(front(x)); }
+
+    unsigned operator()(const bit_vector &x) const
+    { return back(front(x)); }
+
+    std::vector<bit_vector> find_stash(const key_value_set &keys, unsigned groupSize=1) const
+    { return find_stash_of(*this, keys, groupSize); }
+
+    bool is_solution(const key_value_set &keys, unsigned groupSize=1) const
+    {
+        return find_stash(keys, groupSize).size() <= keys.getMaxStash();
+    }
+
+    void print(std::ostream &dst, std::string prefix="") const
+    {
+        dst<<prefix<<"ConcentratedHashBegin "<<wO<<" "<<wI<<" "<<front.wO<<"\n";
+        front.print(dst, prefix+"  ");
+        back.print(dst, prefix+"  ");
+        dst<<prefix<<"ConcentratedHashEnd\n";
+    }
+};
+
+ConcentratedHash parse_concentrated_hash(std::istream &src)
+{
+    ConcentratedHash res;
+    unsigned wC;
+
+    expect_token(src, "ConcentratedHashBegin")>>res.wO>>res.wI>>wC;
+    res.front=parse_bit_hash(src);
+    res.back=parse_bit_hash(src);
+    if(res.front.wI!=res.wI || res.front.wO!=wC || res.back.wI!=wC || res.back.wO!=res.wO)
+        throw std::runtime_error("Persisted concentrated hash is corrupt.");
+    expect_token(src, "ConcentratedHashEnd");
+
+    return res;
+}
+
+//! A key as seen by the back stage
+bit_vector concentrateKey(const BitHash &front, const bit_vector &key)
+{
+    std::vector<int> kb(front.wO);
+    unsigned c=front(*key.variants_begin());
+    for(unsigned i=0; i<front.wO; i++){
+        kb[i]=(c>>i)&1;
+    }
+    return bit_vector(kb);
+}
+
+//! The keys as seen by the back stage. The values are unchanged.
+key_value_set concentrateKeys(const BitHash &front, const key_value_set &keys)
+{
+    std::map<bit_vector,bit_vector> entries;
+    for(const auto &kv : keys){
+        if(!entries.insert(std::make_pair(concentrateKey(front, kv.first), kv.second)).second)
+            throw std::runtime_error("concentrateKeys : concentrator is not injective on the keys.");
+    }
+
+    key_value_set res(entries);
+    res.setMaxStash(keys.getMaxStash());
+    if(keys.getMaxHash()>0){
+        res.setMaxHash(keys.getMaxHash());
+    }
+    return res;
+}
+
+#endif //FPGA_PERFECT_HASH_CONCENTRATED_HASH_HPP
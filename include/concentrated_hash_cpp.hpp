@@ -0,0 +1,19 @@
+#ifndef FPGA_PERFECT_HASH_CONCENTRATED_HASH_CPP_HPP
+#define FPGA_PERFECT_HASH_CONCENTRATED_HASH_CPP_HPP
+
+#include "bit_hash_cpp.hpp"
+#include "concentrated_hash.hpp"
+
+//! Each stage is its own function (name_front_hash and name_back_hash), and name_hash chains them
+void write_cpp_concentrated_hash(const ConcentratedHash &ch, std::string name, std::string indent, std::ostream &dst)
+{
+    write_cpp_hash(ch.front, name+"_front", indent, dst);
+    dst<<"\n";
+    write_cpp_hash(ch.back, name+"_back", indent, dst);
+    dst<<"\n";
+    dst<<indent<<"unsigned "<<name<<"_hash(unsigned x){\n";
+    dst<<indent<<"  return "<<name<<"_back_hash("<<name<<"_front_hash(x));\n";
+    dst<<indent<<"}\n";
+}
+
+#endif //FPGA_PERFECT_HASH_CONCENTRATED_HASH_CPP_HPP
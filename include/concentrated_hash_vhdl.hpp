@@ -0,0 +1,52 @@
+#ifndef FPGA_PERFECT_HASH_CONCENTRATED_HASH_VHDL_HPP
+#define FPGA_PERFECT_HASH_CONCENTRATED_HASH_VHDL_HPP
+
+#include "bit_hash_vhdl.hpp"
+#include "concentrated_hash.hpp"
+
+/* Each stage is its own entity (name_front_hash and name_back_hash), and
+ * name_hash chains them, with the same ports as write_vhdl_hash so that
+ * write_vhdl_hit and friends sit on top of it unchanged.
+ */
+void write_vhdl_concentrated_hash(const ConcentratedHash &ch, std::string name, std::string indent, std::ostream &dst)
+{
+    unsigned wI=ch.wI, wO=ch.wO, wC=ch.front.wO;
+
+    write_vhdl_hash(ch.front, name+"_front", indent, dst);
+    dst<<"\n";
+    write_vhdl_hash(ch.back, name+"_back", indent, dst);
+    dst<<"\n";
+
+    dst<<indent<<"library ieee;\n";
+    dst<<indent<<"use ieee.std_logic_1164.all;\n";
+    dst<<indent<<"use ieee.numeric_std.all;\n\n";
+
+    dst<<indent<<"entity "<<name<<"_hash is \n";
+    dst<<indent<<"  port (\n";
+    dst<<indent<<"    key : in std_logic_vector("<<(wI-1)<<" downto 0);\n";
+    dst<<indent<<"    hash : out std_logic_vector("<<(wO-1)<<" downto 0)\n";
+    dst<<indent<<"  );\n";
+    dst<<indent<<"end entity "<<name<<"_hash;\n";
+    dst<<"\n";
+
+    dst<<indent<<"architecture RTL of "<<name<<"_hash is\n";
+    dst<<indent<<"  component "<<name<<"_front_hash \n";
+    dst<<indent<<"    port (\n";
+    dst<<indent<<"      key : in std_logic_vector("<<(wI-1)<<" downto 0);\n";
+    dst<<indent<<"      hash : out std_logic_vector("<<(wC-1)<<" downto 0)\n";
+    dst<<indent<<"    );\n";
+    dst<<indent<<"  end component;\n";
+    dst<<indent<<"  component "<<name<<"_back_hash \n";
+    dst<<indent<<"    port (\n";
+    dst<<indent<<"      key : in std_logic_vector("<<(wC-1)<<" downto 0);\n";
+    dst<<indent<<"      hash : out std_logic_vector("<<(wO-1)<<" downto 0)\n";
+    dst<<indent<<"    );\n";
+    dst<<indent<<"  end component;\n";
+    dst<<indent<<"  signal narrow : std_logic_vector("<<(wC-1)<<" downto 0);\n";
+    dst<<indent<<"begin\n";
+    dst<<indent<<"  theFront : "<<name<<"_front_hash port map(key=>key,hash=>narrow);\n";
+    dst<<indent<<"  theBack : "<<name<<"_back_hash port map(key=>narrow,hash=>hash);\n";
+    dst<<indent<<"end RTL;\n";
+}
+
+#endif //FPGA_PERFECT_HASH_CONCENTRATED_HASH_VHDL_HPP
@@ -0,0 +1,275 @@
+#ifndef FPGA_PERFECT_HASH_CUCKOO_HASH_HPP
+#define FPGA_PERFECT_HASH_CUCKOO_HASH_HPP
+
+#include "bit_hash.hpp"
+#include "key_value_set.hpp"
+
+#include <algorithm>
+#include <climits>
+
+/* Incremental maximum matching of keys to slots, where key k may go to
+ * slots[0][k] or slots[1][k] (or UINT_MAX if that choice is unusable), and
+ * each slot holds up to capacity keys. Keys are added by augmenting paths,
+ * found breadth first so that the fewest keys move. If every unplaced key is
+ * retried after a change then the matching stays maximum (Berge), so settle
+ * gives the exact number of keys which can't be placed, in O(n) time as
+ * failed searches share their dead ends.
+ */
+struct cuckoo_matching
+{
+    unsigned capacity;
+    std::vector<unsigned> slots[2];
+    std::vector<int> choice;    // -1 if the key is not placed
+    std::vector<std::vector<unsigned> > occupants;
+    unsigned unplaced;
+
+    // Scratch for augment
+    std::vector<unsigned> slotSeen, keySeen, fromKey, queue;
+    unsigned stamp=0;
+
+    cuckoo_matching(unsigned nSlots, unsigned nKeys, unsigned _capacity)
+        : capacity(_capacity)
+        , choice(nKeys, -1)
+        , occupants(nSlots)
+        , unplaced(nKeys)
+        , slotSeen(nSlots, 0)
+        , keySeen(nKeys, 0)
+        , fromKey(nSlots, 0)
+    {
+        slots[0].assign(nKeys, UINT_MAX);
+        slots[1].assign(nKeys, UINT_MAX);
+    }
+
+    unsigned current(unsigned k) const
+    { return choice[k]==-1 ? UINT_MAX : slots[choice[k]][k]; }
+
+    void remove(unsigned k)
+    {
+        auto &occ=occupants[current(k)];
+        occ.erase(std::find(occ.begin(), occ.end(), k));
+        choice[k]=-1;
+        unplaced++;
+    }
+
+    void put(unsigned k, int c)
+    {
+        occupants[slots[c][k]].push_back(k);
+        choice[k]=c;
+        unplaced--;
+    }
+
+    //! Change where choice c sends key k, which unplaces it if it was using that choice
+    void set_slot(unsigned k, int c, unsigned s)
+    {
+        if(choice[k]==c)
+            remove(k);
+        slots[c][k]=s;
+    }
+
+    /*! Try to place unplaced key k, moving other keys along the shortest
+        augmenting path. If fresh is false then nothing has moved since the
+        last augment failed, so everything it reached is still a dead end
+        and is not searched again. */
+    bool augment(unsigned k, bool fresh=true)
+    {
+        if(fresh && ++stamp==0){
+            std::fill(slotSeen.begin(), slotSeen.end(), 0);
+            std::fill(keySeen.begin(), keySeen.end(), 0);
+            stamp=1;
+        }
+        if(keySeen[k]==stamp)
+            return false;
+        queue.clear();
+        queue.push_back(k);
+        keySeen[k]=stamp;
+        for(unsigned qi=0; qi<queue.size(); qi++){
+            unsigned u=queue[qi];
+            for(int c=0; c<2; c++){
+                unsigned s=slots[c][u];
+                if(s==UINT_MAX || c==choice[u] || slotSeen[s]==stamp)
+                    continue;
+                slotSeen[s]=stamp;
+                fromKey[s]=u;
+                if(occupants[s].size()<capacity){
+                    // Walk back along the path, moving each key into the slot the one after it left
+                    unsigned v=u, target=s;
+                    while(true){
+                        unsigned old=current(v);
+                        if(old!=UINT_MAX)
+                            remove(v);
+                        put(v, slots[0][v]==target ? 0 : 1);
+                        if(old==UINT_MAX)
+                            return true;
+                        target=old;
+                        v=fromKey[old];
+                    }
+                }
+                for(unsigned o : occupants[s]){
+                    if(keySeen[o]!=stamp){
+                        keySeen[o]=stamp;
+                        queue.push_back(o);
+                    }
+                }
+            }
+        }
+        return false;
+    }
+
+    //! Retry every unplaced key, and return how many still can't be placed
+    unsigned settle()
+    {
+        bool fresh=true;
+        for(unsigned k=0; k<choice.size() && unplaced>0; k++){
+            if(choice[k]==-1)
+                fresh=augment(k, fresh);
+        }
+        return unplaced;
+    }
+};
+
+/* Two-choice (cuckoo style) hashing with LUT hashes. The table is split into
+ * two banks of 2^(wO-1) slots, and bank c is addressed by choices[c], so key
+ * x can live in slot (c<<(wO-1)) | choices[c](x) for either c. A lookup
+ * reads both banks and compares both tags, so which bank a key went to only
+ * matters when building the tables, and is found by place. With two choices
+ * most keys have somewhere else to go, so the luts only need to make the
+ * placement possible rather than be perfect on their own, which is much
+ * easier at high load.
+ */
+struct CuckooHash
+{
+    unsigned wI;
+    unsigned wO;
+
+    BitHash choices[2];
+
+    //! The slot key x would use with choice c
+    unsigned slot(int c, unsigned x) const
+    { return (unsigned(c)<<(wO-1)) | choices[c](x); }
+
+    unsigned slot(int c, const bit_vector &x) const
+    { return (unsigned(c)<<(wO-1)) | choices[c](x); }
+
+    /*! A maximum matching of the keys (in key order) to slots, giving the
+        choice each key uses, or -1 if it has to be stashed. A choice is
+        unusable for a key if its variants don't agree on the slot, or the
+        slot is at or above the maxHash. */
+    std::vector<int> place(const key_value_set &keys, unsigned groupSize=1) const
+    {
+        unsigned maxHash=keys.getMaxHash();
+        cuckoo_matching m(1u<<wO, keys.keys_size(), groupSize);
+
+        unsigned ki=0;
+        for(const auto &kv : keys){
+            for(int c=0; c<2; c++){
+                auto it=kv.first.variants_begin(), end=kv.first.variants_end();
+                unsigned s=slot(c, *it);
+                bool ok = !(maxHash>0 && s>=maxHash);
+                for(++it; ok && it!=end; ++it){
+                    ok = slot(c, *it)==s;
+                }
+                m.slots[c][ki] = ok ? s : UINT_MAX;
+            }
+            ki++;
+        }
+        m.settle();
+        return m.choice;
+    }
+
+    std::vector<bit_vector> find_stash(const key_value_set &keys, unsigned groupSize=1) const
+    {
+        auto placed=place(keys, groupSize);
+        std::vector<bit_vector> res;
+        unsigned ki=0;
+        for(const auto &kv : keys){
+            if(placed[ki++]==-1)
+                res.push_back(kv.first);
+        }
+        return res;
+    }
+
+    bool is_solution(const key_value_set &keys, unsigned groupSize=1) const
+    {
+        return find_stash(keys, groupSize).size() <= keys.getMaxStash();
+    }
+
+    void print(std::ostream &dst, std::string prefix="") const
+    {
+        dst<<prefix<<"CuckooHashBegin "<<wO<<" "<<wI<<"\n";
+        choices[0].print(dst, prefix+"  ");
+        choices[1].print(dst, prefix+"  ");
+        dst<<prefix<<"CuckooHashEnd\n";
+    }
+};
+
+CuckooHash parse_cuckoo_hash(std::istream &src)
+{
+    CuckooHash res;
+
+    expect_token(src, "CuckooHashBegin")>>res.wO>>res.wI;
+    res.choices[0]=parse_bit_hash(src);
+    res.choices[1]=parse_bit_hash(src);
+    if(res.wO<2 || res.choices[0].wO+1!=res.wO || res.choices[1].wO+1!=res.wO)
+        throw std::runtime_error("Persisted cuckoo hash is corrupt.");
+    expect_token(src, "CuckooHashEnd");
+
+    return res;
+}
+
+/* What the dual lookup in hardware computes, which is the bank whose tag
+ * matches the key (or bank 0 if neither does). It has the wI, wO,
+ * operator() and find_stash that write_cpp_lookup and friends need, so the
+ * value tables and tests are built with those writers unchanged.
+ */
+struct CuckooLookup
+{
+    unsigned wI;
+    unsigned wO;
+
+    CuckooHash hash;
+    std::vector<bit_vector> stash;
+    std::vector<unsigned> tags, masks;   // Per slot, with tag 1<<wI for an empty slot
+
+    CuckooLookup(const CuckooHash &_hash, const key_value_set &keys)
+        : wI(_hash.wI)
+        , wO(_hash.wO)
+        , hash(_hash)
+    {
+        // The empty tag must be wider than any key, so must still fit in an unsigned
+        if(wI >= 32){
+            throw std::runtime_error("CuckooLookup : keys must be narrower than 32 bits.");
+        }
+        tags.assign(1u<<wO, 1u<<wI);
+        masks.assign(1u<<wO, 0);
+
+        auto placed=hash.place(keys);
+        unsigned ki=0;
+        for(const auto &kv : keys){
+            int c=placed[ki++];
+            if(c==-1){
+                stash.push_back(kv.first);
+                continue;
+            }
+            unsigned s=hash.slot(c, *kv.first.variants_begin());
+            tags.at(s)=to_unsigned(*kv.first.variants_begin());
+            masks.at(s)=to_unsigned(kv.first.get_concrete_mask(wI));
+        }
+    }
+
+    bool matches(unsigned s, unsigned x) const
+    { return (x&masks[s])==tags[s]; }
+
+    unsigned operator()(unsigned x) const
+    {
+        unsigned s1=hash.slot(1, x);
+        return matches(s1, x) ? s1 : hash.slot(0, x);
+    }
+
+    unsigned operator()(const bit_vector &x) const
+    { return (*this)(to_unsigned(x)); }
+
+    std::vector<bit_vector> find_stash(const key_value_set &, unsigned =1) const
+    { return stash; }
+};
+
+#endif //FPGA_PERFECT_HASH_CUCKOO_HASH_HPP
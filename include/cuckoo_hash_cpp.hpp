@@ -0,0 +1,78 @@
+#ifndef FPGA_PERFECT_HASH_CUCKOO_HASH_CPP_HPP
+#define FPGA_PERFECT_HASH_CUCKOO_HASH_CPP_HPP
+
+#include "bit_hash_cpp.hpp"
+#include "cuckoo_hash.hpp"
+
+//! Each choice is its own function (name_choice0_hash and name_choice1_hash)
+void write_cpp_cuckoo_hash(const CuckooHash &ch, std::string name, std::string indent, std::ostream &dst)
+{
+    write_cpp_hash(ch.choices[0], name+"_choice0", indent, dst);
+    dst<<"\n";
+    write_cpp_hash(ch.choices[1], name+"_choice1", indent, dst);
+    dst<<"\n";
+}
+
+/* The dual lookup. Both banks are read and both tags compared, so name_hit
+ * is true if either matches, and name_hash is the slot whose tag matched
+ * (or the bank 0 slot if neither did). The tags are shared at file scope,
+ * and write_cpp_lookup and write_cpp_test can then be used with the
+ * CuckooLookup as they stand.
+ */
+void write_cpp_cuckoo_hit(const CuckooLookup &cl, const key_value_set &keys, std::string name, std::string indent, std::ostream &dst)
+{
+    bool hasMask=!keys.has_concrete_keys();
+
+    dst<<indent<<"unsigned "<<name<<"_choice0_hash(unsigned x);\n";
+    dst<<indent<<"unsigned "<<name<<"_choice1_hash(unsigned x);\n";
+    dst<<"\n";
+    dst<<indent<<"static const unsigned "<<name<<"_tags["<<(1<<cl.wO)<<"] = {\n";
+    for(unsigned i=0;i<cl.tags.size();i++){
+        dst<<indent<<"  "<<cl.tags[i];
+        if(i!=cl.tags.size()-1)
+            dst<<",";
+        dst<<"\n";
+    }
+    dst<<indent<<"};\n";
+    if(hasMask){
+        dst<<indent<<"static const unsigned "<<name<<"_masks["<<(1<<cl.wO)<<"] = {\n";
+        for(unsigned i=0;i<cl.masks.size();i++){
+            dst<<indent<<"  "<<cl.masks[i];
+            if(i!=cl.masks.size()-1)
+                dst<<",";
+            dst<<"\n";
+        }
+        dst<<indent<<"};\n";
+    }
+    dst<<"\n";
+
+    auto match=[&](const char *h) -> std::string
+    {
+        std::string tag=name+"_tags["+h+"]";
+        if(!hasMask)
+            return tag+"==x";
+        return tag+"==(x&"+name+"_masks["+h+"])";
+    };
+
+    auto probes=[&]()
+    {
+        dst<<indent<<"  unsigned h0="<<name<<"_choice0_hash(x);\n";
+        dst<<indent<<"  unsigned h1="<<(1u<<(cl.wO-1))<<"u | "<<name<<"_choice1_hash(x);\n";
+    };
+
+    dst<<indent<<"unsigned "<<name<<"_hash(unsigned x){\n";
+    probes();
+    dst<<indent<<"  return "<<match("h1")<<" ? h1 : h0;\n";
+    dst<<indent<<"}\n";
+    dst<<"\n";
+
+    dst<<indent<<"bool "<<name<<"_hit(unsigned x){\n";
+    for(const auto &k : find_checked_stash(cl, keys)){
+        dst<<indent<<"  if((x&"<<to_unsigned(k.get_concrete_mask(cl.wI))<<"u)=="<<to_unsigned(*k.variants_begin())<<"u) return true;\n";
+    }
+    probes();
+    dst<<indent<<"  return ("<<match("h0")<<") || ("<<match("h1")<<");\n";
+    dst<<indent<<"}\n";
+}
+
+#endif //FPGA_PERFECT_HASH_CUCKOO_HASH_CPP_HPP
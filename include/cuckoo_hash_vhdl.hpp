@@ -0,0 +1,94 @@
+#ifndef FPGA_PERFECT_HASH_CUCKOO_HASH_VHDL_HPP
+#define FPGA_PERFECT_HASH_CUCKOO_HASH_VHDL_HPP
+
+#include "bit_hash_vhdl.hpp"
+#include "cuckoo_hash.hpp"
+
+//! Each choice is its own entity (name_choice0_hash and name_choice1_hash)
+void write_vhdl_cuckoo_hash(const CuckooHash &ch, std::string name, std::string indent, std::ostream &dst)
+{
+    write_vhdl_hash(ch.choices[0], name+"_choice0", indent, dst);
+    dst<<"\n";
+    write_vhdl_hash(ch.choices[1], name+"_choice1", indent, dst);
+    dst<<"\n";
+}
+
+/* The dual lookup, with the same ports as write_vhdl_hit. Each bank is its
+ * own tag rom, addressed by its own choice, so the two reads and compares
+ * happen side by side. The hash is the slot whose tag matched (or the bank 0
+ * slot if neither did), so write_vhdl_lookup and write_vhdl_test can sit on
+ * top of it with the CuckooLookup as they stand.
+ */
+void write_vhdl_cuckoo_hit(const CuckooLookup &cl, const key_value_set &keys, std::string name, std::string indent, std::ostream &dst)
+{
+    unsigned wI=cl.wI, wO=cl.wO, wR=cl.wO-1;
+
+    bool hasMask=!keys.has_concrete_keys();
+    unsigned wEntry=1 + (hasMask ? 2*wI : wI);
+
+    dst<<indent<<"library ieee;\n";
+    dst<<indent<<"use ieee.std_logic_1164.all;\n";
+    dst<<indent<<"use ieee.numeric_std.all;\n\n";
+
+    dst<<indent<<"entity "<<name<<"_hit is \n";
+    dst<<indent<<"  port (\n";
+    dst<<indent<<"    key : in std_logic_vector("<<(wI-1)<<" downto 0);\n";
+    dst<<indent<<"    hit : out std_logic;\n";
+    dst<<indent<<"    hash : out std_logic_vector("<<(wO-1)<<" downto 0)\n";
+    dst<<indent<<"  );\n";
+    dst<<indent<<"end "<<name<<"_hit;\n\n";
+
+    dst<<indent<<"architecture RTL of "<<name<<"_hit is\n";
+    for(unsigned c=0;c<2;c++){
+        dst<<indent<<"  component "<<name<<"_choice"<<c<<"_hash \n";
+        dst<<indent<<"    port (\n";
+        dst<<indent<<"      key : in std_logic_vector("<<(wI-1)<<" downto 0);\n";
+        dst<<indent<<"      hash : out std_logic_vector("<<(wR-1)<<" downto 0)\n";
+        dst<<indent<<"    );\n";
+        dst<<indent<<"  end component;\n";
+    }
+
+    dst<<indent<<"  type tag_array_t is array(0 to "<<((1<<wR)-1)<<") of std_logic_vector("<<(wEntry-1)<<" downto 0);\n";
+    for(unsigned c=0;c<2;c++){
+        dst<<indent<<"  signal tags"<<c<<" : tag_array_t := (\n";
+        for(unsigned i=0;i<(1u<<wR);i++){
+            unsigned s=(c<<wR)|i;
+            uint64_t val=(uint64_t(cl.masks[s])<<(wI+1)) | cl.tags[s];
+            dst<<indent<<"    "<<i<<" => \"";
+            for(int j=wEntry-1;j>=0;j--){
+                dst<<((val>>j)&1);
+            }
+            dst<<"\"";
+            if(i!=(1u<<wR)-1)
+                dst<<",";
+            dst<<"\n";
+        }
+        dst<<indent<<"  );\n";
+    }
+    dst<<indent<<"  signal h0, h1 : std_logic_vector("<<(wR-1)<<" downto 0);\n";
+    dst<<indent<<"  signal entry0, entry1 : std_logic_vector("<<(wEntry-1)<<" downto 0);\n";
+    dst<<indent<<"  signal hit0, hit1, stashHit : std_logic;\n";
+    dst<<indent<<"begin\n";
+    dst<<indent<<"  theChoice0 : "<<name<<"_choice0_hash port map(key=>key,hash=>h0);\n";
+    dst<<indent<<"  theChoice1 : "<<name<<"_choice1_hash port map(key=>key,hash=>h1);\n";
+    dst<<indent<<"\n";
+    for(unsigned c=0;c<2;c++){
+        dst<<indent<<"  entry"<<c<<" <= tags"<<c<<"(to_integer(unsigned(h"<<c<<")));\n";
+        if(hasMask){
+            // Mask above a tag with a sentinel bit, as in write_vhdl_hit
+            dst<<indent<<"  hit"<<c<<" <= '1' when entry"<<c<<"("<<wI<<" downto 0) = (\"0\" & (key and entry"<<c<<"("<<(wEntry-1)<<" downto "<<(wI+1)<<"))) else '0';\n";
+        }else{
+            dst<<indent<<"  hit"<<c<<" <= '1' when entry"<<c<<" = (\"0\"&key) else '0';\n";
+        }
+    }
+    dst<<indent<<"  stashHit <= ";
+    for(const auto &k : find_checked_stash(cl, keys)){
+        dst<<"'1' when "<<vhdl_stash_match(k, wI)<<" else\n"<<indent<<"              ";
+    }
+    dst<<"'0';\n";
+    dst<<indent<<"  hit <= hit0 or hit1 or stashHit;\n";
+    dst<<indent<<"  hash <= ('1' & h1) when hit1 = '1' else ('0' & h0);\n";
+    dst<<indent<<"end RTL;\n";
+}
+
+#endif //FPGA_PERFECT_HASH_CUCKOO_HASH_VHDL_HPP
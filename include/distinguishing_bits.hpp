@@ -0,0 +1,271 @@
+#ifndef FPGA_PERFECT_HASH_DISTINGUISHING_BITS_HPP
+#define FPGA_PERFECT_HASH_DISTINGUISHING_BITS_HPP
+
+#include "bit_hash.hpp"
+#include "bit_hash_cnf.hpp"
+
+#include "key_value_set.hpp"
+
+#include <cstdint>
+
+/* Find a small set of input bits which still tells every pair of key groups
+ * apart. Two groups are told apart by a bit if both define it and they
+ * differ there. This is a set cover over the pairs, but there are far too
+ * many pairs to list, so the keys are kept as classes which the chosen bits
+ * haven't told apart yet. Choosing a bit splits each class into the keys
+ * which are 0 and the keys which are 1 there, and keys which don't define
+ * it go to both sides, so two keys are still to be told apart exactly when
+ * they share a class. The greedy cover repeatedly takes the bit which
+ * splits the most pairs, counted from the sizes of the two sides.
+ *
+ * If confBudget is non-zero, minisat then tries to find covers with one
+ * fewer bit until that is unsatisfiable (the cover is minimum) or runs out
+ * of conflicts (negative means no limit). It only knows the pairs which a
+ * candidate cover has failed on so far, so each candidate is checked by
+ * refining with it, and any pairs left in a class are added before trying
+ * again.
+ *
+ * Returns the chosen bits in ascending order. Keys in a key_value_set never
+ * overlap, so every pair can be told apart by some bit.
+ */
+std::vector<unsigned> findDistinguishingBits(const key_value_set &keys, int64_t confBudget=0)
+{
+    using namespace Minisat;
+
+    unsigned wI=keys.getKeyWidth();
+    unsigned nWords=(wI+63)/64;
+
+    // Bits which are 1, and bits which are defined, for each key group
+    std::vector<std::vector<uint64_t> > ones, defined;
+    for(const auto &kv : keys){
+        ones.push_back(std::vector<uint64_t>(nWords, 0));
+        defined.push_back(std::vector<uint64_t>(nWords, 0));
+        for(unsigned b=0; b<wI; b++){
+            int v=kv.first[b];
+            if(v!=-1)
+                defined.back()[b/64] |= uint64_t(1)<<(b%64);
+            if(v==1)
+                ones.back()[b/64] |= uint64_t(1)<<(b%64);
+        }
+    }
+
+    auto has=[](const std::vector<uint64_t> &d, unsigned b) -> bool
+    { return (d[b/64]>>(b%64))&1; };
+
+    typedef std::vector<std::vector<unsigned> > classes_t;
+
+    // Split every class on bit b, dropping the classes which are done
+    auto refine=[&](const classes_t &from, unsigned b) -> classes_t
+    {
+        classes_t res;
+        std::vector<unsigned> sides[2];
+        for(const auto &c : from){
+            sides[0].clear();
+            sides[1].clear();
+            for(unsigned k : c){
+                if(!has(defined[k], b)){
+                    sides[0].push_back(k);
+                    sides[1].push_back(k);
+                }else{
+                    sides[has(ones[k], b)].push_back(k);
+                }
+            }
+            for(int s=0; s<2; s++){
+                if(sides[s].size()>1)
+                    res.push_back(sides[s]);
+            }
+        }
+        return res;
+    };
+
+    classes_t all(1);
+    for(unsigned k=0; k<ones.size(); k++){
+        all[0].push_back(k);
+    }
+    if(ones.size()<2)
+        all.clear();
+
+    std::vector<unsigned> chosen;
+    classes_t remaining(all);
+    std::vector<uint64_t> counts(wI);
+    std::vector<unsigned> n0(wI), n1(wI);
+    while(!remaining.empty()){
+        std::fill(counts.begin(), counts.end(), 0);
+        for(const auto &c : remaining){
+            std::fill(n0.begin(), n0.end(), 0);
+            std::fill(n1.begin(), n1.end(), 0);
+            for(unsigned k : c){
+                for(unsigned w=0; w<nWords; w++){
+                    uint64_t x=defined[k][w];
+                    while(x){
+                        unsigned b=__builtin_ctzll(x);
+                        x &= x-1;
+                        if((ones[k][w]>>b)&1){
+                            n1[w*64+b]++;
+                        }else{
+                            n0[w*64+b]++;
+                        }
+                    }
+                }
+            }
+            for(unsigned b=0; b<wI; b++){
+                counts[b] += uint64_t(n0[b])*n1[b];
+            }
+        }
+        unsigned b=std::max_element(counts.begin(), counts.end())-counts.begin();
+        if(counts[b]==0)
+            throw std::runtime_error("findDistinguishingBits : some keys can't be told apart.");
+        chosen.push_back(b);
+        remaining=refine(remaining, b);
+    }
+
+    if(confBudget!=0 && chosen.size()>1){
+        Solver S;
+        std::vector<Lit> use;
+        for(unsigned b=0; b<wI; b++){
+            use.push_back(mkLit(S.newVar()));
+        }
+
+        // The bits separating each pair we have a clause for. Many pairs are
+        // separated by the same bits, and only the distinct sets matter.
+        std::set<std::vector<uint64_t> > known;
+        std::vector<uint64_t> diff(nWords);
+        vec<Lit> lits;
+        auto addPair=[&](unsigned i, unsigned j)
+        {
+            for(unsigned w=0; w<nWords; w++){
+                diff[w]=(ones[i][w]^ones[j][w]) & defined[i][w] & defined[j][w];
+            }
+            if(!known.insert(diff).second)
+                return;
+            lits.clear();
+            for(unsigned b=0; b<wI; b++){
+                if(has(diff, b))
+                    lits.push(use[b]);
+            }
+            S.addClause(lits);
+        };
+
+        std::vector<Lit> counter=makeSequentialCounter(S, use, chosen.size());
+        vec<Lit> assumps;
+        std::vector<unsigned> candidate;
+        while(chosen.size()>1){
+            // At most chosen.size()-1 bits
+            assumps.clear();
+            assumps.push(~counter[chosen.size()-2]);
+            if(confBudget>0){
+                S.setConfBudget(confBudget);
+            }
+            lbool r=S.solveLimited(assumps);
+            if(r!=l_True)
+                break;
+
+            candidate.clear();
+            for(unsigned b=0; b<wI; b++){
+                if(S.model[var(use[b])]==l_True)
+                    candidate.push_back(b);
+            }
+            classes_t left(all);
+            for(unsigned b : candidate){
+                left=refine(left, b);
+            }
+            if(left.empty()){
+                chosen=candidate;
+            }else{
+                for(const auto &c : left){
+                    for(unsigned i=1; i<c.size(); i++){
+                        addPair(c[0], c[i]);
+                    }
+                }
+            }
+        }
+    }
+
+    std::sort(chosen.begin(), chosen.end());
+    return chosen;
+}
+
+/* Input bits which are defined in every key and are not the same in every
+ * key. A hash which only taps these gives the same output for every
+ * variant of a ternary key, and the other bits can't help anyway.
+ */
+std::vector<unsigned> findUsableBits(const key_value_set &keys)
+{
+    unsigned wI=keys.getKeyWidth();
+
+    std::vector<bool> defined(wI, true), seen0(wI, false), seen1(wI, false);
+    for(const auto &kv : keys){
+        for(unsigned i=0; i<wI; i++){
+            int v=kv.first[i];
+            defined[i] = defined[i] && v!=-1;
+            seen0[i] = seen0[i] || v==0;
+            seen1[i] = seen1[i] || v==1;
+        }
+    }
+    std::vector<unsigned> res;
+    for(unsigned i=0; i<wI; i++){
+        if(defined[i] && seen0[i] && seen1[i])
+            res.push_back(i);
+    }
+    return res;
+}
+
+//! findUsableBits for a solver which can't do anything without them, so it throws on behalf of who if there are none
+std::vector<unsigned> requireUsableBits(const key_value_set &keys, const char *who)
+{
+    auto res=findUsableBits(keys);
+    if(res.empty())
+        throw std::runtime_error(std::string(who)+" : no input bit is defined in every key and varies.");
+    return res;
+}
+
+/* A key_value_set can't have a maxHash beyond the span of its keys, so if
+ * the keys are projected onto too few bits for maxHash, add the lowest of
+ * the other inputs until they are wide enough. The extra bits don't have
+ * to tell any keys apart, they just make room for the hash range.
+ */
+std::vector<unsigned> widenForMaxHash(std::vector<unsigned> bits, unsigned wI, unsigned maxHash)
+{
+    for(unsigned b=0; b<wI && maxHash>(1ull<<bits.size()); b++){
+        if(std::find(bits.begin(), bits.end(), b)==bits.end())
+            bits.push_back(b);
+    }
+    std::sort(bits.begin(), bits.end());
+    return bits;
+}
+
+//! Keep only the given bits of every key, so bit i of the result is bit bits[i] of the input.
+//! maxHash is carried over, so there must be enough bits for it (see widenForMaxHash).
+key_value_set projectKeys(const key_value_set &keys, const std::vector<unsigned> &bits)
+{
+    std::map<bit_vector,bit_vector> entries;
+    std::vector<int> kb(bits.size());
+    for(const auto &kv : keys){
+        for(unsigned i=0; i<bits.size(); i++){
+            kb[i]=kv.first[bits[i]];
+        }
+        entries.insert(std::make_pair(bit_vector(kb), kv.second));
+    }
+
+    key_value_set res(entries);
+    res.setMaxStash(keys.getMaxStash());
+    if(keys.getMaxHash()>0){
+        res.setMaxHash(keys.getMaxHash());
+    }
+    return res;
+}
+
+//! The inverse of projectKeys for a hash, so that it taps the original inputs
+BitHash unprojectBitHash(const BitHash &bh, const std::vector<unsigned> &bits, unsigned wI)
+{
+    BitHash res(bh);
+    res.wI=wI;
+    for(auto &t : res.tables){
+        for(auto &s : t.selectors){
+            s=bits.at(s);
+        }
+    }
+    return res;
+}
+
+#endif //FPGA_PERFECT_HASH_DISTINGUISHING_BITS_HPP
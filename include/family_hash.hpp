@@ -5,6 +5,9 @@
 #ifndef FPGA_PERFECT_HASH_FAMILY_HASH_HPP
 #define FPGA_PERFECT_HASH_FAMILY_HASH_HPP
 
+#include "bit_hash.hpp"
+#include "key_value_set.hpp"
+
 /* Assume 2-bits of control per table, leaving 4 bits leftover for taps (wA).
  * Each entry gets 16 bits.
  * Total number of control bits will be 2*wO, which gives 2^(2+wO) configurations.
@@ -34,9 +37,195 @@
 
  */
 
-class FamilyHash
+/* (The combinations above are really 2^(c*wO), as each table has its own c
+ * control bits.)
+ *
+ * A family of hashes which share one netlist. Each table taps wT key bits
+ * and has a lut of 2^(wC+wT) entries, where the top wC address bits come
+ * from that table's part of the control word. So the taps and luts are
+ * fixed at synthesis time, and a new key set only needs a new control
+ * word, which is found by search_family_control.
+ */
+struct FamilyHash
 {
-    std::vector<
+    struct table
+    {
+        std::vector<unsigned> selectors;
+        std::vector<int> lut; // 2^(wC+selectors.size()) entries, control in the top bits
+
+        bool operator==(const table &o)const
+        { return selectors==o.selectors && lut==o.lut; }
+    };
+
+    unsigned wI;
+    unsigned wO;
+    unsigned wC; // Control bits per table
+    std::vector<table> tables;
+    std::vector<unsigned> control; // Sub-lut chosen for each table
+
+    //! The hash selected by the control word, as a plain BitHash
+    BitHash configure() const
+    {
+        BitHash res;
+        res.wI=wI;
+        res.wO=wO;
+        for(unsigned i=0;i<wO;i++){
+            const auto &t=tables[i];
+            unsigned n=1u<<t.selectors.size();
+            res.tables.push_back(BitHash::table());
+            res.tables.back().selectors=t.selectors;
+            res.tables.back().lut.assign(t.lut.begin()+control[i]*n, t.lut.begin()+(control[i]+1)*n);
+        }
+        return res;
+    }
+
+    unsigned operator()(unsigned x) const
+    {
+        unsigned acc=0;
+        for(unsigned i=0;i<wO;i++){
+            const auto &t=tables[i];
+            unsigned addr=control[i]<<t.selectors.size();
+            for(unsigned j=0;j<t.selectors.size();j++){
+                addr |= ((x>>t.selectors[j])&1)<<j;
+            }
+            acc |= unsigned(t.lut[addr]==1)<<i;
+        }
+        return acc;
+    }
+
+    unsigned operator()(const bit_vector &x) const
+    {
+        unsigned acc=0;
+        for(unsigned i=0;i<wO;i++){
+            const auto &t=tables[i];
+            unsigned addr=control[i]<<t.selectors.size();
+            for(unsigned j=0;j<t.selectors.size();j++){
+                int bit=x[t.selectors[j]];
+                if(bit==-1)
+                    throw std::runtime_error("Cannot lookup non-concrete key.");
+                addr |= unsigned(bit)<<j;
+            }
+            acc |= unsigned(t.lut[addr]==1)<<i;
+        }
+        return acc;
+    }
+
+    std::vector<bit_vector> find_stash(const key_value_set &keys, unsigned groupSize=1) const
+    { return configure().find_stash(keys, groupSize); }
+
+    bool is_solution(const key_value_set &keys, unsigned groupSize=1) const
+    { return configure().is_solution(keys, groupSize); }
+
+    //! The control word as one number, with table 0 in the low wC bits
+    uint64_t control_word() const
+    {
+        uint64_t res=0;
+        for(unsigned i=0;i<wO;i++){
+            res |= uint64_t(control[i])<<(i*wC);
+        }
+        return res;
+    }
+
+    void print(std::ostream &dst, std::string prefix="") const
+    {
+        assert(tables.size()==wO && control.size()==wO);
+        dst<<prefix<<"FamilyHashBegin "<<wO<<" "<<wI<<" "<<wC<<"\n";
+        dst<<prefix<<"  control";
+        for(unsigned c : control){
+            dst<<" "<<c;
+        }
+        dst<<"\n";
+        for(unsigned i=0;i<tables.size();i++){
+            const auto &t=tables[i];
+            assert(t.lut.size()==(1u<<(wC+t.selectors.size())));
+            dst<<prefix<<"  table "<<i<<" "<<t.selectors.size()<<"\n";
+            dst<<prefix<<"    sel";
+            for(unsigned s : t.selectors){
+                dst<<" "<<s;
+            }
+            dst<<"\n";
+            dst<<prefix<<"    lut "<<bit_vector(t.lut)<<"\n";
+        }
+        dst<<prefix<<"FamilyHashEnd\n";
+    }
 };
 
+FamilyHash parse_family_hash(std::istream &src)
+{
+    FamilyHash res;
+
+    expect_token(src, "FamilyHashBegin")>>res.wO>>res.wI>>res.wC;
+    res.control.resize(res.wO);
+    expect_token(src, "control");
+    for(unsigned i=0;i<res.wO;i++){
+        src>>res.control[i];
+        if(res.control[i]>=(1u<<res.wC))
+            throw std::runtime_error("Persisted family hash is corrupt.");
+    }
+    for(unsigned i=0;i<res.wO;i++){
+        res.tables.push_back(FamilyHash::table{});
+        auto &t = res.tables.back();
+        unsigned idx, wT;
+        expect_token(src, "table")>>idx>>wT;
+        if(idx!=i)
+            throw std::runtime_error("Persisted family hash is corrupt.");
+
+        t.selectors.resize(wT);
+        t.lut.resize(1<<(res.wC+wT));
+
+        expect_token(src, "sel");
+        for(unsigned j=0;j<t.selectors.size();j++){
+            src>>t.selectors[j];
+        }
+
+        bit_vector bv;
+        expect_token(src, "lut")>>bv;
+        for(unsigned j=0;j<t.lut.size();j++){
+            t.lut[j]=bv[j];
+        }
+    }
+    expect_token(src, "FamilyHashEnd");
+
+    return res;
+}
+
+/* A random family with wT taps and wC control bits per table. If the taps
+ * can span the key then every input is tapped at least once (as in
+ * makeRandomShuffle), otherwise each table just gets random taps.
+ */
+template<class TRng>
+FamilyHash makeFamilyHash(TRng &rng, unsigned wO, unsigned wI, unsigned wC, unsigned wT)
+{
+    wT=std::min(wT, wI);
+
+    std::vector<std::vector<unsigned> > shuffle;
+    if(wO*wT >= wI){
+        shuffle=makeRandomShuffle(rng, wO, wI, wT);
+    }else{
+        for(unsigned i=0;i<wO;i++){
+            std::set<unsigned> taps;
+            while(taps.size()<wT){
+                taps.insert(rng()%wI);
+            }
+            shuffle.emplace_back(taps.begin(), taps.end());
+        }
+    }
+
+    FamilyHash res;
+    res.wI=wI;
+    res.wO=wO;
+    res.wC=wC;
+    res.control.assign(wO, 0);
+    for(unsigned i=0;i<wO;i++){
+        res.tables.push_back(FamilyHash::table());
+        auto &t=res.tables.back();
+        t.selectors=shuffle[i];
+        t.lut.resize(1u<<(wC+t.selectors.size()));
+        for(int &le : t.lut){
+            le=rng()%2;
+        }
+    }
+    return res;
+}
+
 #endif //FPGA_PERFECT_HASH_FAMILY_HASH_HPP
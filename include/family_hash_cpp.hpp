@@ -0,0 +1,48 @@
+#ifndef FPGA_PERFECT_HASH_FAMILY_HASH_CPP_HPP
+#define FPGA_PERFECT_HASH_FAMILY_HASH_CPP_HPP
+
+#include "bit_hash_cpp.hpp"
+#include "family_hash.hpp"
+
+/* As write_cpp_hash, but the luts hold every member of the family, and the
+ * control word is a global (name_control) which picks the member. It starts
+ * out as the word that was found, and can be overwritten with a new one.
+ */
+void write_cpp_family_hash(const FamilyHash &fh, std::string name, std::string indent, std::ostream &dst)
+{
+    dst<<indent<<"unsigned long long "<<name<<"_control = "<<fh.control_word()<<"ull;\n";
+    dst<<"\n";
+    dst<<indent<<"unsigned "<<name<<"_hash(unsigned x){\n";
+    dst<<indent<<"  // ROMS\n";
+    for(unsigned i=0;i<fh.tables.size();i++){
+        const auto &t = fh.tables[i];
+        dst<<indent<<"  static const unsigned lut_"<<i<<"["<<t.lut.size()<<"] = {";
+        for(unsigned j=0;j<t.lut.size();j++){
+            if(j!=0)
+                dst<<",";
+            dst<<(t.lut[j]==1?'1':'0');
+        }
+        dst<<"};\n";
+    }
+    dst<<indent<<"  // Addresses and bits\n";
+    for(unsigned i=0;i<fh.tables.size();i++){
+        const auto &t = fh.tables[i];
+        dst<<indent<<"  unsigned addr_"<<i<<" = 0 ";
+        for(unsigned j=0;j<t.selectors.size();j++){
+            dst<<"| (((x>>"<<t.selectors[j]<<")&1)<<"<<j<<")";
+        }
+        dst<<"| (unsigned(("<<name<<"_control>>"<<(i*fh.wC)<<")&"<<((1u<<fh.wC)-1)<<")<<"<<t.selectors.size()<<")";
+        dst<<";\n";
+        dst<<indent<<"  unsigned bit_"<<i<<" = lut_"<<i<<"[addr_"<<i<<"];\n";
+    }
+    dst<<indent<<"  // Final composition\n";
+    dst<<indent<<"  unsigned result= 0 ";
+    for(unsigned i=0;i<fh.tables.size();i++){
+        dst<<"| (bit_"<<i<<"<<"<<i<<")";
+    }
+    dst<<";\n";
+    dst<<indent<<"  return result;\n";
+    dst<<indent<<"}\n";
+}
+
+#endif //FPGA_PERFECT_HASH_FAMILY_HASH_CPP_HPP
@@ -0,0 +1,113 @@
+#ifndef FPGA_PERFECT_HASH_FAMILY_HASH_VHDL_HPP
+#define FPGA_PERFECT_HASH_FAMILY_HASH_VHDL_HPP
+
+#include "bit_hash_vhdl.hpp"
+#include "family_hash.hpp"
+
+/* Two entities. name_family is the fixed netlist, with the control word as
+ * an input, and name_hash wraps it with the control word in a register,
+ * which resets to the word that was found and is loaded from control_in
+ * when control_load is high. The extra ports of name_hash all have
+ * defaults, so write_vhdl_hit and friends can still instantiate it with
+ * just key and hash (their tag and value ROMs are for this key set, so a
+ * real design would keep those in RAM, and load them with the word).
+ */
+void write_vhdl_family_hash(const FamilyHash &fh, std::string name, std::string indent, std::ostream &dst)
+{
+    unsigned wI=fh.wI, wO=fh.wO, wCtl=fh.wO*fh.wC;
+    uint64_t word=fh.control_word();
+
+    dst<<indent<<"library ieee;\n";
+    dst<<indent<<"use ieee.std_logic_1164.all;\n";
+    dst<<indent<<"use ieee.numeric_std.all;\n\n";
+
+    dst<<indent<<"entity "<<name<<"_family is \n";
+    dst<<indent<<"  port (\n";
+    dst<<indent<<"    control : in std_logic_vector("<<(wCtl-1)<<" downto 0);\n";
+    dst<<indent<<"    key : in std_logic_vector("<<(wI-1)<<" downto 0);\n";
+    dst<<indent<<"    hash : out std_logic_vector("<<(wO-1)<<" downto 0)\n";
+    dst<<indent<<"  );\n";
+    dst<<indent<<"end entity "<<name<<"_family;\n";
+    dst<<"\n";
+
+    dst<<indent<<"architecture RTL of "<<name<<"_family is\n";
+    dst<<indent<<"  -- ROMS, with the control bits at the top of the address\n";
+    for(unsigned i=0;i<fh.tables.size();i++){
+        const auto &t = fh.tables[i];
+        dst<<indent<<"  signal lut_"<<i<<" : std_logic_vector("<<(t.lut.size()-1)<<" downto 0) := \"";
+        for(int j=t.lut.size()-1;j>=0;j--){
+            dst<<(t.lut[j]==1?'1':'0');
+        }
+        dst<<"\";\n";
+    }
+    dst<<indent<<"  -- Addresses and bits\n";
+    for(unsigned i=0;i<fh.tables.size();i++){
+        const auto &t = fh.tables[i];
+        dst<<indent<<"  signal addr_"<<i<<" : std_logic_vector("<<(fh.wC+t.selectors.size()-1)<<" downto 0);\n";
+        dst<<indent<<"  signal bit_"<<i<<" : std_logic;\n";
+    }
+    dst<<indent<<"begin\n";
+    dst<<indent<<"  -- Addresses and bits\n";
+    for(unsigned i=0;i<fh.tables.size();i++){
+        const auto &t = fh.tables[i];
+        dst<<indent<<"  addr_"<<i<<" <= control("<<((i+1)*fh.wC-1)<<" downto "<<(i*fh.wC)<<")";
+        for(int j=t.selectors.size()-1;j>=0;j--){
+            dst<<" & key("<<t.selectors[j]<<")";
+        }
+        dst<<";\n";
+        dst<<indent<<"  bit_"<<i<<" <= lut_"<<i<<"(to_integer(unsigned(addr_"<<i<<")));\n";
+    }
+    dst<<indent<<"  -- Final composition\n";
+    dst<<indent<<"  hash <= ";
+    for(int i=fh.tables.size()-1;i>=0;i--){
+        dst<<"bit_"<<i;
+        if(i!=0)
+            dst<<" & ";
+    }
+    dst<<";\n";
+    dst<<indent<<"end RTL;\n";
+    dst<<"\n";
+
+    dst<<indent<<"library ieee;\n";
+    dst<<indent<<"use ieee.std_logic_1164.all;\n";
+    dst<<indent<<"use ieee.numeric_std.all;\n\n";
+
+    dst<<indent<<"entity "<<name<<"_hash is \n";
+    dst<<indent<<"  port (\n";
+    dst<<indent<<"    clk : in std_logic := '0';\n";
+    dst<<indent<<"    control_load : in std_logic := '0';\n";
+    dst<<indent<<"    control_in : in std_logic_vector("<<(wCtl-1)<<" downto 0) := (others => '0');\n";
+    dst<<indent<<"    key : in std_logic_vector("<<(wI-1)<<" downto 0);\n";
+    dst<<indent<<"    hash : out std_logic_vector("<<(wO-1)<<" downto 0)\n";
+    dst<<indent<<"  );\n";
+    dst<<indent<<"end entity "<<name<<"_hash;\n";
+    dst<<"\n";
+
+    dst<<indent<<"architecture RTL of "<<name<<"_hash is\n";
+    dst<<indent<<"  component "<<name<<"_family \n";
+    dst<<indent<<"    port (\n";
+    dst<<indent<<"      control : in std_logic_vector("<<(wCtl-1)<<" downto 0);\n";
+    dst<<indent<<"      key : in std_logic_vector("<<(wI-1)<<" downto 0);\n";
+    dst<<indent<<"      hash : out std_logic_vector("<<(wO-1)<<" downto 0)\n";
+    dst<<indent<<"    );\n";
+    dst<<indent<<"  end component;\n";
+    dst<<indent<<"  signal control : std_logic_vector("<<(wCtl-1)<<" downto 0) := \"";
+    for(int i=wCtl-1;i>=0;i--){
+        dst<<((word>>i)&1);
+    }
+    dst<<"\";\n";
+    dst<<indent<<"begin\n";
+    dst<<indent<<"  process(clk)\n";
+    dst<<indent<<"  begin\n";
+    dst<<indent<<"    if rising_edge(clk) then\n";
+    dst<<indent<<"      if control_load = '1' then\n";
+    dst<<indent<<"        control <= control_in;\n";
+    dst<<indent<<"      end if;\n";
+    dst<<indent<<"    end if;\n";
+    dst<<indent<<"  end process;\n";
+    dst<<indent<<"\n";
+    dst<<indent<<"  theFamily : "<<name<<"_family port map(control=>control,key=>key,hash=>hash);\n";
+    dst<<indent<<"end RTL;\n";
+}
+
+#endif //FPGA_PERFECT_HASH_FAMILY_HASH_VHDL_HPP
@@ -26,6 +26,7 @@ private:
     bool m_isKeyConcrete;
     unsigned m_nDistinctKeys;
     unsigned m_maxHash;
+    unsigned m_maxStash;
 
     void setupProperties()
     {
@@ -35,11 +36,35 @@ private:
         m_isKeyConcrete=true;
         m_nDistinctKeys=0;
 
+        // Two concrete keys only overlap if they are equal once zero extended,
+        // so only ternary keys need the pairwise check. This keeps big
+        // concrete sets linear (well, n log n).
+        std::set<std::vector<int> > concrete;
+        std::vector<key_type> ternary;
         for(const auto &e : m_entries){
-            for(const auto &x : m_keys){
-                if(x.overlaps(e.first)){
+            if(e.first.is_concrete()){
+                for(const auto &x : ternary){
+                    if(x.overlaps(e.first)){
+                        throw std::runtime_error("Two keys in different groups overlap.");
+                    }
+                }
+                std::vector<int> bits;
+                for(unsigned i=0; i<e.first.size(); i++){
+                    bits.push_back(e.first[i]);
+                }
+                while(!bits.empty() && bits.back()==0){
+                    bits.pop_back();
+                }
+                if(!concrete.insert(bits).second){
                     throw std::runtime_error("Two keys in different groups overlap.");
                 }
+            }else{
+                for(const auto &x : m_keys){
+                    if(x.overlaps(e.first)){
+                        throw std::runtime_error("Two keys in different groups overlap.");
+                    }
+                }
+                ternary.push_back(e.first);
             }
             m_keys.insert(e.first);
             m_wKey=std::max(m_wKey, (unsigned)e.first.size());
@@ -53,10 +78,15 @@ public:
         : m_wKey(0)
         , m_wValue(0)
         , m_isKeyConcrete(false)
+        , m_nDistinctKeys(0)
+        , m_maxHash(0)
+        , m_maxStash(0)
     {}
 
     key_value_set(const std::map<key_type,value_type> &_entries)
         : m_entries(_entries)
+        , m_maxHash(0)
+        , m_maxStash(0)
     {
         setupProperties();
     }
@@ -88,7 +118,8 @@ public:
     unsigned getValueWidth() const
     { return m_wValue; }
 
-    //! If getMaxHash()==keys_size(), then this is a perfect hash
+    //! Hashes must be strictly less than this, or zero if there is no limit.
+    //! If getMaxHash()==keys_size(), then this is a minimal perfect hash
     unsigned getMaxHash() const
     {
         return m_maxHash;
@@ -98,8 +129,8 @@ public:
     {
         if(x==UINT_MAX)
             x=keys_size();
-        if(x<keys_size())
-            throw std::runtime_error("Can't request fewer hashes than there are keys.");
+        if(x+m_maxStash<keys_size())
+            throw std::runtime_error("Can't request fewer hashes than there are (unstashed) keys.");
         if(x>(1<<getKeyWidth()))
             throw std::runtime_error("Can't request maxHash larger than number of bits in key.");
         m_maxHash=x;
@@ -108,6 +139,18 @@ public:
     bool isMinimal() const
     { return m_maxHash==keys_size(); }
 
+    //! Number of keys which may be left out of the hash, to be matched by a
+    //! small overflow CAM (the stash) instead.
+    unsigned getMaxStash() const
+    { return m_maxStash; }
+
+    void setMaxStash(unsigned x)
+    {
+        if(x>keys_size())
+            throw std::runtime_error("Can't stash more keys than there are.");
+        m_maxStash=x;
+    }
+
     void print(std::ostream &dst, std::string indent="") const
     {
         for(auto e : m_entries){
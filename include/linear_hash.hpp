@@ -0,0 +1,137 @@
+#ifndef FPGA_PERFECT_HASH_LINEAR_HASH_HPP
+#define FPGA_PERFECT_HASH_LINEAR_HASH_HPP
+
+#include "bit_hash.hpp"
+#include "key_value_set.hpp"
+
+#include <cstdint>
+
+/* A binary linear transform h = A x over GF(2), as in Carter and Wegman (see
+ * notes/references.md). Row i of A is a mask over the key bits, and hash bit
+ * i is the parity of the key bits in it, so in hardware each output is an
+ * XOR tree. Keys are limited to 64 bits.
+ */
+struct LinearHash
+{
+    unsigned wI;
+    unsigned wO;
+
+    std::vector<uint64_t> rows;
+
+    unsigned operator()(uint64_t x) const
+    {
+        unsigned res=0;
+        for(unsigned i=0; i<wO; i++){
+            res |= unsigned(__builtin_parityll(rows[i]&x))<<i;
+        }
+        return res;
+    }
+
+    unsigned operator()(unsigned x) const
+    { return (*this)(uint64_t(x)); }
+
+    unsigned operator()(const bit_vector &x) const
+    {
+        uint64_t k=0;
+        for(unsigned b=0; b<wI; b++){
+            int v=x[b];
+            if(v==-1)
+                throw std::runtime_error("Cannot lookup non-concrete key.");
+            k |= uint64_t(v)<<b;
+        }
+        return (*this)(k);
+    }
+
+    //! The inputs which feed output i, in ascending order
+    std::vector<unsigned> taps(unsigned i) const
+    {
+        std::vector<unsigned> res;
+        for(unsigned b=0; b<wI; b++){
+            if((rows[i]>>b)&1)
+                res.push_back(b);
+        }
+        return res;
+    }
+
+    std::vector<bit_vector> find_stash(const key_value_set &keys, unsigned groupSize=1) const
+    { return find_stash_of(*this, keys, groupSize); }
+
+    bool is_solution(const key_value_set &keys, unsigned groupSize=1) const
+    {
+        return find_stash(keys, groupSize).size() <= keys.getMaxStash();
+    }
+
+    void print(std::ostream &dst, std::string prefix="") const
+    {
+        dst<<prefix<<"LinearHashBegin "<<wO<<" "<<wI<<"\n";
+        for(unsigned i=0; i<wO; i++){
+            auto t=taps(i);
+            dst<<prefix<<"  row "<<i<<" "<<t.size()<<"\n";
+            dst<<prefix<<"    sel";
+            for(unsigned b : t){
+                dst<<" "<<b;
+            }
+            dst<<"\n";
+        }
+        dst<<prefix<<"LinearHashEnd\n";
+    }
+};
+
+LinearHash parse_linear_hash(std::istream &src)
+{
+    LinearHash res;
+
+    expect_token(src, "LinearHashBegin")>>res.wO>>res.wI;
+    if(res.wI>64)
+        throw std::runtime_error("Persisted linear hash is corrupt (keys are limited to 64 bits).");
+    res.rows.assign(res.wO, 0);
+    for(unsigned i=0; i<res.wO; i++){
+        unsigned idx, n;
+        expect_token(src, "row")>>idx>>n;
+        if(idx!=i)
+            throw std::runtime_error("Persisted linear hash is corrupt.");
+        expect_token(src, "sel");
+        for(unsigned j=0; j<n; j++){
+            unsigned b;
+            src>>b;
+            if(b>=res.wI)
+                throw std::runtime_error("Persisted linear hash is corrupt.");
+            res.rows[i] |= uint64_t(1)<<b;
+        }
+    }
+    expect_token(src, "LinearHashEnd");
+
+    return res;
+}
+
+/* Add v to a GF(2) basis kept in echelon form, where basis[b] is either zero
+ * or the only vector whose highest set bit is b. Returns false if v was
+ * already in the span.
+ */
+bool gf2_insert(std::vector<uint64_t> &basis, uint64_t v)
+{
+    if(basis.size()<64)
+        basis.resize(64, 0);
+    while(v){
+        unsigned top=63-__builtin_clzll(v);
+        if(basis[top]==0){
+            basis[top]=v;
+            return true;
+        }
+        v ^= basis[top];
+    }
+    return false;
+}
+
+//! Rank over GF(2) of a set of vectors
+unsigned gf2_rank(const std::vector<uint64_t> &vs)
+{
+    std::vector<uint64_t> basis;
+    unsigned res=0;
+    for(uint64_t v : vs){
+        res += gf2_insert(basis, v);
+    }
+    return res;
+}
+
+#endif //FPGA_PERFECT_HASH_LINEAR_HASH_HPP
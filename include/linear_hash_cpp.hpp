@@ -0,0 +1,30 @@
+#ifndef FPGA_PERFECT_HASH_LINEAR_HASH_CPP_HPP
+#define FPGA_PERFECT_HASH_LINEAR_HASH_CPP_HPP
+
+#include "bit_hash_cpp.hpp"
+#include "linear_hash.hpp"
+
+//! Each output is the XOR of its taps, with the same signature as write_cpp_hash
+void write_cpp_linear_hash(const LinearHash &lh, std::string name, std::string indent, std::ostream &dst)
+{
+    dst<<indent<<"unsigned "<<name<<"_hash(unsigned x){\n";
+    dst<<indent<<"  // XOR trees\n";
+    for(unsigned i=0;i<lh.wO;i++){
+        auto t=lh.taps(i);
+        dst<<indent<<"  unsigned bit_"<<i<<" = (0";
+        for(unsigned b : t){
+            dst<<" ^ (x>>"<<b<<")";
+        }
+        dst<<") & 1;\n";
+    }
+    dst<<indent<<"  // Final composition\n";
+    dst<<indent<<"  unsigned result= 0 ";
+    for(unsigned i=0;i<lh.wO;i++){
+        dst<<"| (bit_"<<i<<"<<"<<i<<")";
+    }
+    dst<<";\n";
+    dst<<indent<<"  return result;\n";
+    dst<<indent<<"}\n";
+}
+
+#endif //FPGA_PERFECT_HASH_LINEAR_HASH_CPP_HPP
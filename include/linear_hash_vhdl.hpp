@@ -0,0 +1,43 @@
+#ifndef FPGA_PERFECT_HASH_LINEAR_HASH_VHDL_HPP
+#define FPGA_PERFECT_HASH_LINEAR_HASH_VHDL_HPP
+
+#include "bit_hash_vhdl.hpp"
+#include "linear_hash.hpp"
+
+/* Each output is an XOR of its taps, which synthesis turns into a tree of
+ * luts. The ports are the same as write_vhdl_hash, so write_vhdl_hit and
+ * friends sit on top of it unchanged.
+ */
+void write_vhdl_linear_hash(const LinearHash &lh, std::string name, std::string indent, std::ostream &dst)
+{
+    unsigned wI=lh.wI, wO=lh.wO;
+
+    dst<<indent<<"library ieee;\n";
+    dst<<indent<<"use ieee.std_logic_1164.all;\n";
+    dst<<indent<<"use ieee.numeric_std.all;\n\n";
+
+    dst<<indent<<"entity "<<name<<"_hash is \n";
+    dst<<indent<<"  port (\n";
+    dst<<indent<<"    key : in std_logic_vector("<<(wI-1)<<" downto 0);\n";
+    dst<<indent<<"    hash : out std_logic_vector("<<(wO-1)<<" downto 0)\n";
+    dst<<indent<<"  );\n";
+    dst<<indent<<"end entity "<<name<<"_hash;\n";
+    dst<<"\n";
+
+    dst<<indent<<"architecture RTL of "<<name<<"_hash is\n";
+    dst<<indent<<"begin\n";
+    for(unsigned i=0;i<wO;i++){
+        auto t=lh.taps(i);
+        dst<<indent<<"  hash("<<i<<") <= ";
+        if(t.empty()){
+            dst<<"'0'";
+        }
+        for(unsigned j=0;j<t.size();j++){
+            dst<<(j==0?"":" xor ")<<"key("<<t[j]<<")";
+        }
+        dst<<";\n";
+    }
+    dst<<indent<<"end RTL;\n";
+}
+
+#endif //FPGA_PERFECT_HASH_LINEAR_HASH_VHDL_HPP
@@ -0,0 +1,71 @@
+#ifndef FPGA_PERFECT_HASH_PARTITIONED_HASH_HPP
+#define FPGA_PERFECT_HASH_PARTITIONED_HASH_HPP
+
+#include "bit_hash.hpp"
+#include "key_value_set.hpp"
+
+/* The scheme from notes/wide-hash-2.md. A selector lut (a BitHash with one
+ * output) splits the keys into two halves, and is the top bit of the hash.
+ * The other wO-1 bits come from one of two BitHashes, depending on the
+ * selector. Both halves use the same taps, so in hardware each of those
+ * bits is a single lut with the selector as its top address bit, and wA-1
+ * taps below it.
+ */
+struct PartitionedHash
+{
+    unsigned wI;
+    unsigned wO;
+
+    BitHash selector;
+    BitHash halves[2];
+
+    unsigned operator()(unsigned x) const
+    {
+        unsigned s=selector(x);
+        return (s<<(wO-1)) | halves[s](x);
+    }
+
+    unsigned operator()(const bit_vector &x) const
+    {
+        unsigned s=selector(x);
+        return (s<<(wO-1)) | halves[s](x);
+    }
+
+    std::vector<bit_vector> find_stash(const key_value_set &keys, unsigned groupSize=1) const
+    { return find_stash_of(*this, keys, groupSize); }
+
+    bool is_solution(const key_value_set &keys, unsigned groupSize=1) const
+    {
+        return find_stash(keys, groupSize).size() <= keys.getMaxStash();
+    }
+
+    void print(std::ostream &dst, std::string prefix="") const
+    {
+        dst<<prefix<<"PartitionedHashBegin "<<wO<<" "<<wI<<"\n";
+        selector.print(dst, prefix+"  ");
+        halves[0].print(dst, prefix+"  ");
+        halves[1].print(dst, prefix+"  ");
+        dst<<prefix<<"PartitionedHashEnd\n";
+    }
+};
+
+PartitionedHash parse_partitioned_hash(std::istream &src)
+{
+    PartitionedHash res;
+
+    expect_token(src, "PartitionedHashBegin")>>res.wO>>res.wI;
+    res.selector=parse_bit_hash(src);
+    res.halves[0]=parse_bit_hash(src);
+    res.halves[1]=parse_bit_hash(src);
+    if(res.selector.wO!=1 || res.halves[0].wO+1!=res.wO || res.halves[1].wO+1!=res.wO)
+        throw std::runtime_error("Persisted partitioned hash is corrupt.");
+    for(unsigned i=0;i<res.wO-1;i++){
+        if(res.halves[0].tables[i].selectors!=res.halves[1].tables[i].selectors)
+            throw std::runtime_error("Persisted partitioned hash is corrupt (halves have different taps).");
+    }
+    expect_token(src, "PartitionedHashEnd");
+
+    return res;
+}
+
+#endif //FPGA_PERFECT_HASH_PARTITIONED_HASH_HPP
@@ -0,0 +1,52 @@
+#ifndef FPGA_PERFECT_HASH_PARTITIONED_HASH_CPP_HPP
+#define FPGA_PERFECT_HASH_PARTITIONED_HASH_CPP_HPP
+
+#include "bit_hash_cpp.hpp"
+#include "partitioned_hash.hpp"
+
+/* The selector is its own function (name_selector_hash). Each of the other
+ * bits is one lut with the selector as its top address bit, so the lut is
+ * the one from halves[0] followed by the one from halves[1].
+ */
+void write_cpp_partitioned_hash(const PartitionedHash &ph, std::string name, std::string indent, std::ostream &dst)
+{
+    unsigned wR=ph.wO-1;
+
+    write_cpp_hash(ph.selector, name+"_selector", indent, dst);
+    dst<<"\n";
+
+    dst<<indent<<"unsigned "<<name<<"_hash(unsigned x){\n";
+    dst<<indent<<"  // ROMS\n";
+    for(unsigned i=0;i<wR;i++){
+        const auto &t0=ph.halves[0].tables[i], &t1=ph.halves[1].tables[i];
+        dst<<indent<<"  static const unsigned lut_"<<i<<"["<<(2*t0.lut.size())<<"] = {";
+        for(unsigned j=0;j<t0.lut.size();j++){
+            dst<<(j==0?"":",")<<(t0.lut[j]==1?'1':'0');
+        }
+        for(unsigned j=0;j<t1.lut.size();j++){
+            dst<<","<<(t1.lut[j]==1?'1':'0');
+        }
+        dst<<"};\n";
+    }
+    dst<<indent<<"  unsigned s = "<<name<<"_selector_hash(x);\n";
+    dst<<indent<<"  // Addresses and bits\n";
+    for(unsigned i=0;i<wR;i++){
+        const auto &t=ph.halves[0].tables[i];
+        dst<<indent<<"  unsigned addr_"<<i<<" = (s<<"<<t.selectors.size()<<") ";
+        for(unsigned j=0;j<t.selectors.size();j++){
+            dst<<"| (((x>>"<<t.selectors[j]<<")&1)<<"<<j<<")";
+        }
+        dst<<";\n";
+        dst<<indent<<"  unsigned bit_"<<i<<" = lut_"<<i<<"[addr_"<<i<<"];\n";
+    }
+    dst<<indent<<"  // Final composition\n";
+    dst<<indent<<"  unsigned result = (s<<"<<wR<<") ";
+    for(unsigned i=0;i<wR;i++){
+        dst<<"| (bit_"<<i<<"<<"<<i<<")";
+    }
+    dst<<";\n";
+    dst<<indent<<"  return result;\n";
+    dst<<indent<<"}\n";
+}
+
+#endif //FPGA_PERFECT_HASH_PARTITIONED_HASH_CPP_HPP
@@ -0,0 +1,75 @@
+#ifndef FPGA_PERFECT_HASH_PARTITIONED_HASH_VHDL_HPP
+#define FPGA_PERFECT_HASH_PARTITIONED_HASH_VHDL_HPP
+
+#include "bit_hash_vhdl.hpp"
+#include "partitioned_hash.hpp"
+
+/* The selector is its own entity (name_selector_hash), and its output is
+ * both the top hash bit and the top address bit of every other lut, which
+ * hold halves[1] above halves[0]. The result has the same ports as
+ * write_vhdl_hash, so write_vhdl_hit and friends sit on top of it unchanged.
+ */
+void write_vhdl_partitioned_hash(const PartitionedHash &ph, std::string name, std::string indent, std::ostream &dst)
+{
+    unsigned wI=ph.wI, wO=ph.wO, wR=ph.wO-1;
+
+    write_vhdl_hash(ph.selector, name+"_selector", indent, dst);
+    dst<<"\n";
+
+    dst<<indent<<"library ieee;\n";
+    dst<<indent<<"use ieee.std_logic_1164.all;\n";
+    dst<<indent<<"use ieee.numeric_std.all;\n\n";
+
+    dst<<indent<<"entity "<<name<<"_hash is \n";
+    dst<<indent<<"  port (\n";
+    dst<<indent<<"    key : in std_logic_vector("<<(wI-1)<<" downto 0);\n";
+    dst<<indent<<"    hash : out std_logic_vector("<<(wO-1)<<" downto 0)\n";
+    dst<<indent<<"  );\n";
+    dst<<indent<<"end entity "<<name<<"_hash;\n";
+    dst<<"\n";
+
+    dst<<indent<<"architecture RTL of "<<name<<"_hash is\n";
+    dst<<indent<<"  component "<<name<<"_selector_hash \n";
+    dst<<indent<<"    port (\n";
+    dst<<indent<<"      key : in std_logic_vector("<<(wI-1)<<" downto 0);\n";
+    dst<<indent<<"      hash : out std_logic_vector(0 downto 0)\n";
+    dst<<indent<<"    );\n";
+    dst<<indent<<"  end component;\n";
+    dst<<indent<<"  signal sel : std_logic_vector(0 downto 0);\n";
+    dst<<indent<<"  -- ROMS\n";
+    for(unsigned i=0;i<wR;i++){
+        const auto &t0=ph.halves[0].tables[i], &t1=ph.halves[1].tables[i];
+        dst<<indent<<"  signal lut_"<<i<<" : std_logic_vector("<<(2*t0.lut.size()-1)<<" downto 0) := \"";
+        for(int j=t1.lut.size()-1;j>=0;j--){
+            dst<<(t1.lut[j]==1?'1':'0');
+        }
+        for(int j=t0.lut.size()-1;j>=0;j--){
+            dst<<(t0.lut[j]==1?'1':'0');
+        }
+        dst<<"\";\n";
+    }
+    dst<<indent<<"  -- Addresses and bits\n";
+    for(unsigned i=0;i<wR;i++){
+        const auto &t=ph.halves[0].tables[i];
+        dst<<indent<<"  signal addr_"<<i<<" : std_logic_vector("<<t.selectors.size()<<" downto 0);\n";
+        dst<<indent<<"  signal bit_"<<i<<" : std_logic;\n";
+    }
+    dst<<indent<<"begin\n";
+    dst<<indent<<"  theSelector : "<<name<<"_selector_hash port map(key=>key,hash=>sel);\n";
+    for(unsigned i=0;i<wR;i++){
+        const auto &t=ph.halves[0].tables[i];
+        dst<<indent<<"  addr_"<<i<<" <= sel(0)";
+        for(int j=t.selectors.size()-1;j>=0;j--){
+            dst<<" & key("<<t.selectors[j]<<")";
+        }
+        dst<<";\n";
+        dst<<indent<<"  bit_"<<i<<" <= lut_"<<i<<"(to_integer(unsigned(addr_"<<i<<")));\n";
+    }
+    dst<<indent<<"  hash("<<wR<<") <= sel(0);\n";
+    for(unsigned i=0;i<wR;i++){
+        dst<<indent<<"  hash("<<i<<") <= bit_"<<i<<";\n";
+    }
+    dst<<indent<<"end RTL;\n";
+}
+
+#endif //FPGA_PERFECT_HASH_PARTITIONED_HASH_VHDL_HPP
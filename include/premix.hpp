@@ -0,0 +1,135 @@
+#ifndef FPGA_PERFECT_HASH_PREMIX_HPP
+#define FPGA_PERFECT_HASH_PREMIX_HPP
+
+#include "bit_hash.hpp"
+#include "distinguishing_bits.hpp"
+#include "linear_hash.hpp"
+
+#include "key_value_set.hpp"
+
+#include <cmath>
+#include <set>
+
+/* Structured keys (sequential IDs, aligned addresses, keys which only
+ * differ in a few high bits) have most of their entropy in a few inputs
+ * (see calculateBitWeights), so random taps mostly see bits which tell the
+ * keys apart badly. A premix is a sparse GF(2) matrix in front of the
+ * tables, where each mixed bit is the XOR of at most mixWeight inputs.
+ *
+ * There is one mixed bit per varying input, chosen greedily. Each one is
+ * the candidate with the highest entropy over the keys, out of
+ * `candidates` random sparse rows, ties going to fewer inputs. A row must
+ * be independent of the rows before it. So the matrix is invertible on the
+ * varying bits, and distinct keys stay distinct. Only concrete keys are
+ * supported, as a don't care input would make every mixed bit it reaches
+ * a don't care too.
+ *
+ * If the keys have a maxHash beyond the span of the varying bits, the
+ * lowest constant inputs are passed straight through as extra mixed bits,
+ * so that the mixed keys are still wide enough for it.
+ */
+template<class TRng>
+std::vector<std::vector<unsigned> > makePremix(TRng &rng, const key_value_set &keys, unsigned mixWeight=2, unsigned candidates=64)
+{
+    if(!keys.has_concrete_keys())
+        throw std::runtime_error("makePremix : only concrete keys can be premixed.");
+    if(keys.getKeyWidth()>64)
+        throw std::runtime_error("makePremix : keys are limited to 64 bits.");
+
+    auto pool=findUsableBits(keys);
+    if(pool.empty())
+        throw std::runtime_error("makePremix : no input bit varies.");
+    mixWeight=std::max(1u, std::min(mixWeight, (unsigned)pool.size()));
+
+    std::vector<uint64_t> packed;
+    for(const auto &kv : keys){
+        const auto &k=kv.first;
+        uint64_t x=0;
+        for(unsigned b : pool){
+            x |= uint64_t(k[b]==1)<<b;
+        }
+        packed.push_back(x);
+    }
+    double n=packed.size();
+
+    auto entropy=[&](uint64_t row) -> double
+    {
+        unsigned ones=0;
+        for(uint64_t x : packed){
+            ones += __builtin_parityll(x&row);
+        }
+        if(ones==0 || ones==packed.size())
+            return 0.0;
+        double p=ones/n;
+        return -p*log2(p) - (1-p)*log2(1-p);
+    };
+
+    auto inSpan=[](std::vector<uint64_t> basis, uint64_t v) -> bool
+    { return !gf2_insert(basis, v); };
+
+    std::vector<uint64_t> basis;
+    std::vector<std::vector<unsigned> > res;
+    for(unsigned j=0; j<pool.size(); j++){
+        uint64_t best=0;
+        double bestScore=-1;
+        for(unsigned c=0; c<candidates; c++){
+            unsigned w=1+rng()%mixWeight;
+            uint64_t row=0;
+            while((unsigned)__builtin_popcountll(row)<w){
+                row |= uint64_t(1)<<pool[rng()%pool.size()];
+            }
+            if(inSpan(basis, row))
+                continue;
+            double score=entropy(row);
+            bool better = score>bestScore+1e-12
+                || (score>bestScore-1e-12 && __builtin_popcountll(row)<__builtin_popcountll(best));
+            if(better){
+                best=row;
+                bestScore=score;
+            }
+        }
+        // A single input outside the span always exists, as the inputs span everything
+        for(unsigned i=0; best==0 && i<pool.size(); i++){
+            uint64_t row=uint64_t(1)<<pool[i];
+            if(!inSpan(basis, row))
+                best=row;
+        }
+        gf2_insert(basis, best);
+
+        res.push_back(std::vector<unsigned>());
+        for(unsigned b : pool){
+            if((best>>b)&1)
+                res.back().push_back(b);
+        }
+    }
+
+    for(unsigned b=0; b<keys.getKeyWidth() && keys.getMaxHash()>(1ull<<res.size()); b++){
+        if(std::find(pool.begin(), pool.end(), b)==pool.end())
+            res.push_back(std::vector<unsigned>(1, b));
+    }
+    return res;
+}
+
+//! The keys as seen by the tables behind the premix. The values are unchanged.
+key_value_set premixKeys(const std::vector<std::vector<unsigned> > &premix, const key_value_set &keys)
+{
+    BitHash mixer;
+    mixer.wI=keys.getKeyWidth();
+    mixer.wO=0;
+    mixer.premix=premix;
+
+    std::map<bit_vector,bit_vector> entries;
+    for(const auto &kv : keys){
+        if(!entries.insert(std::make_pair(mixer.mix(kv.first), kv.second)).second)
+            throw std::runtime_error("premixKeys : premix is not injective on the keys.");
+    }
+
+    key_value_set res(entries);
+    res.setMaxStash(keys.getMaxStash());
+    if(keys.getMaxHash()>0){
+        res.setMaxHash(keys.getMaxHash());
+    }
+    return res;
+}
+
+#endif //FPGA_PERFECT_HASH_PREMIX_HPP
@@ -67,7 +67,7 @@ unsigned metricShuffleAddress(const std::vector<unsigned> &a0, const std::vector
 {
   unsigned different=0;
 
-  auto i0=a0.begin(), i1=a1.end();
+  auto i0=a0.begin(), i1=a1.begin();
   while(i0!=a0.end() && i1!=a1.end()){
     if(*i0 < *i1){
       ++different;
@@ -5,10 +5,13 @@
 #ifndef FPGA_PERFECT_HASH_SOLVE_CONTEXT_HPP
 #define FPGA_PERFECT_HASH_SOLVE_CONTEXT_HPP
 
+#include <chrono>
 #include <cstdarg>
 #include <fstream>
 #include <random>
 
+#include <sys/resource.h>
+
 double cpuTime()
 {
     struct rusage ru;
@@ -16,6 +19,14 @@ double cpuTime()
     return ru.ru_utime.tv_sec+ru.ru_utime.tv_usec/1000000.0;
 }
 
+//! Real time in seconds from an arbitrary start. cpuTime() adds up every
+//! thread, so solvers which run several threads need this for their budget.
+double wallTime()
+{
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
 
 /* This is the God Object where random flags and context goes */
 struct solve_context
@@ -72,6 +83,27 @@ struct solve_context
 
     std::string tapSelectMethod;
 
+    // Probability of a random (rather than greedy) move in solver_walk
+    double walkNoise=0.2;
+
+    // Probability that a local search step moves a selector rather than lut contents
+    double tapMoveProb=0.01;
+
+    // Number of recent points that solver_tabu will not move back to
+    int tabuTenure=1<<16;
+
+    // Number of worker threads for solvers that support it
+    int threads=1;
+
+    // Seconds of local search before solver_hybrid or solver_lns hand over to minisat
+    double hybridTime=10;
+
+    // Inputs each selector can choose between in solve_cnf_mux
+    int tapCandidates=4;
+
+    // Shuffles to score before each attempt of the CNF solvers (1 is no scoring)
+    int shuffleCandidates=1;
+
     void logMsg(int level, const char *fmt, ...)
     {
         if(level>verbose)
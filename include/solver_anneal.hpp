@@ -58,16 +58,34 @@ std::pair<BitHash,bool> solver_anneal(
         double ePrev=manipCurr.eval(groupSize);
         double eCurr=ePrev*10;
 
-        int nFlips=3+(unsigned)ceil(-log2(udist(urng)));
+        int nFlips=0;
+        // A selector move, as (table, selector, previous input)
+        int tapTable=-1;
+        unsigned tapSel=0, tapPrev=0;
+
+        if(udist(urng) < ctxt.tapMoveProb){
+            unsigned ti=urng()%wO, ib;
+            if(chooseTapMove(urng, manipCurr, ti, 0, 0, tapSel, ib)){
+                tapTable=ti;
+                tapPrev=solCurr.tables[ti].selectors[tapSel];
+                manipCurr.swapSelector(ti, tapSel, ib);
+                eCurr=manipCurr.eval(groupSize);
+            }
+        }
 
-        for(int i=0; i<nFlips; i++) {
-            int b=urng()%manipCurr.bitCount();
-            manipCurr.flipBit(b);
-            flips.push_back(b);
+        if(tapTable<0){
+            int maxFlips=3+(unsigned)ceil(-log2(udist(urng)));
 
-            eCurr=manipCurr.eval(groupSize);
-            if(eCurr < ePrev){
-                break;
+            for(int i=0; i<maxFlips; i++) {
+                int b=urng()%manipCurr.bitCount();
+                manipCurr.flipBit(b);
+                flips.push_back(b);
+                nFlips++;
+
+                eCurr=manipCurr.eval(groupSize);
+                if(eCurr < ePrev){
+                    break;
+                }
             }
         }
 
@@ -114,11 +132,15 @@ std::pair<BitHash,bool> solver_anneal(
 
         if(udist(urng) < probAccept) {
             // accept
+            flips.clear();
         }else {
             for(int i=0; i<nFlips; i++) {
                 manipCurr.flipBit(flips.back());
                 flips.pop_back();
             }
+            if(tapTable>=0){
+                manipCurr.swapSelector(tapTable, tapSel, tapPrev);
+            }
         }
 
         tries++;
@@ -7,6 +7,7 @@
 
 #include "bit_hash.hpp"
 #include "bit_hash_cnf.hpp"
+#include "bit_hash_cnf_mux.hpp"
 #include "bit_hash_cpp.hpp"
 
 #include "key_value_set.hpp"
@@ -14,6 +15,28 @@
 
 #include "solve_context.hpp"
 
+#include <tuple>
+
+
+/* The shuffle for one attempt of the CNF solvers. If ctxt.shuffleCandidates
+ * is more than one then we score that many on the keys and use the best (see
+ * makeBestBitHash), which costs far less than a failed call to minisat.
+ */
+BitHash makeCnfBitHash(solve_context &ctxt, const key_value_set &problem)
+{
+    auto &urng=ctxt.urng;
+    bool weighted = ctxt.tapSelectMethod == "weighted";
+
+    if(ctxt.shuffleCandidates<=1){
+        return weighted ? makeWeightedBitHash(urng, problem, ctxt.wO, ctxt.wI, ctxt.wA) : makeBitHash(urng, ctxt.wO, ctxt.wI, ctxt.wA);
+    }
+
+    double score;
+    auto bh=makeBestBitHash(urng, problem, ctxt.wO, ctxt.wI, ctxt.wA, weighted, ctxt.shuffleCandidates, ctxt.groupSize, &score);
+    ctxt.logMsg(2, "  Best of %d shuffles has score %g\n", ctxt.shuffleCandidates, score);
+    ctxt.logCsv("ShuffleScore", score);
+    return bh;
+}
 
 std::pair<BitHash,bool> solve_cnf(
         solve_context &ctxt,
@@ -21,14 +44,11 @@ std::pair<BitHash,bool> solve_cnf(
 ) {
     int &verbose=ctxt.verbose;
     int &tries=ctxt.tries;
-    auto &urng=ctxt.urng;
-
-    if(ctxt.groupSize!=1)
-        throw std::runtime_error("Solver_cnf does not support groupSize!=1");
 
     BitHash result;
 
     tries=1;
+    unsigned rejected=0;
     bool success = false;
     while (ctxt.tries < ctxt.maxTries) {
         if (verbose > 0) {
@@ -37,13 +57,30 @@ std::pair<BitHash,bool> solve_cnf(
         if (verbose > 0) {
             std::cerr << "  Creating bit hash...\n";
         }
-        auto bh = (ctxt.tapSelectMethod == "weighted") ? makeWeightedBitHash(urng, problem, ctxt.wO, ctxt.wI, ctxt.wA) : makeBitHash(urng, ctxt.wO, ctxt.wI, ctxt.wA);
+        auto bh = makeCnfBitHash(ctxt, problem);
+
+        // Shuffles where too many keys read the same addresses can't work
+        // whatever the luts are, and that is much quicker to check than to
+        // have minisat prove.
+        unsigned lowerBound = bh.stash_lower_bound(problem, ctxt.groupSize);
+        if (lowerBound > problem.getMaxStash()) {
+            if (verbose > 1) {
+                std::cerr << "  Shuffle rejected, at least " << lowerBound << " keys collide\n";
+            }
+            rejected++;
+            tries++;
+            continue;
+        }
+
         if (verbose > 0) {
             std::cerr << "  Converting to CNF...\n";
         }
 
         cnf_problem prob;
-        to_cnf(bh, problem.keys(), prob, problem.getMaxHash());
+        to_cnf(bh, problem.keys(), prob, problem.getMaxHash(), ctxt.groupSize, problem.getMaxStash()>0);
+        if(problem.getMaxStash()>0){
+            requireAtMostK(prob.sat, prob.stashLits, problem.getMaxStash());
+        }
         if (verbose > 0) {
             std::cerr << "  Solving problem with minisat...\n";
         }
@@ -66,18 +103,186 @@ std::pair<BitHash,bool> solve_cnf(
             if (verbose > 0) {
                 std::cerr << "  checking...\n";
             }
-            if (!back.is_solution(problem))
+            if (!back.is_solution(problem, ctxt.groupSize))
                 throw std::runtime_error("Failed post substitution check.");
 
             success = true;
             result = back;
+            ctxt.logCsv("PrefilterRejected", rejected);
             return std::make_pair(result,true);
         }
         tries++;
     }
 
+    ctxt.logCsv("PrefilterRejected", rejected);
     return std::make_pair(result, false);
 }
 
 
+/* As solve_cnf, but each selector may choose between ctxt.tapCandidates
+ * inputs (see to_cnf_mux), so minisat picks the taps and the lut contents
+ * together. The instances are bigger, but far fewer of them are
+ * unsatisfiable, so we spend less time proving that shuffles don't work.
+ */
+std::pair<BitHash,bool> solve_cnf_mux(
+        solve_context &ctxt,
+        const key_value_set &problem
+) {
+    int &verbose=ctxt.verbose;
+    int &tries=ctxt.tries;
+    auto &urng=ctxt.urng;
+
+    tries=1;
+    while (ctxt.tries < ctxt.maxTries) {
+        if (verbose > 0) {
+            std::cerr << "  Attempt " << tries << "\n";
+        }
+        auto bh = makeCnfBitHash(ctxt, problem);
+        auto candidates = makeTapCandidates(urng, bh, ctxt.tapCandidates);
+
+        cnf_problem prob;
+        to_cnf_mux(bh, candidates, problem.keys(), prob, problem.getMaxHash(), ctxt.groupSize, problem.getMaxStash()>0);
+        if(problem.getMaxStash()>0){
+            requireAtMostK(prob.sat, prob.stashLits, problem.getMaxStash());
+        }
+        if (verbose > 0) {
+            std::cerr << "  Solving problem with " << prob.sat.nVars() << " variables and " << prob.sat.nClauses() << " clauses...\n";
+        }
+        auto sol = minisat_solve(prob, verbose);
+
+        if (sol.empty()) {
+            if (verbose > 0) {
+                std::cerr << "  No solution\n";
+            }
+        } else {
+            auto back = substitute(bh, prob, sol);
+            if (!back.is_solution(problem, ctxt.groupSize))
+                throw std::runtime_error("Failed post substitution check.");
+            unsigned moved=0;
+            for(unsigned ti=0; ti<bh.wO; ti++){
+                for(unsigned si=0; si<bh.tables[ti].selectors.size(); si++){
+                    moved += bh.tables[ti].selectors[si]!=back.tables[ti].selectors[si];
+                }
+            }
+            ctxt.logCsv("MuxTapChanges", moved);
+            return std::make_pair(back,true);
+        }
+        tries++;
+    }
+
+    return std::make_pair(BitHash(), false);
+}
+
+/* Find the hash with the fewest keys that have to be stashed, for when there
+ * may be no perfect hash. Every key gets a relaxation literal (see to_cnf),
+ * and we first find any solution, then build a sequential counter over the
+ * relaxation literals and keep asking for one fewer stashed key using an
+ * assumption on the counter outputs. That only searches the luts for one
+ * shuffle of the taps, so once it becomes unsatisfiable or reaches
+ * BitHash::stash_lower_bound we move on to a new shuffle (see
+ * makeCnfBitHash), which is only asked to beat the best so far. This goes
+ * on until no keys are stashed, or ctxt.maxTime runs out, or ctxt.maxTries
+ * shuffles have been tried.
+ *
+ * Returns the hash, the keys which need to be stashed, and whether the
+ * count was proved optimal for the shuffle the hash came from. Other
+ * shuffles may still do better. The hash is empty if nothing was found in
+ * time.
+ */
+std::tuple<BitHash,std::vector<bit_vector>,bool> solve_cnf_maxsat(
+        solve_context &ctxt,
+        const key_value_set &problem
+) {
+    using namespace Minisat;
+
+    int &verbose=ctxt.verbose;
+
+    ctxt.tries=1;
+
+    BitHash best;
+    std::vector<bit_vector> bestStash;
+    bool optimal=false;
+
+    // Run the solver in chunks of conflicts so that we can watch the time. This
+    // stops a little early, so that we return before the CPU limit kills us.
+    auto solveBudgeted=[&](Solver &S, const vec<Lit> &assumps) -> lbool
+    {
+        while(1){
+            if(::cpuTime() > 0.95*ctxt.maxTime)
+                return l_Undef;
+            S.setConfBudget(10000);
+            lbool r=S.solveLimited(assumps);
+            if(r!=l_Undef)
+                return r;
+        }
+    };
+
+    for(; ctxt.tries < ctxt.maxTries && ::cpuTime() < 0.95*ctxt.maxTime; ctxt.tries++){
+        if(!best.tables.empty() && bestStash.empty())
+            break;  // Nothing can do better
+
+        auto bh = makeCnfBitHash(ctxt, problem);
+
+        // Nothing with this shuffle can do better than this
+        unsigned lowerBound=bh.stash_lower_bound(problem, ctxt.groupSize);
+        if(!best.tables.empty() && lowerBound>=bestStash.size()){
+            ctxt.logMsg(2, "  Shuffle %d can't stash fewer than %u keys, skipping.\n", ctxt.tries, lowerBound);
+            continue;
+        }
+
+        cnf_problem prob;
+        to_cnf(bh, problem.keys(), prob, problem.getMaxHash(), ctxt.groupSize, true);
+
+        Solver &S=prob.sat;
+        S.verbosity=std::max(0, verbose-2);
+
+        // Whether the best hash came from this shuffle
+        bool mine=false;
+        std::vector<Lit> counter;
+        vec<Lit> assumps;
+        while(true){
+            assumps.clear();
+            if(!best.tables.empty()){
+                if(bestStash.size()<=lowerBound){
+                    if(mine)
+                        optimal=true;
+                    break;
+                }
+                if(counter.empty()){
+                    counter=makeSequentialCounter(S, prob.stashLits, bestStash.size());
+                }
+                // At most bestStash.size()-1 keys may be stashed
+                assumps.push(~counter[bestStash.size()-1]);
+            }
+
+            lbool r=solveBudgeted(S, assumps);
+            if(r!=l_True){
+                // Unsatisfiable if we asked for too few keys, or if the hard
+                // constraints (e.g. maxHash) can't be met with these taps
+                if(mine)
+                    optimal = r==l_False;
+                break;
+            }
+
+            std::map<int,int> sol;
+            for (int i = 0; i < S.nVars(); i++) {
+                sol.insert(std::make_pair(i+1, S.model[i]==l_True ? 1 : 0));
+            }
+            auto back=substitute(bh, prob, sol);
+            auto stash=back.find_stash(problem, ctxt.groupSize);
+            if(best.tables.empty() || stash.size() < bestStash.size()){
+                best=back;
+                bestStash=stash;
+                mine=true;
+                optimal=false;
+                ctxt.logMsg(1, "  Found hash with %u stashed keys (shuffle %d).\n", (unsigned)stash.size(), ctxt.tries);
+                ctxt.logCsv("Stashed", stash.size());
+            }
+        }
+    }
+    ctxt.logCsv("MaxsatShuffles", ctxt.tries-1);
+
+    return std::make_tuple(best, bestStash, optimal);
+}
+
 #endif //FPGA_PERFECT_HASH_SOLVER_CNF_HPP
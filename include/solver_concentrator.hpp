@@ -0,0 +1,230 @@
+#ifndef FPGA_PERFECT_HASH_SOLVER_CONCENTRATOR_HPP
+#define FPGA_PERFECT_HASH_SOLVER_CONCENTRATOR_HPP
+
+#include "bit_hash.hpp"
+#include "concentrated_hash.hpp"
+#include "distinguishing_bits.hpp"
+
+#include "key_value_set.hpp"
+
+#include "solve_context.hpp"
+#include "solver_walk.hpp"
+
+/* Any concentrator drawn from the pool (see findUsableBits) can only tell
+ * keys apart by those bits, so keys which agree on all of them can never be
+ * separated. Better to say so than to search until we run out of time.
+ */
+void requirePoolSeparates(const key_value_set &problem, const std::vector<unsigned> &pool, const char *who)
+{
+    // Only the keys matter, and the pool may be too narrow for maxHash
+    key_value_set keys(std::map<bit_vector,bit_vector>(problem.begin(), problem.end()));
+    auto reduced=projectKeys(keys, pool);
+    if(reduced.keys_size() < problem.keys_size()){
+        throw std::runtime_error(std::string(who)+" : some keys are the same in every bit which all keys define, so can't be concentrated apart.");
+    }
+}
+
+/* A LUT concentrator is just a hash with wC outputs which is perfect on the
+ * keys, so solver_walk finds it, restricted to findUsableBits so every
+ * variant of a ternary key concentrates to the same concrete key. With wC
+ * well above log2(nKeys) this is a very loose problem. Borrows ctxt, and
+ * puts back the widths and limits it changes.
+ */
+std::pair<BitHash,bool> solve_concentrator_lut(solve_context &ctxt, const key_value_set &problem, unsigned wC)
+{
+    auto pool=requireUsableBits(problem, "solve_concentrator_lut");
+    requirePoolSeparates(problem, pool, "solve_concentrator_lut");
+
+    key_value_set loose(std::map<bit_vector,bit_vector>(problem.begin(), problem.end()));
+    loose=projectKeys(loose, pool);
+
+    int wO=ctxt.wO, wI=ctxt.wI, wA=ctxt.wA, groupSize=ctxt.groupSize;
+    ctxt.wO=wC;
+    ctxt.wI=pool.size();
+    ctxt.wA=std::min(wA, (int)pool.size());
+    ctxt.groupSize=1;
+
+    BitHash front;
+    bool success;
+    std::tie(front, success)=solver_walk(ctxt, loose);
+
+    ctxt.wO=wO;
+    ctxt.wI=wI;
+    ctxt.wA=wA;
+    ctxt.groupSize=groupSize;
+
+    return std::make_pair(unprojectBitHash(front, pool, problem.getKeyWidth()), success);
+}
+
+/* An XOR concentrator, where each of the wC outputs is the parity of ctxt.wA
+ * of the findUsableBits. It starts from random taps, then repeatedly picks
+ * two keys which concentrate to the same value, and swaps one tap of one
+ * output, where exactly one of the tap going in and the tap going out
+ * differs between the two keys, which always pulls them apart in that
+ * output. As in solver_walk, with probability walkNoise the swap is random,
+ * otherwise it is the best of a small sample. Each swap only changes the
+ * keys which have one of the two bits set, so it is cheap to try. Each
+ * output leaves out at least one pool bit, as otherwise there would be
+ * nothing to swap in (and every output would be the same).
+ */
+std::pair<BitHash,bool> solve_concentrator_xor(solve_context &ctxt, const key_value_set &problem, unsigned wC)
+{
+    auto &urng=ctxt.urng;
+    std::uniform_real_distribution<> udist;
+
+    if(wC>24)
+        throw std::runtime_error("solve_concentrator_xor : wc > 24 is unexpectedly large.");
+    if(problem.getKeyWidth()>64)
+        throw std::runtime_error("solve_concentrator_xor : keys are limited to 64 bits.");
+
+    auto pool=requireUsableBits(problem, "solve_concentrator_xor");
+    requirePoolSeparates(problem, pool, "solve_concentrator_xor");
+    unsigned wA=std::min((unsigned)ctxt.wA, (unsigned)pool.size());
+    if(wA==pool.size() && wA>1)
+        wA--;
+
+    // Every variant agrees on the pool bits
+    std::vector<uint64_t> keys;
+    std::vector<std::vector<unsigned> > withBit(problem.getKeyWidth());
+    for(const auto &kv : problem){
+        const auto &k=*kv.first.variants_begin();
+        uint64_t x=0;
+        for(unsigned b : pool){
+            if(k[b]==1){
+                x |= uint64_t(1)<<b;
+                withBit[b].push_back(keys.size());
+            }
+        }
+        keys.push_back(x);
+    }
+    unsigned n=keys.size();
+
+    std::vector<std::vector<unsigned> > rows(wC);
+    for(auto &r : rows){
+        std::set<unsigned> taps;
+        while(taps.size()<wA){
+            taps.insert(pool[urng()%pool.size()]);
+        }
+        r.assign(taps.begin(), taps.end());
+    }
+
+    std::vector<uint32_t> values(n, 0);
+    std::vector<unsigned> counts(1u<<wC, 0);
+    unsigned collisions=0;
+    for(unsigned r=0; r<wC; r++){
+        for(unsigned b : rows[r]){
+            for(unsigned k : withBit[b]){
+                values[k] ^= 1u<<r;
+            }
+        }
+    }
+    for(unsigned k=0; k<n; k++){
+        if(counts[values[k]]++ > 0)
+            collisions++;
+    }
+
+    auto flip=[&](unsigned k, unsigned r)
+    {
+        uint32_t &v=values[k];
+        if(--counts[v] > 0)
+            collisions--;
+        v ^= 1u<<r;
+        if(counts[v]++ > 0)
+            collisions++;
+    };
+
+    // Swapping tap out for tap in on row r flips bit r of every key with exactly one of them
+    auto swap=[&](unsigned r, unsigned in, unsigned out)
+    {
+        for(unsigned k : withBit[in]){
+            flip(k, r);
+        }
+        for(unsigned k : withBit[out]){
+            flip(k, r);
+        }
+    };
+
+    int &tries=ctxt.tries;
+    std::vector<uint32_t> seen(1u<<wC, UINT32_MAX);
+    std::vector<std::tuple<unsigned,unsigned,unsigned> > options;
+    const unsigned sample=16;
+
+    while(collisions>0 && tries<ctxt.maxTries){
+        if((tries%64)==0 && cpuTime()>ctxt.maxTime)
+            break;
+        tries++;
+
+        // Find two keys with the same value, starting somewhere random
+        unsigned ka=0, kb=0, start=urng()%n, i=0;
+        for(; i<n; i++){
+            unsigned k=(start+i)%n;
+            if(seen[values[k]]!=UINT32_MAX){
+                ka=seen[values[k]];
+                kb=k;
+                break;
+            }
+            seen[values[k]]=k;
+        }
+        for(unsigned j=0; j<i; j++){
+            seen[values[(start+j)%n]]=UINT32_MAX;
+        }
+        uint64_t diff=keys[ka]^keys[kb];
+
+        // Candidate swaps (row, in, out) which separate ka and kb
+        options.clear();
+        for(unsigned attempt=0; attempt<8*sample && options.size()<sample; attempt++){
+            unsigned r=urng()%wC;
+            unsigned in=pool[urng()%pool.size()];
+            unsigned out=rows[r][urng()%rows[r].size()];
+            if(std::find(rows[r].begin(), rows[r].end(), in)!=rows[r].end())
+                continue;
+            if(((diff>>in)&1)==((diff>>out)&1))
+                continue;
+            options.push_back(std::make_tuple(r, in, out));
+        }
+        if(options.empty())
+            continue;
+
+        unsigned pick=0;
+        if(udist(urng) < ctxt.walkNoise){
+            pick=urng()%options.size();
+        }else{
+            unsigned best=UINT_MAX;
+            for(unsigned i=0; i<options.size(); i++){
+                unsigned r, in, out;
+                std::tie(r, in, out)=options[i];
+                swap(r, in, out);
+                if(collisions<best){
+                    best=collisions;
+                    pick=i;
+                }
+                swap(r, in, out);
+            }
+        }
+
+        unsigned r, in, out;
+        std::tie(r, in, out)=options[pick];
+        swap(r, in, out);
+        *std::find(rows[r].begin(), rows[r].end(), out)=in;
+
+        if(ctxt.verbose>2){
+            std::cerr<<"    Try: "<<tries<<", collisions = "<<collisions<<"\n";
+        }
+    }
+
+    BitHash res;
+    res.wI=problem.getKeyWidth();
+    res.wO=wC;
+    for(auto &r : rows){
+        std::sort(r.begin(), r.end());
+        res.tables.push_back(BitHash::table());
+        res.tables.back().selectors=r;
+        res.tables.back().lut.resize(1u<<r.size());
+        for(unsigned a=0; a<res.tables.back().lut.size(); a++){
+            res.tables.back().lut[a]=__builtin_popcount(a)&1;
+        }
+    }
+    return std::make_pair(res, collisions==0);
+}
+
+#endif //FPGA_PERFECT_HASH_SOLVER_CONCENTRATOR_HPP
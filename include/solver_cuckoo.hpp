@@ -0,0 +1,256 @@
+#ifndef FPGA_PERFECT_HASH_SOLVER_CUCKOO_HPP
+#define FPGA_PERFECT_HASH_SOLVER_CUCKOO_HPP
+
+#include "bit_hash.hpp"
+#include "cuckoo_hash.hpp"
+#include "distinguishing_bits.hpp"
+
+#include "key_value_set.hpp"
+
+#include "solve_context.hpp"
+
+#include <set>
+
+/* One choice of a cuckoo hash, with wA taps per table drawn from pool, and
+ * random luts. Not makeBitHashConcrete, which would give every input to
+ * some table, and may use inputs which some keys don't define.
+ */
+template<class TRng>
+BitHash make_cuckoo_choice(TRng &rng, const std::vector<unsigned> &pool, unsigned wI, unsigned wR, unsigned wA)
+{
+    wA=std::min(wA, (unsigned)pool.size());
+
+    BitHash res;
+    res.wI=wI;
+    res.wO=wR;
+    res.tables.resize(wR);
+    for(auto &t : res.tables){
+        std::set<unsigned> taps;
+        while(taps.size()<wA){
+            taps.insert(pool[rng()%pool.size()]);
+        }
+        t.selectors.assign(taps.begin(), taps.end());
+        t.lut.resize(1u<<wA);
+        for(int &le : t.lut){
+            le=rng()%2;
+        }
+    }
+    return res;
+}
+
+/* Find a cuckoo hash (see cuckoo_hash.hpp), where each choice has ctxt.wO-1
+ * outputs and ctxt.wA taps per table, drawn from findUsableBits so that all
+ * the variants of a ternary key agree. Both choices start random, and the
+ * keys are placed by cuckoo_matching, which is kept maximum as the luts
+ * change. Then as in solver_walk, each step picks a key which can't be
+ * placed and flips one of the 2*(wO-1) lut entries it reads, which moves it
+ * (and any keys sharing that entry) to a different slot. With probability
+ * walkNoise the flip is random, otherwise it is the one which leaves the
+ * fewest keys unplaced. With probability tapMoveProb a tap of a random table
+ * is moved instead, which is kept if it doesn't make things worse. After 2n
+ * steps without a new best it goes back to the best point.
+ *
+ * Succeeds once no more than problem.getMaxStash() keys are unplaced, and
+ * gives up after ctxt.maxTries steps or ctxt.maxTime. Each slot holds one
+ * key, as in CuckooLookup, so ctxt.groupSize must be 1.
+ */
+std::pair<CuckooHash,bool> solve_cuckoo(
+        solve_context &ctxt,
+        const key_value_set &problem
+){
+    auto &urng=ctxt.urng;
+    std::uniform_real_distribution<> udist;
+
+    CuckooHash res;
+    res.wI=problem.getKeyWidth();
+    res.wO=ctxt.wO;
+
+    if(ctxt.wO<2)
+        throw std::runtime_error("solve_cuckoo : need wo >= 2.");
+    if(ctxt.groupSize!=1)
+        throw std::runtime_error("solve_cuckoo : only a group size of 1 is supported.");
+
+    unsigned wR=res.wO-1, n=problem.keys_size();
+    unsigned maxHash=problem.getMaxHash();
+    unsigned limit=maxHash>0 ? std::min(maxHash, 1u<<res.wO) : (1u<<res.wO);
+    if(limit*ctxt.groupSize+problem.getMaxStash() < n)
+        throw std::runtime_error("solve_cuckoo : output range and stash cannot hold the keys.");
+
+    auto pool=requireUsableBits(problem, "solve_cuckoo");
+
+    std::vector<bit_vector> keys;
+    for(const auto &kv : problem){
+        keys.push_back(*kv.first.variants_begin());
+    }
+
+    for(int c=0; c<2; c++){
+        res.choices[c]=make_cuckoo_choice(urng, pool, res.wI, wR, ctxt.wA);
+    }
+
+    // addrs[c][i][k] is the address key k reads in table i of choice c, and
+    // keysAt[c][i][a] are the keys which read address a of it
+    std::vector<std::vector<unsigned> > addrs[2];
+    std::vector<std::vector<std::vector<unsigned> > > keysAt[2];
+    std::vector<unsigned> hashes[2];
+    cuckoo_matching m(1u<<res.wO, n, ctxt.groupSize);
+
+    auto toSlot=[&](int c, unsigned h) -> unsigned
+    {
+        unsigned s=(unsigned(c)<<wR) | h;
+        return s<limit ? s : UINT_MAX;
+    };
+
+    auto indexTable=[&](int c, unsigned i)
+    {
+        const auto &t=res.choices[c].tables[i];
+        keysAt[c][i].assign(t.lut.size(), std::vector<unsigned>());
+        for(unsigned k=0; k<n; k++){
+            addrs[c][i][k]=t.address(keys[k]);
+            keysAt[c][i][addrs[c][i][k]].push_back(k);
+        }
+    };
+
+    // Bring the hash of key k under choice c up to date with table i
+    auto refresh=[&](int c, unsigned i, unsigned k)
+    {
+        unsigned bit=res.choices[c].tables[i].lut[addrs[c][i][k]];
+        unsigned h=(hashes[c][k] & ~(1u<<i)) | (bit<<i);
+        if(h!=hashes[c][k]){
+            hashes[c][k]=h;
+            m.set_slot(k, c, toSlot(c, h));
+        }
+    };
+
+    // Rebuild everything from res, and place the keys from scratch
+    auto load=[&]() -> unsigned
+    {
+        m=cuckoo_matching(1u<<res.wO, n, ctxt.groupSize);
+        for(int c=0; c<2; c++){
+            addrs[c].assign(wR, std::vector<unsigned>(n));
+            keysAt[c].resize(wR);
+            hashes[c].resize(n);
+            for(unsigned i=0; i<wR; i++){
+                indexTable(c, i);
+            }
+            for(unsigned k=0; k<n; k++){
+                hashes[c][k]=res.choices[c](keys[k]);
+                m.slots[c][k]=toSlot(c, hashes[c][k]);
+            }
+        }
+        return m.settle();
+    };
+
+    auto flipLut=[&](int c, unsigned i, unsigned a)
+    {
+        int &le=res.choices[c].tables[i].lut[a];
+        le=1-le;
+        for(unsigned k : keysAt[c][i][a]){
+            refresh(c, i, k);
+        }
+        return m.settle();
+    };
+
+    auto setTaps=[&](int c, unsigned i, const std::vector<unsigned> &taps)
+    {
+        res.choices[c].tables[i].selectors=taps;
+        indexTable(c, i);
+        for(unsigned k=0; k<n; k++){
+            refresh(c, i, k);
+        }
+        return m.settle();
+    };
+
+    unsigned eCurr=load(), eBest=eCurr;
+    CuckooHash best=res;
+    ctxt.logMsg(1, "Random start leaves %u of %u keys unplaced.\n", eCurr, n);
+
+    unsigned maxStall=2*n, stall=0;
+
+    std::vector<unsigned> unplaced;
+    std::vector<std::tuple<int,unsigned,unsigned> > candidates, flipBest;
+
+    for(ctxt.tries=1; eCurr>problem.getMaxStash() && ctxt.tries<ctxt.maxTries; ctxt.tries++){
+        if((ctxt.tries%256)==0 && cpuTime()>ctxt.maxTime)
+            break;
+
+        if(udist(urng) < ctxt.tapMoveProb){
+            int c=urng()%2;
+            unsigned i=urng()%wR;
+            auto before=res.choices[c].tables[i].selectors;
+            std::set<unsigned> taps(before.begin(), before.end());
+            if(taps.size()<pool.size()){
+                unsigned drop=before[urng()%before.size()], add;
+                do{
+                    add=pool[urng()%pool.size()];
+                }while(taps.count(add));
+                taps.erase(drop);
+                taps.insert(add);
+                unsigned e=setTaps(c, i, std::vector<unsigned>(taps.begin(), taps.end()));
+                if(e<=eCurr){
+                    eCurr=e;
+                }else{
+                    eCurr=setTaps(c, i, before);
+                }
+            }
+        }else{
+            unplaced.clear();
+            for(unsigned k=0; k<n; k++){
+                if(m.choice[k]==-1)
+                    unplaced.push_back(k);
+            }
+            unsigned k=unplaced[urng()%unplaced.size()];
+
+            candidates.clear();
+            for(int c=0; c<2; c++){
+                for(unsigned i=0; i<wR; i++){
+                    candidates.push_back(std::make_tuple(c, i, addrs[c][i][k]));
+                }
+            }
+
+            if(udist(urng) < ctxt.walkNoise){
+                const auto &f=candidates[urng()%candidates.size()];
+                eCurr=flipLut(std::get<0>(f), std::get<1>(f), std::get<2>(f));
+            }else{
+                // Try each flip and put it back, which gives a maximum matching again
+                unsigned eFlipBest=UINT_MAX;
+                flipBest.clear();
+                for(const auto &f : candidates){
+                    unsigned e=flipLut(std::get<0>(f), std::get<1>(f), std::get<2>(f));
+                    if(e<eFlipBest){
+                        eFlipBest=e;
+                        flipBest.clear();
+                    }
+                    if(e==eFlipBest){
+                        flipBest.push_back(f);
+                    }
+                    flipLut(std::get<0>(f), std::get<1>(f), std::get<2>(f));
+                }
+                const auto &f=flipBest[urng()%flipBest.size()];
+                eCurr=flipLut(std::get<0>(f), std::get<1>(f), std::get<2>(f));
+            }
+        }
+
+        if(eCurr<eBest){
+            eBest=eCurr;
+            best=res;
+            stall=0;
+            ctxt.logMsg(2, "    Try: %d, unplaced = %u\n", ctxt.tries, eBest);
+        }else if(++stall > maxStall){
+            // Greedy flips can wander uphill, so go back to the best point
+            res=best;
+            eCurr=load();
+            stall=0;
+        }
+    }
+    ctxt.logCsv("CuckooSteps", ctxt.tries);
+    ctxt.logCsv("CuckooUnplaced", eBest);
+
+    if(eBest>problem.getMaxStash())
+        return std::make_pair(best, false);
+
+    if(!res.is_solution(problem, ctxt.groupSize))
+        throw std::runtime_error("solve_cuckoo : failed post solution check.");
+    return std::make_pair(res, true);
+}
+
+#endif //FPGA_PERFECT_HASH_SOLVER_CUCKOO_HPP
@@ -0,0 +1,196 @@
+#ifndef FPGA_PERFECT_HASH_SOLVER_FAMILY_HPP
+#define FPGA_PERFECT_HASH_SOLVER_FAMILY_HPP
+
+#include "family_hash.hpp"
+
+#include "key_value_set.hpp"
+
+#include "solve_context.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+/* Search for a control word which makes fh a solution for problem, leaving
+ * the taps and luts alone. The output bit of every (table,control,key) is
+ * worked out once up front, so the search itself is a depth first walk over
+ * the tables, choosing one sub-lut at each level.
+ *
+ * After choosing the first d tables, keys are split by the low d bits of
+ * their hash, and each class has room for at most groupSize times the
+ * number of hashes below maxHash which end in those bits. Keys beyond that
+ * (plus keys whose variants already disagree) must be stashed, so as soon
+ * as that is more than getMaxStash() the branch is cut. At the last level
+ * the bound is exact, so anything that survives is a solution.
+ *
+ * The first few tables are enumerated up front to give work items, which
+ * ctxt.threads workers take in turn, and everyone stops once one of them
+ * finds a word. Gives up if ctxt.maxTime runs out.
+ */
+bool search_family_control(solve_context &ctxt, FamilyHash &fh, const key_value_set &problem)
+{
+    const unsigned wO=fh.wO, nC=1u<<fh.wC;
+    const unsigned groupSize=std::max(1, ctxt.groupSize);
+    const unsigned maxStash=problem.getMaxStash();
+    const unsigned maxHash=problem.getMaxHash();
+    const unsigned range=maxHash>0 ? std::min(maxHash, 1u<<wO) : (1u<<wO);
+    const unsigned nKeys=problem.keys_size();
+
+    if(nKeys > uint64_t(range)*groupSize + maxStash)
+        return false;
+
+    // out[t*nC+c][k] is the bit table t gives key k under control c, or 2 if the variants of k disagree
+    std::vector<std::vector<uint8_t> > out(wO*nC, std::vector<uint8_t>(nKeys));
+    unsigned ki=0;
+    for(const auto &kv : problem){
+        for(unsigned t=0; t<wO; t++){
+            const auto &tab=fh.tables[t];
+            unsigned wT=tab.selectors.size();
+            std::vector<unsigned> addrs;
+            for(auto it=kv.first.variants_begin(); it!=kv.first.variants_end(); ++it){
+                const auto &v=*it;
+                unsigned addr=0;
+                for(unsigned j=0; j<wT; j++){
+                    addr |= unsigned(v[tab.selectors[j]]==1)<<j;
+                }
+                addrs.push_back(addr);
+            }
+            for(unsigned c=0; c<nC; c++){
+                int b=tab.lut[(c<<wT)|addrs[0]]==1;
+                for(unsigned a : addrs){
+                    if((tab.lut[(c<<wT)|a]==1)!=b)
+                        b=2;
+                }
+                out[t*nC+c][ki]=b;
+            }
+        }
+        ki++;
+    }
+
+    // cap[d][p] is the room for keys whose hash has p in its low d+1 bits
+    std::vector<std::vector<unsigned> > cap(wO);
+    for(unsigned d=0; d<wO; d++){
+        unsigned span=1u<<(d+1);
+        cap[d].resize(span);
+        for(unsigned p=0; p<span; p++){
+            cap[d][p] = p<range ? groupSize*((range-p+span-1)/span) : 0;
+        }
+    }
+
+    // Enough prefixes that all the workers stay busy
+    unsigned threads=std::max(1, ctxt.threads);
+    unsigned depthSplit=0;
+    uint64_t nItems=1;
+    while(depthSplit<wO && nItems<8*threads){
+        nItems*=nC;
+        depthSplit++;
+    }
+
+    const uint32_t BAD=0x80000000u;
+
+    std::atomic<uint64_t> next(0), nodes(0);
+    std::atomic<bool> found(false), timedOut(false);
+    std::mutex lock;
+    std::vector<unsigned> result;
+
+    auto worker=[&]()
+    {
+        std::vector<std::vector<uint32_t> > h(wO+1, std::vector<uint32_t>(nKeys, 0));
+        std::vector<unsigned> nBad(wO+1, 0);
+        std::vector<unsigned> counts(1u<<wO);
+        std::vector<unsigned> choice(wO), prefix(depthSplit);
+        uint64_t localNodes=0;
+
+        // Fill in level d+1 from level d using control c, returning false if it is cut
+        auto step=[&](unsigned d, unsigned c) -> bool
+        {
+            localNodes++;
+            const auto &bits=out[d*nC+c];
+            const auto &cp=cap[d];
+            const auto &src=h[d];
+            auto &dst=h[d+1];
+            std::fill(counts.begin(), counts.begin()+(2u<<d), 0);
+            unsigned excess=nBad[d];
+            for(unsigned k=0; k<nKeys; k++){
+                uint32_t x=src[k];
+                if(x!=BAD){
+                    uint8_t b=bits[k];
+                    if(b==2){
+                        x=BAD;
+                        excess++;
+                    }else{
+                        x |= uint32_t(b)<<d;
+                        if(++counts[x] > cp[x])
+                            excess++;
+                    }
+                }
+                dst[k]=x;
+                if(excess>maxStash)
+                    return false;
+            }
+            unsigned bad=nBad[d];
+            for(unsigned k=0; k<nKeys; k++){
+                bad += dst[k]==BAD && src[k]!=BAD;
+            }
+            nBad[d+1]=bad;
+            return true;
+        };
+
+        std::function<void(unsigned)> descend=[&](unsigned d)
+        {
+            if(d==wO){
+                std::lock_guard<std::mutex> g(lock);
+                if(!found){
+                    found=true;
+                    result=choice;
+                }
+                return;
+            }
+            unsigned lo=0, hi=nC;
+            if(d<depthSplit){
+                lo=prefix[d];
+                hi=lo+1;
+            }
+            for(unsigned c=lo; c<hi && !found && !timedOut; c++){
+                if((localNodes&0x3FF)==0 && cpuTime()>ctxt.maxTime){
+                    timedOut=true;
+                    break;
+                }
+                if(step(d, c)){
+                    choice[d]=c;
+                    descend(d+1);
+                }
+            }
+        };
+
+        while(!found && !timedOut){
+            uint64_t item=next++;
+            if(item>=nItems)
+                break;
+            for(unsigned d=0; d<depthSplit; d++){
+                prefix[d]=item%nC;
+                item/=nC;
+            }
+            descend(0);
+        }
+        nodes+=localNodes;
+    };
+
+    std::vector<std::thread> workers;
+    for(unsigned i=0; i<threads; i++){
+        workers.emplace_back(worker);
+    }
+    for(auto &w : workers){
+        w.join();
+    }
+
+    ctxt.logMsg(1, "Visited %llu nodes of the control tree.\n", (unsigned long long)nodes);
+    ctxt.logCsv("FamilyNodes", (uint64_t)nodes);
+
+    if(!found)
+        return false;
+    fh.control=result;
+    return true;
+}
+
+#endif //FPGA_PERFECT_HASH_SOLVER_FAMILY_HPP
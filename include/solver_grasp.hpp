@@ -14,7 +14,17 @@
 
 #include "solve_context.hpp"
 
+#include <mutex>
+#include <thread>
 
+
+/* GRASP with path relinking. Each worker alternates between building a new
+ * point with randomised_greedy and relinking it towards a member of the elite
+ * pool. With ctxt.threads>1 several workers run at once, sharing the elite
+ * pool and best solution under a mutex. Each worker has its own rng and
+ * EntryToKey, and they all share one shuffle so that relinking is possible
+ * between any pair of elites.
+ */
 std::pair<BitHash,bool> solver_grasp(
         solve_context &ctxt,
         const key_value_set &problem
@@ -27,63 +37,104 @@ std::pair<BitHash,bool> solver_grasp(
     int groupSize=ctxt.groupSize;
     int &tries=ctxt.tries;
 
-    std::uniform_real_distribution<> udist;
-
     BitHash solBest=makeBitHashConcrete(urng, wO, wI, wA);
     double eBest=evalSolution(solBest, problem, groupSize);
 
     std::vector<std::pair<double,BitHash> > elites;
     elites.push_back(std::make_pair(eBest, solBest));
 
-    BitHash solCurr=solBest;
-    EntryToKey manipCurr(solCurr, problem);
-
     unsigned triesAtLevel=100;
 
-    while (eBest!=0 && tries < ctxt.maxTries) {
-        if(verbose>0){
-            std::cerr<<"    Try: "<<tries<<", e = "<<eBest<<"\n";
+    std::mutex lock;
+    bool finished=false;
+
+    auto worker=[&](unsigned seed)
+    {
+        std::mt19937 wrng(seed);
+
+        BitHash solCurr;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            solCurr=solBest;
         }
+        EntryToKey manipCurr(solCurr, problem);
 
-        randomised_greedy(manipCurr, groupSize);
-        double eCurr=manipCurr.eval(groupSize);
-        fprintf(stderr, "  ePostSearch = %f", eCurr);
+        while(1){
+            randomised_greedy(wrng, manipCurr, groupSize);
+            double eCurr=manipCurr.eval(groupSize);
+            if(verbose>2){
+                fprintf(stderr, "  ePostSearch = %f\n", eCurr);
+            }
 
-        int sel=urng()%elites.size();
-        BitHash target=elites[sel].second;
+            BitHash target;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                if(finished)
+                    break;
+                target=elites[wrng()%elites.size()].second;
+            }
 
-        relink_path(manipCurr, target, groupSize);
-        eCurr=manipCurr.eval(groupSize);
-        fprintf(stderr, "  ePostLink = %f", eCurr);
+            relink_path(wrng, manipCurr, target, groupSize);
+            eCurr=manipCurr.eval(groupSize);
+            if(verbose>2){
+                fprintf(stderr, "  ePostLink = %f\n", eCurr);
+            }
 
-        if(eCurr < eBest) {
-            eBest=eCurr;
-            solBest=manipCurr.bh;
-        }
+            std::unique_lock<std::mutex> guard(lock);
 
-        bool seen=false;
-        for(unsigned i=0;i<elites.size();i++){
-            if(elites[i].second==manipCurr.bh){
-                seen=true;
+            tries++;
+            if(verbose>0){
+                std::cerr<<"    Try: "<<tries<<", e = "<<eCurr<<", eBest = "<<eBest<<"\n";
             }
-        }
-        if(!seen) {
-            elites.push_back(std::make_pair(eCurr, manipCurr.bh));
-        }
-        if(elites.size()>20){
-            std::sort(elites.begin(), elites.end());
-            elites.erase(elites.end()-1);
-        }
 
-        if(0==(tries%triesAtLevel)){
-            if (verbose > 1) {
-                std::cerr << "    Try: " << tries << ", eBest = " << eBest << "\n";
+            if(eCurr < eBest) {
+                eBest=eCurr;
+                solBest=manipCurr.bh;
             }
 
-            // cpuTime() is really expensive in OS X
-            if(cpuTime() > ctxt.maxTime)
+            bool seen=false;
+            for(unsigned i=0;i<elites.size();i++){
+                if(elites[i].second==manipCurr.bh){
+                    seen=true;
+                }
+            }
+            if(!seen) {
+                elites.push_back(std::make_pair(eCurr, manipCurr.bh));
+            }
+            if(elites.size()>20){
+                std::sort(elites.begin(), elites.end());
+                elites.erase(elites.end()-1);
+            }
+
+            if(eBest==0 || tries >= ctxt.maxTries){
+                finished=true;
+            }
+
+            if(0==(tries%triesAtLevel)){
+                if (verbose > 1) {
+                    std::cerr << "    Try: " << tries << ", eBest = " << eBest << "\n";
+                }
+
+                // cpuTime() is really expensive in OS X. Note that it
+                // counts time across all threads.
+                if(cpuTime() > ctxt.maxTime)
+                    finished=true;
+            }
+
+            if(finished)
                 break;
         }
+    };
+
+    if(eBest!=0 && tries < ctxt.maxTries) {
+        std::vector<std::thread> threads;
+        for (int i = 1; i < ctxt.threads; i++) {
+            threads.emplace_back(worker, (unsigned) urng());
+        }
+        worker((unsigned) urng());
+        for (auto &t : threads) {
+            t.join();
+        }
     }
 
     return std::make_pair(solBest, eBest==0);
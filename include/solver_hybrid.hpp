@@ -0,0 +1,92 @@
+#ifndef FPGA_PERFECT_HASH_SOLVER_HYBRID_HPP
+#define FPGA_PERFECT_HASH_SOLVER_HYBRID_HPP
+
+#include "bit_hash.hpp"
+#include "bit_hash_cnf.hpp"
+
+#include "key_value_set.hpp"
+
+#include "solve_context.hpp"
+#include "solver_anneal.hpp"
+
+/* Local search followed by SAT. We anneal for hybridTime seconds, which
+ * usually gets within a few collisions, then build the CNF for the best
+ * hash's shuffle with every lut bit free. Rather than throwing away the
+ * lut contents, they are used to seed minisat's saved phases, so the first
+ * descent goes straight to the near-solution and conflict analysis only has
+ * to repair the remaining collisions.
+ *
+ * Each shuffle only gets a conflict budget (doubling on every attempt),
+ * so a bad shuffle can't soak up all the time; if it turns out to be
+ * unsatisfiable or runs out of budget we go round again with a fresh anneal.
+ */
+std::pair<BitHash,bool> solver_hybrid(
+        solve_context &ctxt,
+        const key_value_set &problem
+){
+    int &verbose=ctxt.verbose;
+
+    double maxTime=ctxt.maxTime;
+    int64_t confBudget=100000;
+
+    // Not ctxt.tries, which belongs to whichever solver is running inside
+    int attempts=0;
+    while(attempts < ctxt.maxTries && cpuTime() < maxTime){
+        attempts++;
+
+        // Local search gets a slice of the time, then we take the best it found
+        ctxt.maxTime=std::min(maxTime, cpuTime()+ctxt.hybridTime);
+        BitHash seed;
+        bool success;
+        std::tie(seed, success)=solver_anneal(ctxt, problem);
+        ctxt.maxTime=maxTime;
+
+        if(success){
+            ctxt.logCsv("HybridPhase", "anneal");
+            return std::make_pair(seed, true);
+        }
+
+        double eSeed=evalSolution(seed, problem, ctxt.groupSize);
+        if(verbose>0){
+            std::cerr<<"  Attempt "<<attempts<<", anneal reached e = "<<eSeed<<", seeding minisat.\n";
+        }
+
+        BitHash bh=seed;
+        for(auto &t : bh.tables){
+            std::fill(t.lut.begin(), t.lut.end(), -1);
+        }
+
+        cnf_problem prob;
+        to_cnf(bh, problem.keys(), prob, problem.getMaxHash(), ctxt.groupSize, problem.getMaxStash()>0);
+        if(problem.getMaxStash()>0){
+            requireAtMostK(prob.sat, prob.stashLits, problem.getMaxStash());
+        }
+
+        // In minisat a polarity of true means the variable is tried as false first
+        for(const auto &bit : prob.lutToVariable){
+            int v=seed.tables[bit.first.first].lut[bit.first.second];
+            prob.sat.setPolarity(bit.second-1, v!=1);
+        }
+
+        auto sol = minisat_solve(prob, verbose>2 ? 1 : 0, confBudget);
+        if(sol.empty()){
+            if(verbose>0){
+                std::cerr<<"  No solution within "<<confBudget<<" conflicts\n";
+            }
+            confBudget*=2;
+            continue;
+        }
+
+        auto back = substitute(bh, prob, sol);
+        if (!back.is_solution(problem, ctxt.groupSize))
+            throw std::runtime_error("Failed post substitution check.");
+
+        ctxt.logCsv("HybridPhase", "minisat");
+        ctxt.logCsv("HybridSeedDistance", seed.distance(back));
+        return std::make_pair(back, true);
+    }
+
+    return std::make_pair(BitHash(), false);
+};
+
+#endif //FPGA_PERFECT_HASH_SOLVER_HYBRID_HPP
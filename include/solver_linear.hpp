@@ -0,0 +1,132 @@
+#ifndef FPGA_PERFECT_HASH_SOLVER_LINEAR_HPP
+#define FPGA_PERFECT_HASH_SOLVER_LINEAR_HPP
+
+#include "linear_hash.hpp"
+#include "distinguishing_bits.hpp"
+
+#include "key_value_set.hpp"
+
+#include "solve_context.hpp"
+
+/* A random row of A over the pool bits. With rowWeight==0 every pool bit is
+ * in with probability 1/2, which is the universal family, otherwise the row
+ * has exactly rowWeight taps, which makes for smaller XOR trees.
+ */
+template<class TRng>
+uint64_t make_linear_row(TRng &rng, const std::vector<unsigned> &pool, unsigned rowWeight)
+{
+    uint64_t res=0;
+    if(rowWeight==0 || rowWeight>=pool.size()){
+        for(unsigned b : pool){
+            if(rowWeight>0 || (rng()&1))
+                res |= uint64_t(1)<<b;
+        }
+    }else{
+        while((unsigned)__builtin_popcountll(res)<rowWeight){
+            res |= uint64_t(1)<<pool[rng()%pool.size()];
+        }
+    }
+    return res;
+}
+
+/* Find a linear hash with ctxt.wO outputs. Only findUsableBits are used, so
+ * every variant of a ternary key gets the same hash.
+ *
+ * The keys lie in the affine space x0 + span{xi ^ x0}, found by elimination
+ * in O(n.w) word operations. If that space has dimension d <= wO, then A is
+ * perfect on it (and so on the keys) exactly when the images of the d basis
+ * vectors have rank d, which is an O(w^2) check per candidate and succeeds
+ * for a constant fraction of random A. This is the case for dense key sets,
+ * such as a block of sequential IDs. Otherwise (or with maxHash) each
+ * candidate is checked by hashing the keys, which only succeeds in
+ * reasonable time at low load, as a random linear hash collides about as
+ * often as a random function.
+ *
+ * Gives up after ctxt.maxTries candidates or ctxt.maxTime.
+ */
+std::pair<LinearHash,bool> solve_linear(
+        solve_context &ctxt,
+        const key_value_set &problem,
+        unsigned rowWeight=0
+){
+    auto &urng=ctxt.urng;
+
+    LinearHash res;
+    res.wI=problem.getKeyWidth();
+    res.wO=ctxt.wO;
+    res.rows.assign(res.wO, 0);
+
+    if(res.wI>64)
+        throw std::runtime_error("solve_linear : keys are limited to 64 bits.");
+    if(res.wO>24)
+        throw std::runtime_error("solve_linear : wo > 24 is unexpectedly large.");
+
+    auto pool=requireUsableBits(problem, "solve_linear");
+
+    // Every variant agrees on the pool bits
+    std::vector<uint64_t> keys;
+    for(const auto &kv : problem){
+        const auto &k=*kv.first.variants_begin();
+        uint64_t x=0;
+        for(unsigned b : pool){
+            x |= uint64_t(k[b]==1)<<b;
+        }
+        keys.push_back(x);
+    }
+
+    std::vector<uint64_t> basis;
+    for(uint64_t x : keys){
+        gf2_insert(basis, x^keys[0]);
+    }
+    std::vector<uint64_t> dirs;
+    for(uint64_t b : basis){
+        if(b)
+            dirs.push_back(b);
+    }
+    unsigned d=dirs.size();
+
+    unsigned maxHash=problem.getMaxHash();
+    bool byRank = d<=res.wO && (maxHash==0 || maxHash>=(1u<<res.wO));
+    ctxt.logMsg(1, "Keys span an affine space of dimension %u, checking candidates by %s.\n", d, byRank ? "rank" : "hashing the keys");
+    ctxt.logCsv("LinearDimension", d);
+
+    std::vector<unsigned> counts(1u<<res.wO);
+    std::vector<uint64_t> images(d);
+    unsigned limit=maxHash>0 ? maxHash : (1u<<res.wO);
+
+    for(ctxt.tries=1; ctxt.tries<ctxt.maxTries; ctxt.tries++){
+        if((ctxt.tries%64)==0 && cpuTime()>ctxt.maxTime)
+            break;
+
+        for(auto &r : res.rows){
+            r=make_linear_row(urng, pool, rowWeight);
+        }
+
+        if(byRank){
+            for(unsigned i=0; i<d; i++){
+                images[i]=res(dirs[i]);
+            }
+            if(gf2_rank(images)==d)
+                break;
+        }else{
+            std::fill(counts.begin(), counts.end(), 0);
+            unsigned stashed=0;
+            for(uint64_t x : keys){
+                unsigned h=res(x);
+                if(h>=limit || counts[h]>=(unsigned)ctxt.groupSize){
+                    if(++stashed > problem.getMaxStash())
+                        break;
+                }else{
+                    counts[h]++;
+                }
+            }
+            if(stashed<=problem.getMaxStash())
+                break;
+        }
+    }
+    ctxt.logCsv("LinearTries", ctxt.tries);
+
+    return std::make_pair(res, res.is_solution(problem, ctxt.groupSize));
+}
+
+#endif //FPGA_PERFECT_HASH_SOLVER_LINEAR_HPP
@@ -0,0 +1,242 @@
+#ifndef FPGA_PERFECT_HASH_SOLVER_LNS_HPP
+#define FPGA_PERFECT_HASH_SOLVER_LNS_HPP
+
+#include "bit_hash.hpp"
+#include "bit_hash_anneal.hpp"
+#include "bit_hash_cnf.hpp"
+
+#include "key_value_set.hpp"
+
+#include "solve_context.hpp"
+#include "solver_walk.hpp"
+
+/* Count, for each table, how many colliding pairs of keys it fails to separate
+ * (i.e. both keys read the same lut entry). Keys above maxHash and disagreeing
+ * variants count against every table they read. These are the tables which
+ * are most worth re-solving.
+ */
+std::vector<unsigned> lns_table_scores(const BitHash &bh, const key_value_set &problem, unsigned groupSize)
+{
+    std::vector<unsigned> scores(bh.wO, 0);
+    std::vector<std::vector<bit_vector> > buckets(1u<<bh.wO);
+    unsigned maxHash=problem.getMaxHash();
+
+    for(const auto &kv : problem){
+        auto it=kv.first.variants_begin();
+        unsigned h=bh(*it);
+        buckets[h].push_back(*it);
+
+        bool bad = maxHash>0 && h>=maxHash;
+        for(++it; it!=kv.first.variants_end(); ++it){
+            bad = bad || bh(*it)!=h;
+        }
+        if(bad){
+            for(auto &s : scores){
+                s++;
+            }
+        }
+    }
+
+    for(const auto &b : buckets){
+        if(b.size()<=groupSize)
+            continue;
+        for(unsigned i=0; i<b.size(); i++){
+            for(unsigned j=i+1; j<b.size(); j++){
+                for(unsigned ti=0; ti<bh.wO; ti++){
+                    if(bh.tables[ti].address(b[i])==bh.tables[ti].address(b[j]))
+                        scores[ti]++;
+                }
+            }
+        }
+    }
+    return scores;
+}
+
+/* Large neighbourhood search, starting from hybridTime seconds of solver_walk.
+ * Each step picks 1-3 tables, weighted towards
+ * the ones that fail to separate colliding keys, frees all their lut entries
+ * (and sometimes their taps) while holding every other table fixed, and asks minisat for an assignment
+ * with fewer stashed keys than we currently have (see to_cnf). Because most
+ * of the hash is fixed the CNF is small, and most of the pair constraints
+ * disappear as they are already satisfied by the fixed tables.
+ *
+ * Occasionally we ask for no more (rather than fewer) stashed keys, which
+ * allows sideways moves to escape neighbourhoods which are locally optimal.
+ *
+ * Success is reaching problem.getMaxStash() stashed keys (zero, normally).
+ */
+std::pair<BitHash,bool> solver_lns(
+        solve_context &ctxt,
+        const key_value_set &problem
+){
+    int &verbose=ctxt.verbose;
+    auto &urng=ctxt.urng;
+    int wO=ctxt.wO;
+    int groupSize=ctxt.groupSize;
+    int &tries=ctxt.tries;
+
+    std::uniform_real_distribution<> udist;
+
+    // The stash bound gets expensive to encode when lots of keys collide, so
+    // start from wherever a short local search gets to.
+    BitHash solCurr;
+    {
+        double maxTime=ctxt.maxTime;
+        ctxt.maxTime=std::min(maxTime, cpuTime()+ctxt.hybridTime);
+        bool success;
+        std::tie(solCurr, success)=solver_walk(ctxt, problem);
+        ctxt.maxTime=maxTime;
+        if(success)
+            return std::make_pair(solCurr, true);
+    }
+    unsigned eCurr=solCurr.find_stash(problem, groupSize).size();
+    if(verbose>1){
+        std::cerr<<"    Local search reached eCurr = "<<eCurr<<"\n";
+    }
+
+    const unsigned target=problem.getMaxStash();
+    const int64_t confBudget=10000;
+
+    unsigned improvements=0, sideways=0, stall=0;
+
+    tries=0;
+    while(eCurr > target && tries < ctxt.maxTries){
+        tries++;
+
+        if(0==(tries%10)){
+            if(verbose>1){
+                std::cerr<<"    Try: "<<tries<<", eCurr = "<<eCurr<<", improvements = "<<improvements<<", sideways = "<<sideways<<"\n";
+            }
+            if(cpuTime() > ctxt.maxTime)
+                break;
+        }
+
+        auto stash=solCurr.find_stash(problem, groupSize);
+        std::set<bit_vector> stashed(stash.begin(), stash.end());
+
+        // Choose the tables to free, without replacement
+        auto scores=lns_table_scores(solCurr, problem, groupSize);
+        unsigned nFree=1+urng()%std::min(3, wO);
+        std::vector<unsigned> chosen;
+        while(chosen.size()<nFree){
+            double total=0;
+            for(int ti=0; ti<wO; ti++){
+                if(std::find(chosen.begin(), chosen.end(), ti)==chosen.end())
+                    total+=scores[ti]+1;
+            }
+            double pick=udist(urng)*total;
+            for(int ti=0; ti<wO; ti++){
+                if(std::find(chosen.begin(), chosen.end(), ti)!=chosen.end())
+                    continue;
+                pick-=scores[ti]+1;
+                if(pick<0 || ti==wO-1){
+                    chosen.push_back(ti);
+                    break;
+                }
+            }
+        }
+
+        // Half the time the freed tables also get new taps, as the current
+        // ones may be what stops them separating the colliding keys
+        bool reTap = udist(urng) < 0.5;
+        BitHash sub(solCurr);
+        for(unsigned ti : chosen){
+            if(reTap){
+                std::vector<unsigned> inputs(solCurr.wI);
+                for(unsigned i=0; i<inputs.size(); i++){
+                    inputs[i]=i;
+                }
+                auto &sel=sub.tables[ti].selectors;
+                for(unsigned i=0; i<sel.size(); i++){
+                    std::swap(inputs[i], inputs[i+urng()%(inputs.size()-i)]);
+                    sel[i]=inputs[i];
+                }
+            }
+            std::fill(sub.tables[ti].lut.begin(), sub.tables[ti].lut.end(), -1);
+        }
+
+        bool sideStep = udist(urng) < (stall > 4u*wO ? 0.5 : 0.1);
+        unsigned bound = sideStep ? eCurr : eCurr-1;
+
+        // Keys which differ in any fixed table can never share a hash, so
+        // only keys within the same class (same fixed hash bits) need to be
+        // encoded against each other. Calls to to_cnf on the same problem
+        // share the lut variables, so we just collect the stash literals.
+        unsigned freeMask=0;
+        for(unsigned ti : chosen){
+            freeMask|=1u<<ti;
+        }
+        std::map<unsigned,std::vector<bit_vector> > classes;
+        for(const auto &k : problem.keys()){
+            classes[solCurr(*k.variants_begin()) & ~freeMask].push_back(k);
+        }
+
+        cnf_problem prob;
+        std::vector<Minisat::Lit> stashLits;
+        for(const auto &c : classes){
+            // A lone concrete key can only be displaced by maxHash
+            if(c.second.size()==1 && problem.getMaxHash()==0 && c.second[0].is_concrete()){
+                continue;
+            }
+            to_cnf(sub, c.second, prob, problem.getMaxHash(), groupSize, true);
+            // Only classes which currently have stashed keys can be rearranged,
+            // otherwise the counter gets too big.
+            bool open=false;
+            for(const auto &k : c.second){
+                open = open || stashed.count(k)>0;
+            }
+            for(unsigned i=0; i<c.second.size(); i++){
+                if(open){
+                    stashLits.push_back(prob.stashLits[i]);
+                    prob.sat.setPolarity(Minisat::var(prob.stashLits[i]), stashed.count(c.second[i])==0);
+                }else{
+                    prob.sat.addClause(~prob.stashLits[i]);
+                }
+            }
+        }
+        requireAtMostK(prob.sat, stashLits, bound);
+        // Improving steps start from the current luts, sideways steps from
+        // somewhere random so that they actually go somewhere new
+        for(const auto &bit : prob.lutToVariable){
+            bool pol = sideStep ? (urng()&1) : solCurr.tables[bit.first.first].lut[bit.first.second]!=1;
+            prob.sat.setPolarity(bit.second-1, pol);
+        }
+
+        stall++;
+        auto sol=minisat_solve(prob, 0, confBudget);
+        if(sol.empty())
+            continue;
+
+        BitHash cand=substitute(sub, prob, sol);
+        // Entries that no key reads are not in the CNF, so keep their old values
+        for(unsigned ti : chosen){
+            auto &lut=cand.tables[ti].lut;
+            for(unsigned i=0; i<lut.size(); i++){
+                if(lut[i]==-1)
+                    lut[i]=solCurr.tables[ti].lut[i];
+            }
+        }
+
+        unsigned eCand=cand.find_stash(problem, groupSize).size();
+        if(eCand < eCurr){
+            improvements++;
+            stall=0;
+            if(verbose>1){
+                std::cerr<<"    Try: "<<tries<<", freed "<<nFree<<" tables, New eCurr = "<<eCand<<"\n";
+            }
+        }else{
+            sideways++;
+        }
+        if(eCand <= eCurr){
+            solCurr=cand;
+            eCurr=eCand;
+        }
+    }
+
+    ctxt.logCsv("LnsImprovements", improvements);
+    ctxt.logCsv("LnsSideways", sideways);
+
+    return std::make_pair(solCurr, eCurr<=target);
+};
+
+#endif //FPGA_PERFECT_HASH_SOLVER_LNS_HPP
@@ -0,0 +1,214 @@
+#ifndef FPGA_PERFECT_HASH_SOLVER_PARTITIONED_HPP
+#define FPGA_PERFECT_HASH_SOLVER_PARTITIONED_HPP
+
+#include "bit_hash.hpp"
+#include "bit_hash_cnf.hpp"
+#include "partitioned_hash.hpp"
+#include "distinguishing_bits.hpp"
+
+#include "key_value_set.hpp"
+
+#include "solve_context.hpp"
+
+#include <set>
+#include <thread>
+#include <tuple>
+
+/* Choose the selector lut, trying selectorCandidates random sets of taps from
+ * findUsableBits (so all the variants of a ternary key agree). For each set
+ * of taps the keys per address are counted, and a subset sum over those
+ * counts picks the addresses which go to half 1, so that it gets as close as
+ * possible to target keys while neither half holds more than caps[h] keys.
+ * Returns the selector and how far from target it is, which is UINT_MAX if
+ * no candidate could respect the caps.
+ */
+template<class TRng>
+std::pair<BitHash,unsigned> make_partition_selector(
+        TRng &rng,
+        const key_value_set &problem,
+        unsigned wS,
+        unsigned target,
+        const unsigned caps[2],
+        unsigned selectorCandidates
+){
+    unsigned wI=problem.getKeyWidth(), n=problem.keys_size();
+
+    auto pool=requireUsableBits(problem, "make_partition_selector");
+    wS=std::min(wS, (unsigned)pool.size());
+
+    BitHash best;
+    unsigned bestDist=UINT_MAX;
+    unsigned nAddr=1u<<wS;
+    std::vector<unsigned> counts(nAddr);
+    // reach[a][s] : some subset of the first a addresses holds exactly s keys
+    std::vector<std::vector<char> > reach(nAddr+1, std::vector<char>(n+1));
+    for(unsigned c=0; c<std::max(1u,selectorCandidates) && bestDist>0; c++){
+        // Not makeBitHash, which would give one table every input
+        std::set<unsigned> taps;
+        while(taps.size()<wS){
+            taps.insert(pool[rng()%pool.size()]);
+        }
+        BitHash cand;
+        cand.wI=wI;
+        cand.wO=1;
+        cand.tables.resize(1);
+        cand.tables[0].selectors.assign(taps.begin(), taps.end());
+        cand.tables[0].lut.resize(nAddr);
+
+        std::fill(counts.begin(), counts.end(), 0);
+        for(const auto &kv : problem){
+            counts[cand.tables[0].address(*kv.first.variants_begin())]++;
+        }
+
+        reach[0].assign(n+1, 0);
+        reach[0][0]=1;
+        for(unsigned a=0; a<nAddr; a++){
+            reach[a+1]=reach[a];
+            for(unsigned s=counts[a]; s<=n; s++){
+                reach[a+1][s] |= reach[a][s-counts[a]];
+            }
+        }
+
+        unsigned sum=UINT_MAX, dist=UINT_MAX;
+        for(unsigned s=0; s<=n; s++){
+            if(!reach[nAddr][s] || s>caps[1] || n-s>caps[0])
+                continue;
+            unsigned d = s>target ? s-target : target-s;
+            if(d<dist){
+                dist=d;
+                sum=s;
+            }
+        }
+        if(dist>=bestDist)
+            continue;
+
+        // Walk back down to find which addresses make up sum
+        for(int a=nAddr-1; a>=0; a--){
+            if(reach[a][sum]){
+                cand.tables[0].lut[a]=0;
+            }else{
+                cand.tables[0].lut[a]=1;
+                sum-=counts[a];
+            }
+        }
+        best=cand;
+        bestDist=dist;
+    }
+    return std::make_pair(best, bestDist);
+}
+
+/* Build a partitioned hash (see partitioned_hash.hpp). First a selector is
+ * found which splits the keys in proportion to the range each half has, then
+ * for each attempt one shuffle with ctxt.wA-1 taps per output is shared by
+ * both halves, which are converted to CNF and solved at the same time, one
+ * of them on a second thread. Shuffles which stash_lower_bound shows can't
+ * work for either half are skipped, as in solve_cnf. Both halves have to be
+ * perfect, so a stash in the problem is not used. Gives up after
+ * ctxt.maxTries attempts or ctxt.maxTime.
+ */
+std::pair<PartitionedHash,bool> solve_partitioned(
+        solve_context &ctxt,
+        const key_value_set &problem,
+        unsigned selectorCandidates=64
+){
+    auto &urng=ctxt.urng;
+
+    PartitionedHash res;
+    res.wI=problem.getKeyWidth();
+    res.wO=ctxt.wO;
+
+    if(ctxt.wO<2)
+        throw std::runtime_error("solve_partitioned : need wo >= 2.");
+    if(ctxt.wA<2)
+        throw std::runtime_error("solve_partitioned : need wa >= 2, as the selector takes one lut input.");
+
+    // Range of each half, in keys
+    unsigned half=1u<<(ctxt.wO-1), maxHash=problem.getMaxHash();
+    unsigned ranges[2]={half, half};
+    if(maxHash>0){
+        ranges[0]=std::min(maxHash, half);
+        ranges[1]=maxHash>half ? maxHash-half : 0;
+    }
+    unsigned caps[2]={ranges[0]*ctxt.groupSize, ranges[1]*ctxt.groupSize};
+    if(caps[0]+caps[1] < problem.keys_size())
+        throw std::runtime_error("solve_partitioned : output range cannot hold the keys without a stash.");
+
+    unsigned target=(unsigned)round(problem.keys_size()*double(caps[1])/(caps[0]+caps[1]));
+    unsigned dist;
+    std::tie(res.selector, dist)=make_partition_selector(urng, problem, ctxt.wA, target, caps, selectorCandidates);
+    if(dist==UINT_MAX){
+        ctxt.logMsg(1, "No selector out of %u splits the keys within the output range.\n", selectorCandidates);
+        return std::make_pair(res, false);
+    }
+
+    std::map<bit_vector,bit_vector> parts[2];
+    for(const auto &kv : problem){
+        parts[res.selector(*kv.first.variants_begin())].insert(kv);
+    }
+    key_value_set halves[2];
+    for(unsigned h=0; h<2; h++){
+        halves[h]=key_value_set(parts[h]);
+        if(ranges[h]<half && !parts[h].empty()){
+            halves[h].setMaxHash(ranges[h]);
+        }
+    }
+    ctxt.logMsg(1, "Selector splits keys into %u and %u (target %u).\n", (unsigned)parts[0].size(), (unsigned)parts[1].size(), target);
+    ctxt.logCsv("PartitionSizes0", parts[0].size());
+    ctxt.logCsv("PartitionSizes1", parts[1].size());
+
+    // As in solve_hybrid, a shuffle only gets a limited number of conflicts,
+    // which doubles every attempt, so one hard shuffle can't take all the time
+    int64_t confBudget=100000;
+
+    auto solveHalf=[&](const BitHash &shuffle, unsigned h, BitHash &out) -> bool
+    {
+        // With maxHash at most half the range, half 1 has no keys. Its cnf
+        // would have no variables, and an empty solution looks like unsat.
+        if(halves[h].keys_size()==0){
+            out=shuffle;
+            for(auto &t : out.tables){
+                std::fill(t.lut.begin(), t.lut.end(), 0);
+            }
+            return true;
+        }
+        cnf_problem prob;
+        to_cnf(shuffle, halves[h].keys(), prob, halves[h].getMaxHash(), ctxt.groupSize);
+        auto sol=minisat_solve(prob, 0, confBudget);
+        if(sol.empty())
+            return false;
+        out=substitute(shuffle, prob, sol);
+        return true;
+    };
+
+    unsigned rejected=0;
+    for(ctxt.tries=1; ctxt.tries<ctxt.maxTries; ctxt.tries++){
+        if(cpuTime() > ctxt.maxTime)
+            break;
+
+        auto shuffle=makeBitHash(urng, ctxt.wO-1, res.wI, ctxt.wA-1);
+        if(shuffle.stash_lower_bound(halves[0], ctxt.groupSize)>0 || shuffle.stash_lower_bound(halves[1], ctxt.groupSize)>0){
+            rejected++;
+            continue;
+        }
+
+        // Minisat solvers are independent, so one half can go on another thread
+        bool ok[2];
+        std::thread other([&](){ ok[1]=solveHalf(shuffle, 1, res.halves[1]); });
+        ok[0]=solveHalf(shuffle, 0, res.halves[0]);
+        other.join();
+
+        ctxt.logMsg(2, "  Attempt %d : half 0 %s, half 1 %s\n", ctxt.tries, ok[0]?"solved":"failed", ok[1]?"solved":"failed");
+        if(ok[0] && ok[1]){
+            ctxt.logCsv("PrefilterRejected", rejected);
+            if(!res.is_solution(problem, ctxt.groupSize))
+                throw std::runtime_error("solve_partitioned : failed post substitution check.");
+            return std::make_pair(res, true);
+        }
+        confBudget*=2;
+    }
+
+    ctxt.logCsv("PrefilterRejected", rejected);
+    return std::make_pair(res, false);
+}
+
+#endif //FPGA_PERFECT_HASH_SOLVER_PARTITIONED_HPP
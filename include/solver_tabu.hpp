@@ -0,0 +1,159 @@
+#ifndef FPGA_PERFECT_HASH_SOLVER_TABU_HPP
+#define FPGA_PERFECT_HASH_SOLVER_TABU_HPP
+
+#include "bit_hash.hpp"
+#include "bit_hash_anneal.hpp"
+#include "bit_hash_history.hpp"
+
+#include "key_value_set.hpp"
+#include "weighted_shuffle.hpp"
+
+#include "solve_context.hpp"
+
+/* Tabu search (originally naboo_fpga_hash). Every step takes the best single
+ * bit flip whose destination has not been visited within the last tabuTenure
+ * steps, with visited points remembered by signature in a blocked counting
+ * filter.
+ *
+ * If every move is tabu we flip a few random bits (recording each point as
+ * visited), rather than giving up.
+ */
+std::pair<BitHash,bool> solver_tabu(
+        solve_context &ctxt,
+        const key_value_set &problem
+){
+    int &verbose=ctxt.verbose;
+    auto &urng=ctxt.urng;
+    int wO=ctxt.wO;
+    int wI=ctxt.wI;
+    int wA=ctxt.wA;
+    int groupSize=ctxt.groupSize;
+    int &tries=ctxt.tries;
+
+    std::uniform_real_distribution<> udist;
+
+    std::vector<BitHash> solBest(1, makeBitHashConcrete(urng, wO, wI, wA));
+    double eBest=evalSolution(solBest[0], problem, groupSize);
+
+    int triesAtLevel = 10000;
+
+    BitHash solCurr=solBest[0];
+    EntryToKey manipCurr(solCurr, problem);
+
+    typedef bit_signature_table<0> sig0_t;
+    typedef bit_signature_table<1> sig1_t;
+    typedef bit_signature_table<2> sig2_t;
+    typedef bit_sig_multi<sig0_t,bit_sig_multi<sig1_t,sig2_t> > sig_t;
+
+    // Keep the filter lightly loaded: 3 probes per entry in 64 counters per block
+    unsigned log2Blocks=0;
+    while( (64u<<log2Blocks) < 32u*ctxt.tabuTenure && log2Blocks<24){
+        log2Blocks++;
+    }
+    bit_sig_blocked_set<sig_t> tabuSet(log2Blocks);
+    bit_sig_tabu_ring<sig_t> tabuRing(tabuSet, ctxt.tabuTenure);
+
+    unsigned escapeFlips=std::max(2u, manipCurr.bitCount()/100);
+    int escapes=0;
+
+    std::vector<int> flipBestLocal;
+
+    while (eBest!=0 && tries < ctxt.maxTries) {
+        double ePrev=manipCurr.eval(groupSize);
+
+        sig_t sig=toSignature<sig_t>(manipCurr);
+
+        double eBestLocal=DBL_MAX;
+        flipBestLocal.clear();
+
+        for(unsigned i=0;i<manipCurr.bitCount();i++){
+            if(!tabuSet.contains_with_flip(sig,i)){
+                manipCurr.flipBit(i);
+
+                double eCurr=manipCurr.eval(groupSize);
+                if(eCurr<eBestLocal){
+                    flipBestLocal.clear();
+                }
+                if(eCurr<=eBestLocal){
+                    eBestLocal=eCurr;
+                    flipBestLocal.push_back(i);
+                }
+
+                manipCurr.flipBit(i);
+            }
+        }
+
+        if(flipBestLocal.size()==0){
+            // Everything around us is tabu, so take a few random steps away
+            escapes++;
+            if(verbose>1){
+                std::cerr<<"    Try: "<<tries<<", all moves tabu, escaping with "<<escapeFlips<<" random flips.\n";
+            }
+            for(unsigned i=0; i<escapeFlips; i++){
+                int flip=urng()%manipCurr.bitCount();
+                manipCurr.flipBit(flip);
+                sig.flip(flip);
+                tabuRing.add(sig);
+            }
+        }else{
+            int flip=flipBestLocal[urng()%flipBestLocal.size()];
+            manipCurr.flipBit(flip);
+            sig.flip(flip);
+            tabuRing.add(sig);
+        }
+
+        double eCurr=manipCurr.eval(groupSize);
+
+        if(verbose>2){
+            std::cerr<<"    Try: "<<tries<<", e = "<<eCurr<<"\n";
+        }
+
+        if(eCurr <= eBest) {
+            if(eCurr < eBest) {
+                if (verbose > 1) {
+                    std::cerr << "    Try: " << tries << ", New eBest = " << eCurr << "\n";
+                }
+                solBest.clear();
+                solBest.push_back(solCurr);
+            }else{
+                bool hit=false;
+                for(const auto &x : solBest){
+                    if(x==solCurr){
+                        hit=true;
+                        break;
+                    }
+                }
+                if(!hit) {
+                    if(solBest.size()>0){
+                        solBest.erase(solBest.begin());
+                    }
+                    solBest.push_back(solCurr);
+                }
+            }
+            eBest = eCurr;
+        }
+
+        tries++;
+
+        if(udist(urng)<0.001){
+            solCurr=solBest[urng()%solBest.size()];
+            manipCurr.sync();
+        }
+
+        if(0==(tries%triesAtLevel)){
+            if (verbose > 1) {
+                std::cerr << "    Try: " << tries << ", eBest = " << eBest << ", nBest = "<<solBest.size()<<", ePrev = " << ePrev <<", tabu=2^"<<log2(tabuRing.size())<<", escapes = "<<escapes<<"\n";
+            }
+
+            // cpuTime() is really expensive in OS X
+            if(cpuTime() > ctxt.maxTime)
+                break;
+        }
+    }
+
+    ctxt.logCsv("TabuEscapes", escapes);
+
+    return std::make_pair(solBest.back(), eBest==0);
+};
+
+#endif //FPGA_PERFECT_HASH_SOLVER_TABU_HPP
@@ -0,0 +1,205 @@
+#ifndef FPGA_PERFECT_HASH_SOLVER_TWO_LEVEL_HPP
+#define FPGA_PERFECT_HASH_SOLVER_TWO_LEVEL_HPP
+
+#include "bit_hash.hpp"
+#include "two_level_hash.hpp"
+#include "distinguishing_bits.hpp"
+
+#include "key_value_set.hpp"
+
+#include "solve_context.hpp"
+#include "solver_walk.hpp"
+
+#include <atomic>
+#include <cfloat>
+#include <thread>
+
+//! The output range bucket b needs: a slot per key, then slack for the load factor
+unsigned two_level_bucket_range(unsigned nKeys, double bucketLoad)
+{
+    if(nKeys<=1)
+        return nKeys;
+    return std::max(nKeys, (unsigned)ceil(nKeys/bucketLoad));
+}
+
+/* Choose the first level from splitCandidates random hashes, keeping the one
+ * with the smallest largest bucket, as the largest buckets are the slowest to
+ * solve and need the most slack. Only findUsableBits are tapped, so all
+ * the variants of a ternary key land in the same bucket.
+ */
+template<class TRng>
+BitHash make_two_level_split(TRng &rng, const key_value_set &problem, unsigned wB, unsigned wA, unsigned splitCandidates)
+{
+    unsigned wI=problem.getKeyWidth();
+
+    auto pool=requireUsableBits(problem, "make_two_level_split");
+
+    BitHash best;
+    unsigned bestMax=UINT_MAX;
+    std::vector<unsigned> counts(1u<<wB);
+    for(unsigned c=0; c<std::max(1u,splitCandidates); c++){
+        BitHash cand=makeBitHashConcrete(rng, wB, pool.size(), std::min(wA, (unsigned)pool.size()));
+        cand=unprojectBitHash(cand, pool, wI);
+
+        std::fill(counts.begin(), counts.end(), 0);
+        for(const auto &kv : problem){
+            counts[cand(*kv.first.variants_begin())]++;
+        }
+        unsigned m=*std::max_element(counts.begin(), counts.end());
+        if(m<bestMax){
+            bestMax=m;
+            best=cand;
+        }
+    }
+    return best;
+}
+
+/* Build a two level hash with 2^wB buckets. Each bucket is reduced to the
+ * few inputs which tell its keys apart (see findDistinguishingBits), then
+ * solved by solver_walk to a range of two_level_bucket_range() outputs.
+ * The buckets are independent, so ctxt.threads workers take them in turn,
+ * each with its own solve_context. A bucket which walk can't solve within
+ * bucketTries is retried with a new seed, and after that one more output,
+ * so that a single awkward bucket costs a slot rather than the whole solve.
+ *
+ * Work is linear in the number of keys, as long as the number of keys per
+ * bucket stays constant. Only perfect hashes (groupSize==1, no stash or
+ * maxHash) are built. Fails if ctxt.maxTime runs out, where the time left
+ * when it starts is counted in real time, as the workers share it.
+ */
+std::pair<TwoLevelHash,bool> solve_two_level(
+        solve_context &ctxt,
+        const key_value_set &problem,
+        unsigned wB,
+        double bucketLoad=0.8,
+        unsigned splitCandidates=16,
+        int bucketTries=20000
+){
+    TwoLevelHash res;
+    res.wI=problem.getKeyWidth();
+
+    res.split=make_two_level_split(ctxt.urng, problem, wB, ctxt.wA, splitCandidates);
+
+    unsigned nBuckets=1u<<wB;
+    std::vector<std::map<bit_vector,bit_vector> > parts(nBuckets);
+    for(const auto &kv : problem){
+        parts[res.split(*kv.first.variants_begin())].insert(kv);
+    }
+
+    unsigned maxBucket=0;
+    for(const auto &p : parts){
+        maxBucket=std::max(maxBucket, (unsigned)p.size());
+    }
+    ctxt.logMsg(1, "Split %u keys into %u buckets, largest has %u keys.\n", problem.keys_size(), nBuckets, maxBucket);
+    ctxt.logCsv("TwoLevelBuckets", nBuckets);
+    ctxt.logCsv("TwoLevelMaxBucket", maxBucket);
+
+    res.buckets.resize(nBuckets);
+    std::vector<unsigned> ranges(nBuckets);
+    std::vector<unsigned> seeds(nBuckets);
+    for(auto &s : seeds){
+        s=ctxt.urng();
+    }
+
+    // cpuTime() would add up the time of every worker
+    double deadline=wallTime()+(ctxt.maxTime-cpuTime());
+
+    std::atomic<unsigned> next(0), retries(0);
+    std::atomic<bool> failed(false);
+
+    auto worker=[&]()
+    {
+        while(!failed){
+            unsigned b=next++;
+            if(b>=nBuckets)
+                break;
+
+            const auto &part=parts[b];
+            ranges[b]=two_level_bucket_range(part.size(), bucketLoad);
+
+            if(part.size()<=1){
+                // Everything in this bucket gets the first output
+                res.buckets[b].wI=res.wI;
+                res.buckets[b].wO=0;
+                continue;
+            }
+
+            key_value_set full(part);
+            auto bits=findDistinguishingBits(full);
+            auto reduced=projectKeys(full, bits);
+
+            solve_context local;
+            local.verbose=0;
+            local.urng.seed(seeds[b]);
+            // solver_walk checks cpuTime(), so it is only limited by bucketTries,
+            // and the deadline is checked between attempts
+            local.maxTime=DBL_MAX;
+            local.maxTries=bucketTries;
+            local.wI=bits.size();
+            local.wA=std::min(ctxt.wA, (int)bits.size());
+            local.walkNoise=ctxt.walkNoise;
+            local.tapMoveProb=ctxt.tapMoveProb;
+
+            // More outputs than distinct reduced keys can't help
+            unsigned maxRange=1u<<bits.size();
+            ranges[b]=std::min(ranges[b], maxRange);
+
+            for(unsigned attempt=0; ; attempt++){
+                if(wallTime() > deadline){
+                    failed=true;
+                    break;
+                }
+                if(attempt>0 && (attempt%2)==0){
+                    ranges[b]=std::min(ranges[b]+1, maxRange);
+                }
+
+                unsigned wO=0;
+                while((1u<<wO) < ranges[b]){
+                    wO++;
+                }
+                local.wO=wO;
+                local.tries=0;
+                reduced.setMaxHash(ranges[b]);
+
+                BitHash sol;
+                bool success;
+                std::tie(sol, success)=solver_walk(local, reduced);
+                if(success){
+                    res.buckets[b]=unprojectBitHash(sol, bits, res.wI);
+                    break;
+                }
+                retries++;
+            }
+        }
+    };
+
+    // Every worker needs its own solve_context, and this thread already has one
+    std::vector<std::thread> threads;
+    for(int i=0; i<std::max(1, ctxt.threads); i++){
+        threads.emplace_back(worker);
+    }
+    for(auto &t : threads){
+        t.join();
+    }
+
+    ctxt.logCsv("TwoLevelRetries", (unsigned)retries);
+    if(failed)
+        return std::make_pair(res, false);
+
+    res.offsets.assign(1, 0);
+    unsigned top=1;
+    for(unsigned b=0; b<nBuckets; b++){
+        top=std::max(top, res.offsets.back() + (1u<<res.buckets[b].wO));
+        res.offsets.push_back(res.offsets.back()+ranges[b]);
+    }
+    res.wO=0;
+    while((1u<<res.wO) < top){
+        res.wO++;
+    }
+    ctxt.logMsg(1, "Two level hash uses %u outputs of %u.\n", res.offsets.back(), 1u<<res.wO);
+    ctxt.logCsv("TwoLevelRange", res.offsets.back());
+
+    return std::make_pair(res, res.is_solution(problem));
+}
+
+#endif //FPGA_PERFECT_HASH_SOLVER_TWO_LEVEL_HPP
@@ -0,0 +1,279 @@
+#ifndef FPGA_PERFECT_HASH_SOLVER_WALK_HPP
+#define FPGA_PERFECT_HASH_SOLVER_WALK_HPP
+
+#include "bit_hash.hpp"
+#include "bit_hash_anneal.hpp"
+
+#include "key_value_set.hpp"
+#include "weighted_shuffle.hpp"
+
+#include "solve_context.hpp"
+
+#include <memory>
+#include <tuple>
+
+/* This is a WalkSAT style search, which only looks at the actual defects.
+ * Each step picks a random over-full hash, then two keys within it. The
+ * only lut bits that can pull those two keys apart are the ones where they
+ * read different addresses of the same table, so there are at most 2*wO
+ * candidate flips. With probability walkNoise we flip one of them at random,
+ * otherwise we flip the one that gives the best overall score.
+ *
+ * Tables where the two keys read the same address can never separate them
+ * by changing lut contents. So with probability tapMoveProb (or always, if
+ * they share an address in every table) we instead move one selector of such
+ * a table onto an input where the keys differ, and the shuffle is repaired
+ * in place rather than by restarting.
+ *
+ * Keys with hashes at or above problem.getMaxHash(), and variants of ternary
+ * keys which hash differently to their key, are also picked as defects in
+ * proportion to their number. They are repaired by flipping one of the bits
+ * they read.
+ */
+std::pair<BitHash,bool> solver_walk(
+        solve_context &ctxt,
+        const key_value_set &problem
+){
+    int &verbose=ctxt.verbose;
+    auto &urng=ctxt.urng;
+    int wO=ctxt.wO;
+    int wI=ctxt.wI;
+    int wA=ctxt.wA;
+    int groupSize=ctxt.groupSize;
+    int &tries=ctxt.tries;
+
+    std::uniform_real_distribution<> udist;
+
+    BitHash solCurr=makeBitHashConcrete(urng, wO, wI, wA);
+    std::unique_ptr<EntryToKey> manipCurr(new EntryToKey(solCurr, problem));
+
+    double eCurr=manipCurr->eval(groupSize);
+    double eBest=eCurr;
+    BitHash solBest=solCurr;
+
+    // Best point seen with the current shuffle, which is where we restart from
+    double eLocal=eCurr;
+    BitHash solLocal=solCurr;
+
+    unsigned maxStall=8*manipCurr->bitCount();
+    unsigned stall=0;
+
+    unsigned triesAtLevel=10000;
+
+    std::vector<unsigned> candidates;
+    std::vector<unsigned> flipBest;
+    std::vector<unsigned> sameTables;
+    std::vector<std::tuple<unsigned,unsigned,unsigned> > tapOptions;
+
+    // Choose one of the candidate flips, either at random or greedily
+    auto pickFlip=[&]() -> unsigned
+    {
+        if(udist(urng) < ctxt.walkNoise){
+            return candidates[urng()%candidates.size()];
+        }
+
+        double eFlipBest=DBL_MAX;
+        flipBest.clear();
+        for(unsigned c : candidates){
+            manipCurr->flipBit(c);
+            double e=manipCurr->eval(groupSize);
+            if(e<eFlipBest){
+                eFlipBest=e;
+                flipBest.clear();
+            }
+            if(e==eFlipBest){
+                flipBest.push_back(c);
+            }
+            manipCurr->flipBit(c);
+        }
+        return flipBest[urng()%flipBest.size()];
+    };
+
+    // Update the local and global bests after a move, and restart if stuck
+    auto track=[&]()
+    {
+        if(verbose>2){
+            std::cerr<<"    Try: "<<tries<<", e = "<<eCurr<<"\n";
+        }
+
+        if(eCurr < eLocal){
+            eLocal=eCurr;
+            solLocal=solCurr;
+            stall=0;
+
+            if(eCurr < eBest){
+                eBest=eCurr;
+                solBest=solCurr;
+                if (verbose > 1) {
+                    std::cerr << "    Try: " << tries << ", New eBest = " << eBest << "\n";
+                }
+            }
+        }else if(++stall > maxStall){
+            // Go back to the best point for this shuffle, and kick it a bit
+            solCurr=perturbHash(urng, solLocal, 0.02);
+            manipCurr->sync();
+            eCurr=manipCurr->eval(groupSize);
+            stall=0;
+
+            // The kick may happen to land on something better
+            if(eCurr < eBest){
+                eBest=eCurr;
+                solBest=solCurr;
+            }
+        }
+    };
+
+    while (eBest!=0 && tries < ctxt.maxTries) {
+        tries++;
+
+        if(0==(tries%triesAtLevel)){
+            if (verbose > 1) {
+                std::cerr << "    Try: " << tries << ", eBest = " << eBest << ", eLocal = " << eLocal << ", eCurr = "<<eCurr<<"\n";
+            }
+
+            // cpuTime() is really expensive in OS X
+            if(cpuTime() > ctxt.maxTime)
+                break;
+        }
+
+        // Find an over-full hash, starting from a random point
+        const auto &shared=manipCurr->getSharedHashes();
+        bool overFull=false;
+        unsigned h=0;
+        if(!shared.empty()){
+            unsigned offset=urng()%shared.size();
+            for(unsigned i=0; i<shared.size() && !overFull; i++){
+                h=shared[(offset+i)%shared.size()];
+                overFull=manipCurr->getBucket(h).size() > (unsigned)groupSize;
+            }
+        }
+
+        // Keys above maxHash are defects too, as are variants of ternary keys
+        // which hash differently to their key. Each kind is picked in
+        // proportion to how many there are.
+        const auto &outOfRange=manipCurr->getOutOfRangeKeys();
+        const auto &disagree=manipCurr->getDisagreeingVariants();
+        unsigned nDefects=(overFull ? shared.size() : 0) + outOfRange.size() + disagree.size();
+        if(nDefects==0){
+            // Only if a kick or a new shuffle landed on a solution
+            if(eCurr < eBest){
+                eBest=eCurr;
+                solBest=solCurr;
+            }
+            break;
+        }
+        unsigned pick=urng()%nDefects;
+
+        if(pick < outOfRange.size()){
+            // Moving an out of range key means flipping one of the bits it reads
+            unsigned ki=outOfRange[urng()%outOfRange.size()];
+            candidates.clear();
+            for(int ti=0; ti<wO; ti++){
+                candidates.push_back(manipCurr->getKeyBit(ki, ti));
+            }
+            manipCurr->flipBit(pickFlip());
+            eCurr=manipCurr->eval(groupSize);
+            track();
+            continue;
+        }else if(pick < outOfRange.size()+disagree.size()){
+            // The variant and its key differ in some output bits, and in
+            // those tables they must read different lut entries
+            unsigned vi=disagree[urng()%disagree.size()];
+            unsigned ki=manipCurr->getVariantKey(vi);
+            unsigned diff=manipCurr->getVariantHash(vi) ^ manipCurr->keys[ki];
+            candidates.clear();
+            for(int ti=0; ti<wO; ti++){
+                if((diff>>ti)&1){
+                    candidates.push_back(manipCurr->getVariantBit(vi, ti));
+                    candidates.push_back(manipCurr->getKeyBit(ki, ti));
+                }
+            }
+            manipCurr->flipBit(pickFlip());
+            eCurr=manipCurr->eval(groupSize);
+            track();
+            continue;
+        }
+        assert(overFull);
+
+        const auto &bucket=manipCurr->getBucket(h);
+        unsigned ia=urng()%bucket.size();
+        unsigned ib=urng()%(bucket.size()-1);
+        if(ib>=ia)
+            ib++;
+        unsigned ka=bucket[ia], kb=bucket[ib];
+
+        candidates.clear();
+        sameTables.clear();
+        for(int ti=0; ti<wO; ti++){
+            unsigned ba=manipCurr->getKeyBit(ka, ti), bb=manipCurr->getKeyBit(kb, ti);
+            if(ba!=bb){
+                candidates.push_back(ba);
+                candidates.push_back(bb);
+            }else{
+                sameTables.push_back(ti);
+            }
+        }
+
+        bool tapped=false;
+        if(!sameTables.empty() && (candidates.empty() || udist(urng) < ctxt.tapMoveProb)){
+            // Each option is (table, selector, new input)
+            tapOptions.clear();
+            for(unsigned ti : sameTables){
+                unsigned si, ib;
+                if(chooseTapMove(urng, *manipCurr, ti, ka, kb, si, ib))
+                    tapOptions.push_back(std::make_tuple(ti, si, ib));
+            }
+
+            if(!tapOptions.empty()){
+                unsigned choice=0;
+                if(udist(urng) < ctxt.walkNoise){
+                    choice=urng()%tapOptions.size();
+                }else{
+                    double eTapBest=DBL_MAX;
+                    for(unsigned i=0; i<tapOptions.size(); i++){
+                        unsigned ti, si, ib;
+                        std::tie(ti, si, ib)=tapOptions[i];
+                        unsigned prev=solCurr.tables[ti].selectors[si];
+                        manipCurr->swapSelector(ti, si, ib);
+                        double e=manipCurr->eval(groupSize);
+                        manipCurr->swapSelector(ti, si, prev);
+                        if(e<eTapBest){
+                            eTapBest=e;
+                            choice=i;
+                        }
+                    }
+                }
+
+                unsigned ti, si, ib;
+                std::tie(ti, si, ib)=tapOptions[choice];
+                manipCurr->swapSelector(ti, si, ib);
+                tapped=true;
+                if(verbose>2){
+                    std::cerr<<"    Try: "<<tries<<", table "<<ti<<" now taps input "<<ib<<"\n";
+                }
+            }else if(candidates.empty()){
+                if(verbose>1){
+                    std::cerr<<"    Try: "<<tries<<", found inseparable keys, moving to new shuffle.\n";
+                }
+                solCurr=makeBitHashConcrete(urng, wO, wI, wA);
+                manipCurr.reset(new EntryToKey(solCurr, problem));
+                eCurr=manipCurr->eval(groupSize);
+                eLocal=eCurr;
+                solLocal=solCurr;
+                stall=0;
+                continue;
+            }
+        }
+
+        if(!tapped){
+            manipCurr->flipBit(pickFlip());
+        }
+        eCurr=manipCurr->eval(groupSize);
+
+        track();
+    }
+
+    return std::make_pair(solBest, eBest==0);
+};
+
+#endif //FPGA_PERFECT_HASH_SOLVER_WALK_HPP
@@ -0,0 +1,83 @@
+#ifndef FPGA_PERFECT_HASH_TWO_LEVEL_HASH_HPP
+#define FPGA_PERFECT_HASH_TWO_LEVEL_HASH_HPP
+
+#include "bit_hash.hpp"
+#include "key_value_set.hpp"
+
+/* A hash in two levels, for key sets too big for one BitHash. The first
+ * level (split) is a BitHash with concrete luts that chooses one of
+ * 2^split.wO buckets, and each bucket has its own small BitHash which is
+ * perfect over the keys in that bucket. Bucket b owns the outputs
+ * [offsets[b],offsets[b+1]), so the output range is only as big as the
+ * buckets need, rather than a power of two per bucket.
+ *
+ * Keys outside the set can get a bucket hash beyond the bucket's range, so
+ * wO is wide enough for the largest such hash, not just offsets.back().
+ */
+struct TwoLevelHash
+{
+    unsigned wI;
+    unsigned wO;
+
+    BitHash split;
+    std::vector<BitHash> buckets;
+    std::vector<unsigned> offsets; // One more than there are buckets
+
+    unsigned operator()(unsigned x) const
+    {
+        unsigned b=split(x);
+        return offsets[b]+buckets[b](x);
+    }
+
+    unsigned operator()(const bit_vector &x) const
+    {
+        unsigned b=split(x);
+        return offsets[b]+buckets[b](x);
+    }
+
+    //! As BitHash::find_stash, which is only empty if the hash is perfect
+    std::vector<bit_vector> find_stash(const key_value_set &keys, unsigned groupSize=1) const
+    { return find_stash_of(*this, keys, groupSize); }
+
+    bool is_solution(const key_value_set &keys, unsigned groupSize=1) const
+    {
+        return find_stash(keys, groupSize).size() <= keys.getMaxStash();
+    }
+
+    void print(std::ostream &dst, std::string prefix="") const
+    {
+        dst<<prefix<<"TwoLevelHashBegin "<<wO<<" "<<wI<<" "<<buckets.size()<<"\n";
+        split.print(dst, prefix+"  ");
+        for(unsigned i=0;i<buckets.size();i++){
+            dst<<prefix<<"  bucket "<<i<<" "<<offsets[i]<<" "<<offsets[i+1]<<"\n";
+            buckets[i].print(dst, prefix+"    ");
+        }
+        dst<<prefix<<"TwoLevelHashEnd\n";
+    }
+};
+
+TwoLevelHash parse_two_level_hash(std::istream &src)
+{
+    TwoLevelHash res;
+    unsigned nBuckets;
+
+    expect_token(src, "TwoLevelHashBegin")>>res.wO>>res.wI>>nBuckets;
+    res.split=parse_bit_hash(src);
+    if(nBuckets!=(1u<<res.split.wO))
+        throw std::runtime_error("Persisted two level hash is corrupt.");
+
+    res.offsets.push_back(0);
+    for(unsigned i=0;i<nBuckets;i++){
+        unsigned idx, begin, end;
+        expect_token(src, "bucket")>>idx>>begin>>end;
+        if(idx!=i || begin!=res.offsets.back() || end<begin)
+            throw std::runtime_error("Persisted two level hash is corrupt.");
+        res.offsets.push_back(end);
+        res.buckets.push_back(parse_bit_hash(src));
+    }
+    expect_token(src, "TwoLevelHashEnd");
+
+    return res;
+}
+
+#endif //FPGA_PERFECT_HASH_TWO_LEVEL_HASH_HPP
@@ -0,0 +1,96 @@
+#ifndef FPGA_PERFECT_HASH_TWO_LEVEL_HASH_CPP_HPP
+#define FPGA_PERFECT_HASH_TWO_LEVEL_HASH_CPP_HPP
+
+#include "bit_hash_cpp.hpp"
+#include "two_level_hash.hpp"
+
+/* The first level is written as its own function by write_cpp_hash. There
+ * can be thousands of buckets, so rather than a function each, the bucket
+ * tables are flattened into arrays (each lut packed into a 64-bit word) and
+ * walked by one loop. write_cpp_hit and friends work on top of this as
+ * they do for a BitHash.
+ */
+void write_cpp_two_level_hash(const TwoLevelHash &th, std::string name, std::string indent, std::ostream &dst)
+{
+    unsigned nBuckets=th.buckets.size();
+
+    std::vector<unsigned> first(1, 0);
+    unsigned maxSel=1;
+    for(const auto &b : th.buckets){
+        first.push_back(first.back()+b.tables.size());
+        for(const auto &t : b.tables){
+            if(t.selectors.size()>6)
+                throw std::runtime_error("write_cpp_two_level_hash : bucket luts must have at most 64 entries.");
+            maxSel=std::max(maxSel, (unsigned)t.selectors.size());
+        }
+    }
+    unsigned nTables=std::max(1u, first.back());
+
+    write_cpp_hash(th.split, name+"_split", indent, dst);
+    dst<<"\n";
+
+    dst<<indent<<"unsigned "<<name<<"_hash(unsigned x){\n";
+    dst<<indent<<"  // Output range and first table of each bucket\n";
+    dst<<indent<<"  static const unsigned offsets["<<nBuckets<<"] = {";
+    for(unsigned i=0;i<nBuckets;i++){
+        dst<<(i==0?"":",")<<th.offsets[i];
+    }
+    dst<<"};\n";
+    dst<<indent<<"  static const unsigned first["<<(nBuckets+1)<<"] = {";
+    for(unsigned i=0;i<=nBuckets;i++){
+        dst<<(i==0?"":",")<<first[i];
+    }
+    dst<<"};\n";
+    dst<<indent<<"  // Taps and luts of every bucket table\n";
+    dst<<indent<<"  static const unsigned char nSel["<<nTables<<"] = {";
+    unsigned ti=0;
+    for(const auto &b : th.buckets){
+        for(const auto &t : b.tables){
+            dst<<(ti++==0?"":",")<<t.selectors.size();
+        }
+    }
+    if(ti==0)
+        dst<<"0";
+    dst<<"};\n";
+    dst<<indent<<"  static const unsigned char sel["<<nTables<<"]["<<maxSel<<"] = {\n";
+    ti=0;
+    for(const auto &b : th.buckets){
+        for(const auto &t : b.tables){
+            dst<<indent<<"    "<<(ti++==0?" ":",")<<"{";
+            for(unsigned j=0;j<t.selectors.size();j++){
+                dst<<(j==0?"":",")<<t.selectors[j];
+            }
+            dst<<"}\n";
+        }
+    }
+    if(ti==0)
+        dst<<indent<<"    {0}\n";
+    dst<<indent<<"  };\n";
+    dst<<indent<<"  static const unsigned long long lut["<<nTables<<"] = {\n";
+    ti=0;
+    for(const auto &b : th.buckets){
+        for(const auto &t : b.tables){
+            uint64_t bits=0;
+            for(unsigned j=0;j<t.lut.size();j++){
+                bits |= uint64_t(t.lut[j]==1)<<j;
+            }
+            dst<<indent<<"    "<<(ti++==0?" ":",")<<bits<<"ull\n";
+        }
+    }
+    if(ti==0)
+        dst<<indent<<"    0\n";
+    dst<<indent<<"  };\n";
+    dst<<indent<<"  unsigned b = "<<name<<"_split_hash(x);\n";
+    dst<<indent<<"  unsigned result = 0;\n";
+    dst<<indent<<"  for(unsigned t=first[b]; t<first[b+1]; t++){\n";
+    dst<<indent<<"    unsigned addr = 0;\n";
+    dst<<indent<<"    for(unsigned j=0; j<nSel[t]; j++){\n";
+    dst<<indent<<"      addr |= ((x>>sel[t][j])&1)<<j;\n";
+    dst<<indent<<"    }\n";
+    dst<<indent<<"    result |= unsigned((lut[t]>>addr)&1)<<(t-first[b]);\n";
+    dst<<indent<<"  }\n";
+    dst<<indent<<"  return offsets[b]+result;\n";
+    dst<<indent<<"}\n";
+}
+
+#endif //FPGA_PERFECT_HASH_TWO_LEVEL_HASH_CPP_HPP
@@ -0,0 +1,89 @@
+#ifndef FPGA_PERFECT_HASH_TWO_LEVEL_HASH_VHDL_HPP
+#define FPGA_PERFECT_HASH_TWO_LEVEL_HASH_VHDL_HPP
+
+#include "bit_hash_vhdl.hpp"
+#include "two_level_hash.hpp"
+
+/* The first level is its own entity (name_split_hash, from write_vhdl_hash),
+ * and the bucket it picks drives a case over the bucket hashes, each of
+ * which is added to the start of the bucket's range. The result has the
+ * same ports as write_vhdl_hash, so write_vhdl_hit and friends sit on top
+ * of it unchanged.
+ */
+void write_vhdl_two_level_hash(const TwoLevelHash &th, std::string name, std::string indent, std::ostream &dst)
+{
+    unsigned wI=th.wI, wO=th.wO, wB=th.split.wO;
+
+    write_vhdl_hash(th.split, name+"_split", indent, dst);
+    dst<<"\n";
+
+    dst<<indent<<"library ieee;\n";
+    dst<<indent<<"use ieee.std_logic_1164.all;\n";
+    dst<<indent<<"use ieee.numeric_std.all;\n\n";
+
+    dst<<indent<<"entity "<<name<<"_hash is \n";
+    dst<<indent<<"  port (\n";
+    dst<<indent<<"    key : in std_logic_vector("<<(wI-1)<<" downto 0);\n";
+    dst<<indent<<"    hash : out std_logic_vector("<<(wO-1)<<" downto 0)\n";
+    dst<<indent<<"  );\n";
+    dst<<indent<<"end entity "<<name<<"_hash;\n";
+    dst<<"\n";
+
+    dst<<indent<<"architecture RTL of "<<name<<"_hash is\n";
+    dst<<indent<<"  component "<<name<<"_split_hash \n";
+    dst<<indent<<"    port (\n";
+    dst<<indent<<"      key : in std_logic_vector("<<(wI-1)<<" downto 0);\n";
+    dst<<indent<<"      hash : out std_logic_vector("<<(wB-1)<<" downto 0)\n";
+    dst<<indent<<"    );\n";
+    dst<<indent<<"  end component;\n";
+    dst<<indent<<"  signal bucket : std_logic_vector("<<(wB-1)<<" downto 0);\n";
+    dst<<indent<<"begin\n";
+    dst<<indent<<"  theSplit : "<<name<<"_split_hash port map(key=>key,hash=>bucket);\n";
+    dst<<indent<<"\n";
+    dst<<indent<<"  process(key, bucket)\n";
+    dst<<indent<<"    -- ROMS of every bucket\n";
+    for(unsigned b=0;b<th.buckets.size();b++){
+        const auto &bh=th.buckets[b];
+        for(unsigned i=0;i<bh.tables.size();i++){
+            const auto &t=bh.tables[i];
+            dst<<indent<<"    constant lut_"<<b<<"_"<<i<<" : std_logic_vector("<<(t.lut.size()-1)<<" downto 0) := \"";
+            for(int j=t.lut.size()-1;j>=0;j--){
+                dst<<(t.lut[j]==1?'1':'0');
+            }
+            dst<<"\";\n";
+        }
+    }
+    dst<<indent<<"    variable local : unsigned("<<(wO-1)<<" downto 0);\n";
+    dst<<indent<<"    variable offset : natural;\n";
+    dst<<indent<<"  begin\n";
+    dst<<indent<<"    local := (others => '0');\n";
+    dst<<indent<<"    offset := 0;\n";
+    dst<<indent<<"    case to_integer(unsigned(bucket)) is\n";
+    for(unsigned b=0;b<th.buckets.size();b++){
+        const auto &bh=th.buckets[b];
+        dst<<indent<<"      when "<<b<<" =>\n";
+        dst<<indent<<"        offset := "<<th.offsets[b]<<";\n";
+        for(unsigned i=0;i<bh.tables.size();i++){
+            const auto &t=bh.tables[i];
+            dst<<indent<<"        local("<<i<<") := lut_"<<b<<"_"<<i<<"(to_integer(unsigned(std_logic_vector'(";
+            if(t.selectors.size()==1){
+                dst<<"0 => key("<<t.selectors[0]<<")";
+            }else{
+                for(int j=t.selectors.size()-1;j>=0;j--){
+                    dst<<"key("<<t.selectors[j]<<")";
+                    if(j!=0)
+                        dst<<" & ";
+                }
+            }
+            dst<<"))));\n";
+        }
+    }
+    dst<<indent<<"      when others =>\n";
+    dst<<indent<<"        null;\n";
+    dst<<indent<<"    end case;\n";
+    dst<<indent<<"    hash <= std_logic_vector(local + offset);\n";
+    dst<<indent<<"  end process;\n";
+    dst<<indent<<"end RTL;\n";
+}
+
+#endif //FPGA_PERFECT_HASH_TWO_LEVEL_HASH_VHDL_HPP
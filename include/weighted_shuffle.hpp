@@ -5,9 +5,11 @@
 #ifndef HLS_PARSER_WEIGHTED_SHUFFLE_HPP
 #define HLS_PARSER_WEIGHTED_SHUFFLE_HPP
 
+#include "bit_hash.hpp"
 #include "key_value_set.hpp"
 
 #include <algorithm>
+#include <cmath>
 
 std::vector<double> calculateBitWeights(const key_value_set &keys)
 {
@@ -125,4 +127,121 @@ BitHash makeWeightedBitHash(TRng &rng, const key_value_set &keys, unsigned wO, u
     return hash;
 }
 
+/* Estimate how many pairs of keys will collide if the shuffle is given
+ * random lut contents. A pair which reads different addresses in a table
+ * gets different bits from it with probability 1/2, so the expected number
+ * of colliding pairs is
+ *
+ *   sum_{pairs} 2^(shared-wO) = 2^-wO * sum_{subsets S} pairs(S)
+ *
+ * where shared is the number of tables in which the pair read the same
+ * address, and pairs(S) is the number of pairs which share an address in
+ * every table of S. We only take the subsets with up to two tables, so the
+ * score combines the address balance of each table (the singletons) with
+ * how well pairs of tables separate the keys (the pairs of tables), which
+ * is where overlapping taps show up. It is exact for wO<=2, and an
+ * underestimate otherwise. Ternary keys are represented by their first
+ * variant.
+ */
+double scoreShuffle(const key_value_set &keys, const std::vector<std::vector<unsigned> > &shuffle)
+{
+    unsigned wO=shuffle.size();
+    unsigned n=keys.keys_size();
+
+    std::vector<std::vector<unsigned> > addr(wO, std::vector<unsigned>(n));
+    unsigned ki=0;
+    for(const auto &kv : keys){
+        const auto &k=*kv.first.variants_begin();
+        for(unsigned ti=0; ti<wO; ti++){
+            unsigned a=0;
+            for(unsigned i=0; i<shuffle[ti].size(); i++){
+                a |= unsigned(k[shuffle[ti][i]]==1)<<i;
+            }
+            addr[ti][ki]=a;
+        }
+        ki++;
+    }
+
+    auto pairs=[](const std::vector<unsigned> &counts) -> double
+    {
+        double acc=0;
+        for(unsigned c : counts){
+            acc += c*(c-1.0)/2;
+        }
+        return acc;
+    };
+
+    double acc=n*(n-1.0)/2;
+    std::vector<unsigned> counts;
+    for(unsigned ti=0; ti<wO; ti++){
+        unsigned wt=shuffle[ti].size();
+        counts.assign(1u<<wt, 0);
+        for(unsigned a : addr[ti]){
+            counts[a]++;
+        }
+        acc += pairs(counts);
+
+        for(unsigned tj=ti+1; tj<wO; tj++){
+            unsigned wu=shuffle[tj].size();
+            counts.assign(1u<<(wt+wu), 0);
+            for(unsigned i=0; i<n; i++){
+                counts[(addr[ti][i]<<wu) | addr[tj][i]]++;
+            }
+            acc += pairs(counts);
+        }
+    }
+    return std::ldexp(acc, -(int)wO);
+}
+
+/* Draw nCandidates shuffles (weighted by calculateBitWeights, or uniformly)
+ * and return the one with the lowest scoreShuffle, breaking ties with the
+ * most different tables (evaluateShuffle). Candidates which
+ * stash_lower_bound shows need more than maxStash keys stashed are never
+ * chosen unless nothing else is available.
+ */
+template<class TRng>
+BitHash makeBestBitHash(TRng &rng, const key_value_set &keys, unsigned wO, unsigned wI, unsigned wA, bool weighted, unsigned nCandidates, unsigned groupSize=1, double *pScore=0)
+{
+    std::vector<double> weights;
+    if(weighted){
+        weights=calculateBitWeights(keys);
+    }
+
+    BitHash best;
+    double bestScore=0;
+    unsigned bestDifferent=0;
+    bool bestFeasible=false;
+    for(unsigned i=0; i<nCandidates; i++){
+        auto shuffle = weighted ? makeWeightedRandomShuffle(rng, wO, weights, wA) : makeRandomShuffle(rng, wO, wI, wA);
+
+        BitHash hash;
+        hash.wI=wI;
+        hash.wO=wO;
+        for(unsigned ti=0; ti<wO; ti++){
+            hash.tables.push_back(BitHash::table());
+            hash.tables.back().selectors=shuffle[ti];
+            hash.tables.back().lut=std::vector<int>(1<<(shuffle[ti].size()),-1);
+        }
+
+        bool feasible = hash.stash_lower_bound(keys, groupSize) <= keys.getMaxStash();
+        double score=scoreShuffle(keys, shuffle);
+        unsigned different=evaluateShuffle(shuffle);
+
+        bool better = best.tables.empty()
+                      || (feasible && !bestFeasible)
+                      || (feasible==bestFeasible && (score < bestScore || (score==bestScore && different > bestDifferent)));
+        if(better){
+            best=hash;
+            bestScore=score;
+            bestDifferent=different;
+            bestFeasible=feasible;
+        }
+    }
+
+    if(pScore){
+        *pScore=bestScore;
+    }
+    return best;
+}
+
 #endif //HLS_PARSER_WEIGHTED_SHUFFLE_HPP
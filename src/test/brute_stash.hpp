@@ -0,0 +1,37 @@
+#ifndef FPGA_PERFECT_HASH_BRUTE_STASH_HPP
+#define FPGA_PERFECT_HASH_BRUTE_STASH_HPP
+
+#include "key_value_set.hpp"
+
+#include <map>
+
+/* Number of keys which would have to be stashed, as an oracle for
+ * find_stash. Rather than walking the variants of each key, this scans
+ * every input, and a key owns the inputs that match it under its concrete
+ * mask. Only those are hashed, as luts may be undefined where no key reads
+ * them. A key must be stashed if its inputs hash differently, or land on or
+ * above maxHash, and otherwise it takes one of the groupSize entries of its
+ * hash.
+ */
+template<class THash>
+unsigned bruteStash(const THash &h, const key_value_set &keys, unsigned groupSize=1)
+{
+    std::map<unsigned,unsigned> counts;
+    unsigned res=0;
+    for(const auto &kv : keys){
+        unsigned tag=to_unsigned(*kv.first.variants_begin());
+        unsigned mask=to_unsigned(kv.first.get_concrete_mask(h.wI));
+
+        unsigned hv=h(tag);
+        bool ok = !(keys.getMaxHash()>0 && hv>=keys.getMaxHash());
+        for(unsigned x=0; ok && x<(1u<<h.wI); x++){
+            if((x&mask)==tag)
+                ok = h(x)==hv;
+        }
+        if(!ok || ++counts[hv]>groupSize)
+            res++;
+    }
+    return res;
+}
+
+#endif //FPGA_PERFECT_HASH_BRUTE_STASH_HPP
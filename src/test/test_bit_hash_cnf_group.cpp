@@ -0,0 +1,271 @@
+#include "bit_hash.hpp"
+#include "bit_hash_cnf.hpp"
+#include "distinguishing_bits.hpp"
+#include "solver_cnf.hpp"
+
+#include <random>
+#include <iostream>
+#include <set>
+
+std::mt19937 urng;
+
+// Check requireAtMostK against every assignment of a few inputs
+void testAtMostK(unsigned n, unsigned k)
+{
+    for(unsigned x=0; x<(1u<<n); x++){
+        Minisat::Solver s;
+        std::vector<Minisat::Lit> lits;
+        for(unsigned i=0; i<n; i++){
+            lits.push_back(Minisat::mkLit(s.newVar()));
+        }
+        requireAtMostK(s, lits, k);
+
+        Minisat::vec<Minisat::Lit> assumps;
+        unsigned count=0;
+        for(unsigned i=0; i<n; i++){
+            bool v=(x>>i)&1;
+            count+=v;
+            assumps.push(v ? lits[i] : ~lits[i]);
+        }
+
+        bool sat=s.solve(assumps);
+        if(sat != (count<=k)){
+            fprintf(stderr, "FAIL : n=%u, k=%u, x=%u, count=%u, sat=%d\n", n, k, x, count, sat);
+            exit(1);
+        }
+    }
+}
+
+int main()
+{
+    for(unsigned n=1; n<=6; n++){
+        for(unsigned k=0; k<=n; k++){
+            testAtMostK(n, k);
+        }
+    }
+
+    unsigned wO=5, wI=16, wA=4;
+
+    for(unsigned groupSize=2; groupSize<=3; groupSize++){
+        unsigned nSolved=0;
+        for(int i=0; i<4; i++){
+            // Load factor of 0.8 relative to 2^wO*groupSize
+            auto keys=uniform_random_key_value_set(urng, wO+2, wI, 0, 0.8*groupSize/4);
+
+            auto bh = makeBitHash(urng, wO, wI, wA);
+
+            cnf_problem prob;
+            to_cnf(bh, keys.keys(), prob, 0, groupSize);
+            auto sol=minisat_solve(prob);
+            if(sol.empty()){
+                fprintf(stderr, "  groupSize=%u, instance %d : no solution\n", groupSize, i);
+                continue;
+            }
+            nSolved++;
+
+            auto back = substitute(bh, prob, sol);
+            if(!back.is_solution(keys, groupSize)){
+                fprintf(stderr, "FAIL : groupSize=%u, instance %d is not a solution\n", groupSize, i);
+                exit(1);
+            }
+            fprintf(stderr, "  groupSize=%u, instance %d : %u keys in %u slots\n", groupSize, i, keys.keys_size(), 1u<<wO);
+        }
+        // If every instance was skipped, groupSize was never checked
+        if(nSolved==0){
+            fprintf(stderr, "FAIL : groupSize=%u solved no instances\n", groupSize);
+            exit(1);
+        }
+    }
+
+    // Several calls to to_cnf on one problem must share the lut variables,
+    // even when other variables (here the stash literals) are interleaved
+    for(int i=0; i<4; i++){
+        auto keys=uniform_random_key_value_set(urng, wO, wI, 0, 0.5);
+        auto bh = makeBitHash(urng, wO, wI, wA);
+
+        // A small first part, so that most lut variables are created late
+        std::vector<std::map<bit_vector,bit_vector> > halves(2);
+        unsigned ki=0;
+        for(const auto &kv : keys){
+            halves[ki++<3 ? 0 : 1].insert(kv);
+        }
+
+        cnf_problem prob;
+        std::set<int> stashVars;
+        for(const auto &h : halves){
+            std::vector<bit_vector> hk;
+            for(const auto &kv : h){
+                hk.push_back(kv.first);
+            }
+            to_cnf(bh, hk, prob, 0, 1, true);
+            for(auto l : prob.stashLits){
+                prob.sat.addClause(~l);
+                stashVars.insert(Minisat::var(l)+1);
+            }
+        }
+        for(const auto &bit : prob.lutToVariable){
+            if(stashVars.count(bit.second) || bit.second>prob.sat.nVars()){
+                fprintf(stderr, "FAIL : split instance %d, lut variable %d is not its own variable\n", i, bit.second);
+                exit(1);
+            }
+        }
+        auto sol=minisat_solve(prob);
+        if(sol.empty()){
+            fprintf(stderr, "  split instance %d : no solution\n", i);
+            continue;
+        }
+        auto back = substitute(bh, prob, sol);
+        for(const auto &h : halves){
+            if(!back.is_solution(key_value_set{h})){
+                fprintf(stderr, "FAIL : split instance %d is not a solution\n", i);
+                exit(1);
+            }
+        }
+        fprintf(stderr, "  split instance %d : ok\n", i);
+    }
+
+    // Reduced inputs must still tell every key apart (projectKeys throws if
+    // two keys overlap), and a hash of the reduced keys must work on the
+    // originals once its taps are mapped back
+    for(int i=0; i<4; i++){
+        // Only the low bits of each byte vary
+        std::map<bit_vector,bit_vector> entries;
+        while(entries.size()<40){
+            std::vector<int> bits(24, 0);
+            for(unsigned b=0; b<24; b++){
+                bits[b] = (b%8)<3 ? (int)(urng()%2) : (b%8)==5;
+            }
+            if(i%2 && urng()%4==0){
+                bits[urng()%24]=-1;
+            }
+            entries.insert(std::make_pair(bit_vector(bits), bit_vector()));
+        }
+        key_value_set keys;
+        try{
+            keys=key_value_set(entries);
+        }catch(std::runtime_error &){
+            continue; // Some ternary keys overlapped
+        }
+
+        auto greedy=findDistinguishingBits(keys);
+        auto exact=findDistinguishingBits(keys, -1);
+        if(exact.size()>greedy.size() || greedy.size()>9){
+            fprintf(stderr, "FAIL : reduce instance %d, greedy=%u, exact=%u\n", i, (unsigned)greedy.size(), (unsigned)exact.size());
+            exit(1);
+        }
+
+        // Brute force over the pairs, which findDistinguishingBits no longer lists
+        for(const auto &bits : {greedy, exact}){
+            for(auto ka=keys.begin(); ka!=keys.end(); ++ka){
+                for(auto kb=std::next(ka); kb!=keys.end(); ++kb){
+                    bool apart=false;
+                    for(unsigned b : bits){
+                        int x=ka->first[b], y=kb->first[b];
+                        apart = apart || (x!=-1 && y!=-1 && x!=y);
+                    }
+                    if(!apart){
+                        fprintf(stderr, "FAIL : reduce instance %d, a pair of keys is not told apart\n", i);
+                        exit(1);
+                    }
+                }
+            }
+        }
+
+        auto reduced=projectKeys(keys, exact);
+        auto bh=makeBitHash(urng, wO+1, exact.size(), 4);
+        cnf_problem prob;
+        to_cnf(bh, reduced.keys(), prob);
+        auto sol=minisat_solve(prob);
+        if(sol.empty()){
+            fprintf(stderr, "  reduce instance %d : no solution\n", i);
+            continue;
+        }
+        auto back=unprojectBitHash(substitute(bh, prob, sol), exact, 24);
+        if(!back.is_solution(keys)){
+            fprintf(stderr, "FAIL : reduce instance %d is not a solution on the full keys\n", i);
+            exit(1);
+        }
+        fprintf(stderr, "  reduce instance %d : %u greedy, %u exact inputs\n", i, (unsigned)greedy.size(), (unsigned)exact.size());
+    }
+
+    // 20 keys which only differ in 5 bits, but with a maxHash that needs 6
+    {
+        std::map<bit_vector,bit_vector> entries;
+        for(unsigned k=0; k<20; k++){
+            std::vector<int> bits(16, 0);
+            for(unsigned b=0; b<5; b++){
+                bits[b+4]=(k>>b)&1;
+            }
+            bits[15]=1;
+            entries.insert(std::make_pair(bit_vector(bits), bit_vector()));
+        }
+        key_value_set keys(entries);
+        keys.setMaxHash(40);
+
+        auto bits=findDistinguishingBits(keys, -1);
+        auto wide=widenForMaxHash(bits, 16, keys.getMaxHash());
+        if(bits.size()!=5 || wide.size()!=6 || !std::includes(wide.begin(), wide.end(), bits.begin(), bits.end())){
+            fprintf(stderr, "FAIL : widenForMaxHash gave %u bits from %u\n", (unsigned)wide.size(), (unsigned)bits.size());
+            exit(1);
+        }
+
+        auto reduced=projectKeys(keys, wide);
+        auto bh=makeBitHash(urng, 6, wide.size(), 3);
+        cnf_problem prob;
+        to_cnf(bh, reduced.keys(), prob, reduced.getMaxHash());
+        auto sol=minisat_solve(prob);
+        if(sol.empty()){
+            fprintf(stderr, "FAIL : widened reduction has no solution\n");
+            exit(1);
+        }
+        auto back=unprojectBitHash(substitute(bh, prob, sol), wide, 16);
+        if(!back.is_solution(keys)){
+            fprintf(stderr, "FAIL : widened reduction is not a solution on the full keys\n");
+            exit(1);
+        }
+    }
+
+    // Fewest collisions, on instances that are usually too hard to be perfect
+    for(int i=0; i<4; i++){
+        solve_context ctxt;
+        ctxt.urng.seed(i);
+        ctxt.verbose=0;
+        ctxt.maxTime=60;
+        ctxt.maxTries=4;    // Three shuffles
+        ctxt.wO=4;
+        ctxt.wI=12;
+        ctxt.wA=1;
+
+        auto keys=uniform_random_key_value_set(ctxt.urng, 4, 12, 0, 1.0);
+
+        BitHash result;
+        std::vector<bit_vector> stash;
+        bool optimal;
+        std::tie(result, stash, optimal)=solve_cnf_maxsat(ctxt, keys);
+        if(result.tables.empty() || !optimal){
+            fprintf(stderr, "FAIL : maxsat instance %d was not solved to optimality\n", i);
+            exit(1);
+        }
+
+        if(stash.size() < result.stash_lower_bound(keys)){
+            fprintf(stderr, "FAIL : maxsat instance %d beat the lower bound\n", i);
+            exit(1);
+        }
+
+        // Removing the stash must leave a perfect hash
+        std::set<bit_vector> stashed(stash.begin(), stash.end());
+        std::map<bit_vector,bit_vector> rest;
+        for(const auto &kv : keys){
+            if(stashed.count(kv.first)==0)
+                rest.insert(kv);
+        }
+        if(!result.is_solution(key_value_set{rest})){
+            fprintf(stderr, "FAIL : maxsat instance %d is not perfect without the stash\n", i);
+            exit(1);
+        }
+        fprintf(stderr, "  maxsat instance %d : %u stashed keys\n", i, (unsigned)stash.size());
+    }
+
+    fprintf(stderr, "Pass\n");
+    return 0;
+}
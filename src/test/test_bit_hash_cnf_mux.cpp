@@ -0,0 +1,63 @@
+#include "bit_hash.hpp"
+#include "bit_hash_cnf.hpp"
+#include "bit_hash_cnf_mux.hpp"
+
+#include <random>
+#include <iostream>
+#include <set>
+
+std::mt19937 urng;
+
+int main()
+{
+    unsigned wO=5, wI=16, wA=4;
+
+    // Taps chosen by the solver, which must come from the candidates and
+    // be distinct within each table
+    for(unsigned nCand=1; nCand<=4; nCand+=3){
+        unsigned nSolved=0;
+        for(int i=0; i<4; i++){
+            auto keys=uniform_random_key_value_set(urng, wO, wI, 0, 0.9, (i%2) ? 0.05 : 0.0);
+            auto bh = makeBitHash(urng, wO, wI, wA);
+            auto cands = makeTapCandidates(urng, bh, nCand);
+
+            cnf_problem prob;
+            to_cnf_mux(bh, cands, keys.keys(), prob);
+            auto sol=minisat_solve(prob);
+            if(sol.empty()){
+                fprintf(stderr, "  mux nCand=%u, instance %d : no solution\n", nCand, i);
+                continue;
+            }
+            nSolved++;
+
+            auto back = substitute(bh, prob, sol);
+            for(unsigned ti=0; ti<wO; ti++){
+                const auto &sel=back.tables[ti].selectors;
+                if(std::set<unsigned>(sel.begin(), sel.end()).size()!=sel.size()){
+                    fprintf(stderr, "FAIL : mux instance %d, table %u has repeated taps\n", i, ti);
+                    exit(1);
+                }
+                for(unsigned si=0; si<sel.size(); si++){
+                    const auto &c=cands[ti][si];
+                    if(std::find(c.begin(), c.end(), sel[si])==c.end()){
+                        fprintf(stderr, "FAIL : mux instance %d, table %u tap %u is not a candidate\n", i, ti, si);
+                        exit(1);
+                    }
+                }
+            }
+            if(!back.is_solution(keys)){
+                fprintf(stderr, "FAIL : mux nCand=%u, instance %d is not a solution\n", nCand, i);
+                exit(1);
+            }
+            fprintf(stderr, "  mux nCand=%u, instance %d : ok\n", nCand, i);
+        }
+        // Otherwise none of the checks above ran
+        if(nSolved==0){
+            fprintf(stderr, "FAIL : mux nCand=%u solved no instances\n", nCand);
+            exit(1);
+        }
+    }
+
+    fprintf(stderr, "Pass\n");
+    return 0;
+}
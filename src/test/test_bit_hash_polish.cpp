@@ -0,0 +1,53 @@
+#include "bit_hash.hpp"
+#include "bit_hash_polish.hpp"
+#include "solver_walk.hpp"
+
+#include <random>
+#include <iostream>
+
+std::mt19937 urng;
+
+int main()
+{
+    unsigned wO=6, wI=16, wA=5;
+
+    for(int i=0; i<5; i++){
+        solve_context ctxt;
+        ctxt.urng.seed(i);
+        ctxt.verbose=0;
+        ctxt.maxTries=10000000;
+        ctxt.maxTime=60;
+        ctxt.wO=wO;
+        ctxt.wI=wI;
+        ctxt.wA=wA;
+
+        auto keys=uniform_random_key_value_set(ctxt.urng, wO, wI, 0, 0.9);
+
+        BitHash result;
+        bool success;
+        std::tie(result, success)=solver_walk(ctxt, keys);
+        if(!success){
+            fprintf(stderr, "  instance %d : walk failed, skipping\n", i);
+            continue;
+        }
+
+        // Knock it away from the solution, then pull it back
+        BitHash near=perturbHash(urng, result, 0.02);
+        if(near.is_solution(keys)){
+            continue;
+        }
+        double eNear=EntryToKey::evalFull(near, keys);
+
+        for(int expandCore=0; expandCore<2; expandCore++){
+            BitHash back=bit_hash_polish(urng, near, keys, 0, expandCore);
+            if(!back.is_solution(keys)){
+                fprintf(stderr, "FAIL : polish did not repair instance %d (e = %f, expandCore = %d)\n", i, eNear, expandCore);
+                exit(1);
+            }
+            fprintf(stderr, "  instance %d : e = %g repaired, %d bits changed (expandCore = %d)\n", i, eNear, near.distance(back), expandCore);
+        }
+    }
+
+    fprintf(stderr, "Pass\n");
+    return 0;
+}
@@ -0,0 +1,122 @@
+#include "bit_hash.hpp"
+#include "bit_hash_history.hpp"
+
+#include <random>
+#include <iostream>
+#include <thread>
+
+std::mt19937 urng;
+
+typedef bit_signature_table<0> sig0_t;
+typedef bit_signature_table<1> sig1_t;
+typedef bit_signature_table<2> sig2_t;
+typedef bit_sig_multi<sig0_t,bit_sig_multi<sig1_t,sig2_t> > sig_t;
+
+typedef bit_sig_blocked_set<sig_t> set_t;
+
+sig_t randomSig(std::mt19937 &rng)
+{
+    sig_t sig;
+    for(unsigned i=0; i<64; i++){
+        if(rng()%2)
+            sig.flip(i);
+    }
+    return sig;
+}
+
+int main()
+{
+    // Force the signature tables to be built before any threads start
+    randomSig(urng);
+
+    {
+        set_t set(10);
+        bit_sig_tabu_ring<sig_t> ring(set, 1000);
+
+        std::vector<sig_t> added;
+        for(unsigned i=0; i<1000; i++){
+            sig_t sig=randomSig(urng);
+            ring.add(sig);
+            added.push_back(sig);
+
+            unsigned flip=urng()%64;
+            sig_t flipped=sig;
+            flipped.flip(flip);
+            if(set.contains(flipped)!=set.contains_with_flip(sig, flip)){
+                fprintf(stderr, "FAIL : contains_with_flip disagrees with contains\n");
+                exit(1);
+            }
+        }
+
+        for(const auto &sig : added){
+            if(!set.contains(sig)){
+                fprintf(stderr, "FAIL : false negative\n");
+                exit(1);
+            }
+        }
+
+        double nFalse=0;
+        for(unsigned i=0; i<100000; i++){
+            if(set.contains(randomSig(urng)))
+                nFalse++;
+        }
+        fprintf(stderr, "  load = %f, pFalse = %g\n", set.load(), nFalse/100000);
+        if(nFalse/100000 > 0.01){
+            fprintf(stderr, "FAIL : false positive rate is too high\n");
+            exit(1);
+        }
+
+        // Push everything back out of the ring
+        for(unsigned i=0; i<1000; i++){
+            ring.add(randomSig(urng));
+        }
+        unsigned nHit=0;
+        for(const auto &sig : added){
+            if(set.contains(sig))
+                nHit++;
+        }
+        if(nHit > 100){
+            fprintf(stderr, "FAIL : %u aged entries still present\n", nHit);
+            exit(1);
+        }
+
+        ring.clear();
+        if(set.load()!=0){
+            fprintf(stderr, "FAIL : set is not empty after clearing ring\n");
+            exit(1);
+        }
+    }
+
+    // Several threads sharing one set, each with its own ring
+    {
+        set_t set(8);
+        std::vector<std::thread> threads;
+        for(unsigned t=0; t<4; t++){
+            threads.emplace_back([&set](unsigned seed){
+                std::mt19937 rng(seed);
+                bit_sig_tabu_ring<sig_t> ring(set, 500);
+                for(unsigned i=0; i<20000; i++){
+                    sig_t sig=randomSig(rng);
+                    ring.add(sig);
+                    if(!set.contains(sig)){
+                        fprintf(stderr, "FAIL : false negative in thread\n");
+                        exit(1);
+                    }
+                }
+            }, (unsigned)urng());
+        }
+        for(auto &t : threads){
+            t.join();
+        }
+
+        // Counters can saturate under contention, but with this load they
+        // should all have returned to zero.
+        if(set.load()!=0){
+            fprintf(stderr, "FAIL : set is not empty after all rings destroyed\n");
+            exit(1);
+        }
+    }
+
+    fprintf(stderr, "Pass\n");
+    return 0;
+}
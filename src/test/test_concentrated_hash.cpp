@@ -0,0 +1,89 @@
+#include "bit_hash.hpp"
+#include "concentrated_hash.hpp"
+#include "solver_concentrator.hpp"
+#include "solver_walk.hpp"
+#include "brute_stash.hpp"
+
+#include <random>
+#include <iostream>
+#include <sstream>
+
+int main()
+{
+    unsigned wI=14, wC=8;
+
+    for(int i=0; i<8; i++){
+        solve_context ctxt;
+        ctxt.urng.seed(i);
+        ctxt.verbose=0;
+        ctxt.maxTime=60;
+        ctxt.wI=wI;
+        ctxt.wA=4;
+
+        // Instances alternate between the two front ends, and some have ternary keys
+        bool lut=(i%2)==1;
+        auto keys=uniform_random_key_value_set(ctxt.urng, 5, wI, 0, 0.7, (i%4)==3 ? 0.05 : 0.0);
+        if(i>=4){
+            keys.setMaxHash(28);
+        }
+
+        BitHash front;
+        bool success;
+        if(lut){
+            std::tie(front, success)=solve_concentrator_lut(ctxt, keys, wC);
+        }else{
+            std::tie(front, success)=solve_concentrator_xor(ctxt, keys, wC);
+        }
+        if(!success || front.wI!=wI || front.wO!=wC){
+            fprintf(stderr, "FAIL : %s concentrator did not solve instance %d\n", lut?"lut":"xor", i);
+            exit(1);
+        }
+
+        // Injective on the keys, and every variant of a key concentrates to the same value
+        key_value_set loose(std::map<bit_vector,bit_vector>(keys.begin(), keys.end()));
+        if(bruteStash(front, loose)!=0){
+            fprintf(stderr, "FAIL : %s concentrator for instance %d is not injective\n", lut?"lut":"xor", i);
+            exit(1);
+        }
+        auto narrow=concentrateKeys(front, keys);
+
+        ConcentratedHash ch;
+        ch.wI=wI;
+        ch.wO=5;
+        ch.front=front;
+
+        // The stash is the same as the oracle's, whether or not the back stage is perfect
+        ch.back=makeBitHashConcrete(ctxt.urng, ch.wO, wC, 4);
+        if(ch.find_stash(keys).size()!=bruteStash(ch, keys)){
+            fprintf(stderr, "FAIL : instance %d stashes %u keys with a random back stage, oracle says %u\n", i, (unsigned)ch.find_stash(keys).size(), bruteStash(ch, keys));
+            exit(1);
+        }
+
+        ctxt.wO=ch.wO;
+        ctxt.wI=wC;
+        std::tie(ch.back, success)=solver_walk(ctxt, narrow);
+        if(!success || ch.find_stash(keys).size()!=0 || bruteStash(ch, keys)!=0){
+            fprintf(stderr, "FAIL : back stage did not solve instance %d\n", i);
+            exit(1);
+        }
+
+        std::stringstream a, b;
+        ch.print(a);
+        auto back=parse_concentrated_hash(a);
+        back.print(b);
+        if(a.str()!=b.str()){
+            fprintf(stderr, "FAIL : instance %d did not survive print and parse\n", i);
+            exit(1);
+        }
+        for(const auto &kv : keys){
+            if(back(*kv.first.variants_begin())!=ch(*kv.first.variants_begin())){
+                fprintf(stderr, "FAIL : parsed instance %d gives a different hash\n", i);
+                exit(1);
+            }
+        }
+        fprintf(stderr, "  instance %d : %u keys through a %s concentrator\n", i, (unsigned)keys.keys_size(), lut?"lut":"xor");
+    }
+
+    fprintf(stderr, "Pass\n");
+    return 0;
+}
@@ -0,0 +1,229 @@
+#include "bit_hash.hpp"
+#include "cuckoo_hash.hpp"
+#include "solver_cuckoo.hpp"
+
+#include <random>
+#include <iostream>
+#include <sstream>
+
+// The fewest keys which can't be placed, trying choice 0, choice 1 or the stash for every key
+unsigned bruteUnplaced(const std::vector<unsigned> slots[2], std::vector<unsigned> &load, unsigned capacity, unsigned k=0)
+{
+    if(k==slots[0].size())
+        return 0;
+    unsigned res=1+bruteUnplaced(slots, load, capacity, k+1);
+    for(int c=0; c<2 && res>0; c++){
+        unsigned s=slots[c][k];
+        if(s==UINT_MAX || load[s]>=capacity)
+            continue;
+        load[s]++;
+        res=std::min(res, bruteUnplaced(slots, load, capacity, k+1));
+        load[s]--;
+    }
+    return res;
+}
+
+// The matching must agree with itself: every placed key is in the slot it chose, and no slot is over capacity
+void checkMatching(const cuckoo_matching &m, int i)
+{
+    unsigned unplaced=0, inSlots=0;
+    for(unsigned k=0; k<m.choice.size(); k++){
+        if(m.choice[k]==-1){
+            unplaced++;
+            continue;
+        }
+        unsigned s=m.current(k);
+        if(s==UINT_MAX || std::count(m.occupants[s].begin(), m.occupants[s].end(), k)!=1){
+            fprintf(stderr, "FAIL : instance %d places key %u somewhere it can't go\n", i, k);
+            exit(1);
+        }
+    }
+    for(const auto &occ : m.occupants){
+        if(occ.size()>m.capacity){
+            fprintf(stderr, "FAIL : instance %d puts too many keys in a slot\n", i);
+            exit(1);
+        }
+        inSlots += occ.size();
+    }
+    if(unplaced!=m.unplaced || inSlots+unplaced!=m.choice.size()){
+        fprintf(stderr, "FAIL : instance %d has lost track of the keys\n", i);
+        exit(1);
+    }
+}
+
+int main()
+{
+    // settle must leave exactly as many keys unplaced as the best assignment,
+    // including after slots are moved under it
+    for(int i=0; i<300; i++){
+        std::mt19937 urng(i);
+        unsigned nSlots=3+urng()%4, nKeys=1+urng()%8, capacity=1+(i%2);
+
+        auto randomSlot=[&]() -> unsigned
+        { return (urng()%8)==0 ? UINT_MAX : urng()%nSlots; };
+
+        cuckoo_matching m(nSlots, nKeys, capacity);
+        for(unsigned k=0; k<nKeys; k++){
+            m.slots[0][k]=randomSlot();
+            m.slots[1][k]=randomSlot();
+        }
+        for(int j=0; j<10; j++){
+            if(j>0){
+                unsigned k=urng()%nKeys;
+                m.set_slot(k, urng()%2, randomSlot());
+            }
+            unsigned got=m.settle();
+            checkMatching(m, i);
+            std::vector<unsigned> load(nSlots, 0);
+            unsigned expected=bruteUnplaced(m.slots, load, capacity);
+            if(got!=expected){
+                fprintf(stderr, "FAIL : instance %d step %d leaves %u unplaced, brute force gets %u\n", i, j, got, expected);
+                exit(1);
+            }
+        }
+    }
+
+    unsigned wI=10;
+
+    // is_solution on random (mostly not perfect) hashes must agree with brute force
+    for(int i=0; i<100; i++){
+        std::mt19937 urng(i);
+        unsigned wO=4;
+        auto keys=uniform_random_key_value_set(urng, wO, wI, 0, 0.5, (i%3)==2 ? 0.05 : 0.0);
+        keys.setMaxStash(i%3);
+        if(i%4==1){
+            keys.setMaxHash(13);
+        }
+
+        std::vector<unsigned> pool;
+        for(unsigned b=0; b<wI; b++){
+            pool.push_back(b);
+        }
+        CuckooHash ch;
+        ch.wI=wI;
+        ch.wO=wO;
+        for(int c=0; c<2; c++){
+            ch.choices[c]=make_cuckoo_choice(urng, pool, wI, wO-1, 2);
+        }
+
+        std::vector<unsigned> slots[2];
+        for(const auto &kv : keys){
+            for(int c=0; c<2; c++){
+                auto it=kv.first.variants_begin();
+                unsigned s=ch.slot(c, to_unsigned(*it));
+                bool ok = !(keys.getMaxHash()>0 && s>=keys.getMaxHash());
+                for(++it; it!=kv.first.variants_end(); ++it){
+                    ok = ok && ch.slot(c, to_unsigned(*it))==s;
+                }
+                slots[c].push_back(ok ? s : UINT_MAX);
+            }
+        }
+        std::vector<unsigned> load(1u<<wO, 0);
+        unsigned expected=bruteUnplaced(slots, load, 1);
+        if(ch.find_stash(keys).size()!=expected || ch.is_solution(keys)!=(expected<=keys.getMaxStash())){
+            fprintf(stderr, "FAIL : instance %d stashes %u keys, brute force gets %u\n", i, (unsigned)ch.find_stash(keys).size(), expected);
+            exit(1);
+        }
+    }
+
+    for(int i=0; i<6; i++){
+        solve_context ctxt;
+        ctxt.urng.seed(i);
+        ctxt.verbose=0;
+        ctxt.maxTime=60;
+        ctxt.wO=6;
+        ctxt.wA=4;
+
+        // Ternary keys are wider, so that enough bits are defined in every key
+        auto keys=uniform_random_key_value_set(ctxt.urng, 6, (i%2) ? 24 : wI, 0, 0.8, (i%2) ? 0.02 : 0.0);
+        keys.setMaxStash(i%3);
+
+        CuckooHash result;
+        bool success;
+        std::tie(result, success)=solve_cuckoo(ctxt, keys);
+        if(!success || !result.is_solution(keys)){
+            fprintf(stderr, "FAIL : solve_cuckoo did not solve instance %d\n", i);
+            exit(1);
+        }
+
+        std::stringstream a, b;
+        result.print(a);
+        auto back=parse_cuckoo_hash(a);
+        back.print(b);
+        if(a.str()!=b.str()){
+            fprintf(stderr, "FAIL : instance %d did not survive print and parse\n", i);
+            exit(1);
+        }
+
+        // Every variant of a placed key must find its own slot, and no two keys share one
+        CuckooLookup cl(result, keys);
+        std::set<unsigned> stash, used;
+        for(const auto &k : cl.stash){
+            stash.insert(to_unsigned(*k.variants_begin()));
+        }
+        for(const auto &kv : keys){
+            if(stash.count(to_unsigned(*kv.first.variants_begin())))
+                continue;
+            auto it=kv.first.variants_begin();
+            unsigned s=cl(*it);
+            if(!cl.matches(s, to_unsigned(*it)) || !used.insert(s).second){
+                fprintf(stderr, "FAIL : instance %d does not look up a placed key\n", i);
+                exit(1);
+            }
+            for(++it; it!=kv.first.variants_end(); ++it){
+                if(cl(*it)!=s){
+                    fprintf(stderr, "FAIL : instance %d looks up variants of a key in different slots\n", i);
+                    exit(1);
+                }
+            }
+        }
+        // Empty slots must not match any input at all
+        for(unsigned s=0; s<cl.tags.size(); s++){
+            for(unsigned x=0; !used.count(s) && x<(1u<<wI); x++){
+                if(cl.matches(s, x)){
+                    fprintf(stderr, "FAIL : instance %d, empty slot %u matches %u\n", i, s, x);
+                    exit(1);
+                }
+            }
+        }
+        fprintf(stderr, "  instance %d : %u keys with %u stashed, in %d steps\n", i, (unsigned)keys.keys_size(), (unsigned)cl.stash.size(), ctxt.tries);
+    }
+
+    {
+        solve_context ctxt;
+        ctxt.verbose=0;
+        ctxt.wO=6;
+        ctxt.groupSize=2;
+        auto keys=uniform_random_key_value_set(ctxt.urng, 6, wI, 0, 0.5);
+        bool threw=false;
+        try{
+            solve_cuckoo(ctxt, keys);
+        }catch(std::runtime_error &){
+            threw=true;
+        }
+        if(!threw){
+            fprintf(stderr, "FAIL : solve_cuckoo accepted a group size of 2\n");
+            exit(1);
+        }
+    }
+
+    // At 32 bits there is no room for the empty tag
+    {
+        CuckooHash ch;
+        ch.wI=32;
+        ch.wO=4;
+        bool threw=false;
+        try{
+            CuckooLookup cl(ch, key_value_set());
+        }catch(std::runtime_error &){
+            threw=true;
+        }
+        if(!threw){
+            fprintf(stderr, "FAIL : CuckooLookup accepted 32 bit keys\n");
+            exit(1);
+        }
+    }
+
+    fprintf(stderr, "Pass\n");
+    return 0;
+}
@@ -0,0 +1,77 @@
+#include "bit_hash.hpp"
+#include "family_hash.hpp"
+#include "solver_family.hpp"
+#include "brute_stash.hpp"
+
+#include <random>
+#include <iostream>
+#include <sstream>
+
+int main()
+{
+    unsigned wI=10, wC=2, wT=3;
+
+    // The search must find a word exactly when trying every word does, so
+    // the cut never throws away a branch with a solution in it
+    unsigned nFound=0, nNone=0;
+    for(int i=0; i<60; i++){
+        solve_context ctxt;
+        ctxt.urng.seed(i);
+        ctxt.verbose=0;
+        ctxt.maxTime=60;
+        ctxt.threads=1+(i%3);
+        ctxt.groupSize=1+(i%2);
+
+        unsigned wO=3+(i%2);
+        auto keys=uniform_random_key_value_set(ctxt.urng, wO, wI, 0, 0.5, (i%4)==3 ? 0.05 : 0.0);
+        if(i%5==1){
+            keys.setMaxStash(2);
+        }
+        if(i%5==2){
+            keys.setMaxHash((1u<<wO)-3);
+        }
+
+        auto fh=makeFamilyHash(ctxt.urng, wO, wI, wC, wT);
+
+        bool exists=false;
+        unsigned nWords=1u<<(wC*wO);
+        for(unsigned w=0; w<nWords && !exists; w++){
+            for(unsigned t=0; t<wO; t++){
+                fh.control[t]=(w>>(t*wC))&((1u<<wC)-1);
+            }
+            exists = bruteStash(fh, keys, ctxt.groupSize) <= keys.getMaxStash();
+        }
+
+        bool found=search_family_control(ctxt, fh, keys);
+        if(found!=exists){
+            fprintf(stderr, "FAIL : instance %d, search says %d but brute force says %d\n", i, found, exists);
+            exit(1);
+        }
+        if(found && (bruteStash(fh, keys, ctxt.groupSize) > keys.getMaxStash() || !fh.is_solution(keys, ctxt.groupSize))){
+            fprintf(stderr, "FAIL : instance %d, control word is not a solution\n", i);
+            exit(1);
+        }
+        if(found){
+            nFound++;
+        }else{
+            nNone++;
+        }
+
+        std::stringstream a, b;
+        fh.print(a);
+        auto back=parse_family_hash(a);
+        back.print(b);
+        if(a.str()!=b.str() || back.control_word()!=fh.control_word()){
+            fprintf(stderr, "FAIL : instance %d, family hash did not survive print and parse\n", i);
+            exit(1);
+        }
+    }
+    fprintf(stderr, "  %u instances with a control word, %u without\n", nFound, nNone);
+    if(nFound==0 || nNone==0){
+        fprintf(stderr, "FAIL : instances should include both outcomes\n");
+        exit(1);
+    }
+
+    fprintf(stderr, "Pass\n");
+    return 0;
+}
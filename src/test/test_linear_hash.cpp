@@ -0,0 +1,135 @@
+#include "bit_hash.hpp"
+#include "linear_hash.hpp"
+#include "solver_linear.hpp"
+#include "brute_stash.hpp"
+
+#include <random>
+#include <iostream>
+#include <sstream>
+
+bit_vector fixed_bit_vector(uint64_t x, unsigned w)
+{
+    std::vector<int> bits;
+    for(unsigned b=0; b<w; b++){
+        bits.push_back((x>>b)&1);
+    }
+    return bit_vector{bits};
+}
+
+//! The keys x0 ^ (any combination of dirs), which is an affine space of dimension rank(dirs)
+key_value_set affine_key_value_set(uint64_t x0, const std::vector<uint64_t> &dirs, unsigned wI)
+{
+    std::map<bit_vector,bit_vector> keys;
+    for(unsigned m=0; m<(1u<<dirs.size()); m++){
+        uint64_t x=x0;
+        for(unsigned i=0; i<dirs.size(); i++){
+            if((m>>i)&1)
+                x ^= dirs[i];
+        }
+        keys.insert(std::make_pair(fixed_bit_vector(x, wI), bit_vector()));
+    }
+    return key_value_set{keys};
+}
+
+void checkSolution(const char *what, int i, solve_context &ctxt, const key_value_set &keys, unsigned rowWeight)
+{
+    LinearHash result;
+    bool success;
+    std::tie(result, success)=solve_linear(ctxt, keys, rowWeight);
+    if(!success || bruteStash(result, keys, ctxt.groupSize)>keys.getMaxStash()){
+        fprintf(stderr, "FAIL : solve_linear did not solve %s instance %d\n", what, i);
+        exit(1);
+    }
+    for(unsigned r=0; r<result.wO; r++){
+        if(rowWeight>0 && result.taps(r).size()!=rowWeight){
+            fprintf(stderr, "FAIL : %s instance %d has a row with %u taps, not %u\n", what, i, (unsigned)result.taps(r).size(), rowWeight);
+            exit(1);
+        }
+    }
+
+    std::stringstream a, b;
+    result.print(a);
+    auto back=parse_linear_hash(a);
+    back.print(b);
+    if(a.str()!=b.str() || back.rows!=result.rows){
+        fprintf(stderr, "FAIL : %s instance %d did not survive print and parse\n", what, i);
+        exit(1);
+    }
+    fprintf(stderr, "  %s instance %d : %u keys solved in %d tries\n", what, i, (unsigned)keys.keys_size(), ctxt.tries);
+}
+
+int main()
+{
+    std::mt19937 urng(1);
+
+    // The rank is log2 of the size of the span, and insert succeeds exactly
+    // when the vector is not already in it
+    for(int i=0; i<1000; i++){
+        unsigned w=1+urng()%7, n=urng()%9;
+        std::vector<uint64_t> vs, basis;
+        std::set<uint64_t> span{0};
+        for(unsigned j=0; j<n; j++){
+            uint64_t v=urng()&((1u<<w)-1);
+            vs.push_back(v);
+            bool inSpan=span.count(v)>0;
+            if(gf2_insert(basis, v)==inSpan){
+                fprintf(stderr, "FAIL : gf2_insert of %u gives %d, but brute force says in span = %d\n", (unsigned)v, !inSpan, inSpan);
+                exit(1);
+            }
+            std::set<uint64_t> next(span);
+            for(uint64_t s : span){
+                next.insert(s^v);
+            }
+            span.swap(next);
+        }
+        unsigned rank=gf2_rank(vs);
+        if((size_t(1)<<rank)!=span.size()){
+            fprintf(stderr, "FAIL : gf2_rank gives %u, but the span has %u vectors\n", rank, (unsigned)span.size());
+            exit(1);
+        }
+    }
+
+    unsigned wI=16;
+
+    // Dense keys (a block of sequential IDs, or some other affine space) are checked by rank
+    for(int i=0; i<6; i++){
+        solve_context ctxt;
+        ctxt.urng.seed(i);
+        ctxt.verbose=0;
+        ctxt.maxTime=60;
+        ctxt.wO=6;
+
+        std::vector<uint64_t> dirs;
+        if(i<3){
+            for(unsigned b=0; b<6; b++){
+                dirs.push_back(uint64_t(1)<<b);
+            }
+        }else{
+            while(gf2_rank(dirs)<6){
+                dirs.push_back(ctxt.urng()&0xFFFF);
+            }
+        }
+        auto keys=affine_key_value_set((ctxt.urng()&0xFFFF)&~uint64_t(i<3 ? 63 : 0), dirs, wI);
+        checkSolution("dense", i, ctxt, keys, (i%3)==2 ? 3 : 0);
+    }
+
+    // Sparse keys are checked by hashing them
+    for(int i=0; i<6; i++){
+        solve_context ctxt;
+        ctxt.urng.seed(i);
+        ctxt.verbose=0;
+        ctxt.maxTime=60;
+        ctxt.wO=7;
+        ctxt.groupSize=1+(i%2);
+
+        auto keys=uniform_random_key_value_set(ctxt.urng, 7, wI, 0, 0.25, (i%3)==1 ? 0.05 : 0.0);
+        if(i>=4){
+            keys.setMaxStash(2);
+            keys.setMaxHash(120);
+        }
+        checkSolution("sparse", i, ctxt, keys, (i%3)==2 ? 4 : 0);
+    }
+
+    fprintf(stderr, "Pass\n");
+    return 0;
+}
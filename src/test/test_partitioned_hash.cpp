@@ -0,0 +1,102 @@
+#include "bit_hash.hpp"
+#include "partitioned_hash.hpp"
+#include "solver_partitioned.hpp"
+#include "brute_stash.hpp"
+
+#include <random>
+#include <iostream>
+#include <sstream>
+
+int main()
+{
+    unsigned wI=12;
+
+    // With one candidate the subset sum must do as well as every lut for the same taps
+    for(int i=0; i<20; i++){
+        std::mt19937 urng(i);
+        auto keys=uniform_random_key_value_set(urng, 5, wI, 0, 0.7, (i%2) ? 0.05 : 0.0);
+        unsigned n=keys.keys_size();
+        unsigned caps[2]={n/2+unsigned(urng()%4), n/2+unsigned(urng()%4)};
+        unsigned target=urng()%(n+1);
+
+        BitHash sel;
+        unsigned dist;
+        std::tie(sel, dist)=make_partition_selector(urng, keys, 3, target, caps, 1);
+
+        const auto &t=sel.tables.at(0);
+        std::vector<unsigned> counts(t.lut.size());
+        for(const auto &kv : keys){
+            counts[t.address(*kv.first.variants_begin())]++;
+        }
+        unsigned best=UINT_MAX;
+        for(unsigned m=0; m<(1u<<t.lut.size()); m++){
+            unsigned s=0;
+            for(unsigned a=0; a<t.lut.size(); a++){
+                s += ((m>>a)&1) ? counts[a] : 0;
+            }
+            if(s<=caps[1] && n-s<=caps[0]){
+                best=std::min(best, s>target ? s-target : target-s);
+            }
+        }
+        if(dist!=best){
+            fprintf(stderr, "FAIL : selector %d is %u from target, brute force gets %u\n", i, dist, best);
+            exit(1);
+        }
+        if(dist!=UINT_MAX){
+            unsigned s=0;
+            for(const auto &kv : keys){
+                s += sel(*kv.first.variants_begin());
+            }
+            if(s>caps[1] || n-s>caps[0] || (s>target ? s-target : target-s)!=dist){
+                fprintf(stderr, "FAIL : selector %d does not split the keys as claimed\n", i);
+                exit(1);
+            }
+        }
+    }
+
+    // The last two only fit in half 0, so half 1 gets no keys at all
+    for(int i=0; i<8; i++){
+        solve_context ctxt;
+        ctxt.urng.seed(i);
+        ctxt.verbose=0;
+        ctxt.maxTime=60;
+        ctxt.wO=6;
+        ctxt.wI=wI;
+        ctxt.wA=4;
+        ctxt.groupSize=1+(i%2);
+
+        auto keys=uniform_random_key_value_set(ctxt.urng, 6, wI, 0, i>=6 ? 0.4 : 0.6, (i%3)==2 ? 0.05 : 0.0);
+        if(i>=6){
+            keys.setMaxHash(28);
+        }else if(i>=4){
+            keys.setMaxHash(48);
+        }
+
+        PartitionedHash result;
+        bool success;
+        std::tie(result, success)=solve_partitioned(ctxt, keys);
+        if(!success || bruteStash(result, keys, ctxt.groupSize)!=0 || !result.is_solution(keys, ctxt.groupSize)){
+            fprintf(stderr, "FAIL : solve_partitioned did not solve instance %d\n", i);
+            exit(1);
+        }
+        for(unsigned ti=0; ti<result.wO-1; ti++){
+            if(result.halves[0].tables[ti].selectors!=result.halves[1].tables[ti].selectors){
+                fprintf(stderr, "FAIL : instance %d has halves with different taps\n", i);
+                exit(1);
+            }
+        }
+
+        std::stringstream a, b;
+        result.print(a);
+        auto back=parse_partitioned_hash(a);
+        back.print(b);
+        if(a.str()!=b.str()){
+            fprintf(stderr, "FAIL : instance %d did not survive print and parse\n", i);
+            exit(1);
+        }
+        fprintf(stderr, "  instance %d solved in %d tries\n", i, ctxt.tries);
+    }
+
+    fprintf(stderr, "Pass\n");
+    return 0;
+}
@@ -0,0 +1,102 @@
+#include "bit_hash.hpp"
+#include "premix.hpp"
+#include "solver_walk.hpp"
+#include "brute_stash.hpp"
+
+#include <random>
+#include <iostream>
+#include <sstream>
+
+//! n distinct keys base+j*2^align, which only differ in the wJ bits above align
+template<class TRng>
+key_value_set aligned_key_value_set(TRng &rng, unsigned n, uint64_t base, unsigned align, unsigned wJ, unsigned wI)
+{
+    std::map<bit_vector,bit_vector> keys;
+    while(keys.size()<n){
+        uint64_t x=base+((rng()&((1u<<wJ)-1))<<align);
+        std::vector<int> bits;
+        for(unsigned b=0; b<wI; b++){
+            bits.push_back((x>>b)&1);
+        }
+        keys.insert(std::make_pair(bit_vector{bits}, bit_vector()));
+    }
+    return key_value_set{keys};
+}
+
+void checkRoundTrip(const char *what, int i, const BitHash &h, const key_value_set &keys)
+{
+    std::stringstream a, b;
+    h.print(a);
+    auto back=parse_bit_hash(a);
+    back.print(b);
+    if(a.str()!=b.str() || !(back==h)){
+        fprintf(stderr, "FAIL : %s hash %d did not survive print and parse\n", what, i);
+        exit(1);
+    }
+    for(const auto &kv : keys){
+        if(back(*kv.first.variants_begin())!=h(*kv.first.variants_begin())){
+            fprintf(stderr, "FAIL : parsed %s hash %d gives a different hash\n", what, i);
+            exit(1);
+        }
+    }
+}
+
+int main()
+{
+    unsigned wI=16;
+    std::mt19937 urng(1);
+
+    // A premix only needs one mixed bit per varying input, but must still be
+    // wide enough for maxHash
+    for(int i=0; i<4; i++){
+        auto keys=aligned_key_value_set(urng, 32, 0x8003, 4, 5, wI);
+        keys.setMaxHash(40+i);
+
+        auto premix=makePremix(urng, keys, 1+i);
+        auto mixed=premixKeys(premix, keys);
+        if(premix.size()!=6 || mixed.keys_size()!=keys.keys_size() || mixed.getMaxHash()!=keys.getMaxHash()){
+            fprintf(stderr, "FAIL : premix instance %d has %u bits for maxHash %u\n", i, (unsigned)premix.size(), keys.getMaxHash());
+            exit(1);
+        }
+    }
+
+    // Solve on the mixed keys, then put the premix in front, as find_fpga_hash does
+    for(int i=0; i<6; i++){
+        solve_context ctxt;
+        ctxt.urng.seed(i);
+        ctxt.verbose=0;
+        ctxt.maxTime=60;
+        ctxt.wO=6;
+        ctxt.wA=4;
+
+        auto keys=aligned_key_value_set(ctxt.urng, 40, ctxt.urng()&0xF00F, 4, 8, wI);
+        if(i>=3){
+            keys.setMaxHash(50);
+        }
+
+        auto premix=makePremix(ctxt.urng, keys, 1+(i%3));
+        auto mixed=premixKeys(premix, keys);
+        ctxt.wI=premix.size();
+
+        BitHash result;
+        bool success;
+        std::tie(result, success)=solver_walk(ctxt, mixed);
+        if(!success){
+            fprintf(stderr, "FAIL : solver_walk did not solve premixed instance %d\n", i);
+            exit(1);
+        }
+        checkRoundTrip("plain", i, result, mixed);
+
+        result.premix=premix;
+        result.wI=wI;
+        if(!result.is_solution(keys) || bruteStash(result, keys)!=0){
+            fprintf(stderr, "FAIL : premixed instance %d does not solve the original keys\n", i);
+            exit(1);
+        }
+        checkRoundTrip("premixed", i, result, keys);
+        fprintf(stderr, "  instance %d : %u mixed bits, solved in %d tries\n", i, (unsigned)premix.size(), ctxt.tries);
+    }
+
+    fprintf(stderr, "Pass\n");
+    return 0;
+}
@@ -1,13 +1,44 @@
 #include "shuffle.hpp"
+#include "weighted_shuffle.hpp"
 
 #include <random>
 #include <iostream>
 
 std::mt19937 urng;
 
+// Expected number of colliding pairs under random luts, by brute force
+double expectedCollisions(const key_value_set &keys, const std::vector<std::vector<unsigned> > &shuffle)
+{
+    std::vector<bit_vector> ks;
+    for(const auto &kv : keys){
+        ks.push_back(*kv.first.variants_begin());
+    }
+
+    double acc=0;
+    for(unsigned i=0; i<ks.size(); i++){
+        for(unsigned j=i+1; j<ks.size(); j++){
+            double p=1;
+            for(const auto &t : shuffle){
+                bool same=true;
+                for(unsigned s : t){
+                    same = same && ks[i][s]==ks[j][s];
+                }
+                p *= same ? 1 : 0.5;
+            }
+            acc += p;
+        }
+    }
+    return acc;
+}
+
 int main() {
     unsigned wO=6, wI=16, wA=6;
 
+    if(metricShuffleAddress({1,2,3}, {1,2,3})!=0 || metricShuffleAddress({1,2,3}, {4,5})!=5 || metricShuffleAddress({1,2,3}, {2,3,4})!=2){
+        std::cerr<<"FAIL : metricShuffleAddress\n";
+        exit(1);
+    }
+
     unsigned best=0;
     for (int i = 0; i < 100000; i++) {
         auto res=makeRandomShuffle(urng, wO, wI, wA);
@@ -19,4 +50,23 @@ int main() {
             best=metric;
         }
     }
+
+    // The score only looks at up to two tables at once, so is exact for two
+    for(int i=0; i<20; i++){
+        auto keys=uniform_random_key_value_set(urng, 6, 8, 0, 0.75);
+        auto res=makeRandomShuffle(urng, 2, 8, 4);
+        double got=scoreShuffle(keys, res), want=expectedCollisions(keys, res);
+        if(std::abs(got-want) > 1e-9){
+            std::cerr<<"FAIL : scoreShuffle = "<<got<<", expected "<<want<<"\n";
+            exit(1);
+        }
+
+        res=makeRandomShuffle(urng, 4, 8, 3);
+        if(scoreShuffle(keys, res) > expectedCollisions(keys, res)+1e-9){
+            std::cerr<<"FAIL : scoreShuffle should not overestimate\n";
+            exit(1);
+        }
+    }
+
+    std::cerr<<"Pass\n";
 }
@@ -0,0 +1,42 @@
+#include "bit_hash.hpp"
+#include "bit_hash_cnf.hpp"
+
+#include <random>
+#include <iostream>
+
+std::mt19937 urng;
+
+int main()
+{
+    unsigned wO=5;
+
+    // The prefilter bound must never be more than minisat can achieve. Narrow
+    // tables make collisions in table subsets likely.
+    unsigned nBound=0;
+    for(int i=0; i<20; i++){
+        auto keys=uniform_random_key_value_set(urng, wO, 8, 0, 0.9);
+        auto bh = makeBitHash(urng, wO, 8, 2);
+
+        unsigned bound=bh.stash_lower_bound(keys);
+        if(bound==0)
+            continue;
+        nBound++;
+
+        cnf_problem prob;
+        to_cnf(bh, keys.keys(), prob, 0, 1, true);
+        requireAtMostK(prob.sat, prob.stashLits, bound-1);
+        if(!minisat_solve(prob).empty()){
+            fprintf(stderr, "FAIL : bound instance %d, %u keys can't need stashing\n", i, bound);
+            exit(1);
+        }
+    }
+    fprintf(stderr, "  %u of 20 narrow shuffles rejected by the bound\n", nBound);
+    // Otherwise none of them were checked against minisat
+    if(nBound==0){
+        fprintf(stderr, "FAIL : no narrow shuffle was rejected by the bound\n");
+        exit(1);
+    }
+
+    fprintf(stderr, "Pass\n");
+    return 0;
+}
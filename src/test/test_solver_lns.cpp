@@ -0,0 +1,91 @@
+#include "bit_hash.hpp"
+#include "bit_hash_cnf.hpp"
+#include "solver_lns.hpp"
+
+#include <random>
+#include <iostream>
+
+std::mt19937 urng;
+
+// Solve with at most bound keys stashed, which is what each LNS step asks
+bool solveWithin(const BitHash &sub, const key_value_set &keys, unsigned bound)
+{
+    cnf_problem prob;
+    to_cnf(sub, keys.keys(), prob, keys.getMaxHash(), 1, true);
+    requireAtMostK(prob.sat, prob.stashLits, bound);
+    auto sol=minisat_solve(prob);
+    if(sol.empty())
+        return false;
+
+    BitHash cand=substitute(sub, prob, sol);
+    for(auto &t : cand.tables){
+        for(int &le : t.lut){
+            if(le==-1)
+                le=0;
+        }
+    }
+    if(cand.find_stash(keys).size()>bound){
+        fprintf(stderr, "FAIL : CNF solution stashes %u keys, bound is %u\n", (unsigned)cand.find_stash(keys).size(), bound);
+        exit(1);
+    }
+    return true;
+}
+
+int main()
+{
+    unsigned wO=4, wI=10, wA=3;
+
+    // Free one table and hold the others fixed, as LNS does, so that most
+    // hash bits are constants. The CNF must then agree with trying every lut.
+    for(int i=0; i<40; i++){
+        auto keys=uniform_random_key_value_set(urng, wO, wI, 0, 0.6, (i%3)==2 ? 0.05 : 0.0);
+        keys.setMaxHash(keys.keys_size()+(i%3));
+
+        auto bh=makeBitHashConcrete(urng, wO, wI, wA);
+        unsigned ti=urng()%wO;
+
+        unsigned best=UINT_MAX;
+        BitHash cand(bh);
+        auto &lut=cand.tables[ti].lut;
+        for(unsigned m=0; m<(1u<<lut.size()); m++){
+            for(unsigned a=0; a<lut.size(); a++){
+                lut[a]=(m>>a)&1;
+            }
+            best=std::min(best, (unsigned)cand.find_stash(keys).size());
+        }
+
+        BitHash sub(bh);
+        std::fill(sub.tables[ti].lut.begin(), sub.tables[ti].lut.end(), -1);
+        if(!solveWithin(sub, keys, best) || (best>0 && solveWithin(sub, keys, best-1))){
+            fprintf(stderr, "FAIL : instance %d, CNF disagrees with brute force minimum stash of %u\n", i, best);
+            exit(1);
+        }
+    }
+
+    // The whole search with maxHash, so that every step has fixed bits above the limit
+    for(int i=0; i<4; i++){
+        solve_context ctxt;
+        ctxt.urng.seed(i);
+        ctxt.verbose=0;
+        ctxt.maxTime=60;
+        ctxt.maxTries=300; // Stop the warm-start walk early, so LNS has work to do
+        ctxt.wO=6;
+        ctxt.wI=16;
+        ctxt.wA=4;
+
+        auto keys=uniform_random_key_value_set(ctxt.urng, ctxt.wO, ctxt.wI, 0, 0.7, (i%2) ? 0.02 : 0.0);
+        keys.setMaxHash(keys.keys_size()+4);
+
+        BitHash result;
+        bool success;
+        std::tie(result, success)=solver_lns(ctxt, keys);
+        if(!success || !result.is_solution(keys)){
+            fprintf(stderr, "FAIL : solver_lns did not solve instance %d\n", i);
+            exit(1);
+        }
+        fprintf(stderr, "  instance %d : %u keys below %u in %d tries\n", i, (unsigned)keys.keys_size(), keys.getMaxHash(), ctxt.tries);
+    }
+
+    fprintf(stderr, "Pass\n");
+    return 0;
+}
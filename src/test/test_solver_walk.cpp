@@ -0,0 +1,216 @@
+#include "bit_hash.hpp"
+#include "bit_hash_anneal.hpp"
+#include "solver_walk.hpp"
+
+#include <random>
+#include <iostream>
+
+std::mt19937 urng;
+
+// Check that the incrementally maintained buckets agree with a full evaluation
+void checkBuckets(const EntryToKey &et, const BitHash &bh, const key_value_set &keys)
+{
+    if(et.eval()!=EntryToKey::evalFull(bh, keys)){
+        fprintf(stderr, "FAIL : eval=%f, evalFull=%f\n", et.eval(), EntryToKey::evalFull(bh, keys));
+        exit(1);
+    }
+
+    // The score is what find_stash leaves over the allowed stash, so it is
+    // zero exactly when the hash is a solution
+    for(unsigned g=1; g<=2; g++){
+        unsigned nStash=bh.find_stash(keys, g).size();
+        double expected=nStash>keys.getMaxStash() ? nStash-keys.getMaxStash() : 0;
+        if(et.eval(g)!=expected || EntryToKey::evalFull(bh, keys, g)!=expected){
+            fprintf(stderr, "FAIL : groupSize=%u, eval=%f, evalFull=%f, but find_stash gives %u with maxStash %u\n",
+                g, et.eval(g), EntryToKey::evalFull(bh, keys, g), nStash, keys.getMaxStash());
+            exit(1);
+        }
+    }
+
+    unsigned ki=0, nShared=0;
+    for(const auto &kv : keys){
+        unsigned h=bh(*kv.first.variants_begin());
+        const auto &b=et.getBucket(h);
+        if(std::find(b.begin(), b.end(), ki)==b.end()){
+            fprintf(stderr, "FAIL : key %u is not in bucket %u\n", ki, h);
+            exit(1);
+        }
+        for(unsigned ti=0; ti<bh.wO; ti++){
+            unsigned bi=et.getKeyBit(ki, ti);
+            if(et.bits[bi].table!=ti || et.bits[bi].offset!=bh.tables[ti].address(*kv.first.variants_begin())){
+                fprintf(stderr, "FAIL : key %u has wrong bit for table %u\n", ki, ti);
+                exit(1);
+            }
+        }
+        ki++;
+    }
+    for(unsigned h=0; h<(1u<<bh.wO); h++){
+        if(et.getBucket(h).size()>1)
+            nShared++;
+    }
+    if(nShared!=et.getSharedHashes().size()){
+        fprintf(stderr, "FAIL : expected %u shared hashes, got %u\n", nShared, (unsigned)et.getSharedHashes().size());
+        exit(1);
+    }
+
+    unsigned nOutOfRange=0, nDisagree=0;
+    for(const auto &kv : keys){
+        auto it=kv.first.variants_begin();
+        unsigned h=bh(*it);
+        if(keys.getMaxHash()>0 && h>=keys.getMaxHash())
+            nOutOfRange++;
+        for(++it; it!=kv.first.variants_end(); ++it){
+            if(bh(*it)!=h)
+                nDisagree++;
+        }
+    }
+    if(nDisagree!=et.getDisagreeingVariants().size()){
+        fprintf(stderr, "FAIL : expected %u disagreeing variants, got %u\n", nDisagree, (unsigned)et.getDisagreeingVariants().size());
+        exit(1);
+    }
+    if(nOutOfRange!=et.getOutOfRangeKeys().size()){
+        fprintf(stderr, "FAIL : expected %u keys out of range, got %u\n", nOutOfRange, (unsigned)et.getOutOfRangeKeys().size());
+        exit(1);
+    }
+}
+
+int main()
+{
+    unsigned wO=6, wI=16, wA=6;
+
+    for(int i=0; i<10; i++){
+        // Odd instances have ternary keys
+        auto keys=uniform_random_key_value_set(urng, wO, wI, 0, 0.9, (i%2) ? 0.1 : 0.0);
+        if(i%4>=2){
+            keys.setMaxStash(3);
+        }
+        if(i%2){
+            keys.setMaxHash(keys.keys_size()+1);
+        }
+
+        auto bh=makeBitHashConcrete(urng, wO, wI, wA);
+        EntryToKey et(bh, keys);
+        checkBuckets(et, bh, keys);
+
+        for(int j=0; j<1000; j++){
+            et.flipBit(urng()%et.bitCount());
+        }
+        checkBuckets(et, bh, keys);
+
+        // Selector moves, which must be undone exactly by moving back
+        for(int j=0; j<100; j++){
+            unsigned ti=urng()%wO, si, ib;
+            if(!chooseTapMove(urng, et, ti, 0, 0, si, ib))
+                continue;
+            unsigned prev=bh.tables[ti].selectors[si];
+            double e=et.eval();
+            et.swapSelector(ti, si, ib);
+            checkBuckets(et, bh, keys);
+            if(j%2){
+                et.swapSelector(ti, si, prev);
+                if(et.eval()!=e){
+                    fprintf(stderr, "FAIL : selector move was not undone\n");
+                    exit(1);
+                }
+            }
+        }
+        checkBuckets(et, bh, keys);
+    }
+
+    for(int i=0; i<10; i++){
+        solve_context ctxt;
+        ctxt.urng.seed(i);
+        ctxt.verbose=0;
+        ctxt.maxTries=10000000;
+        ctxt.maxTime=60;
+        ctxt.wO=wO;
+        ctxt.wI=wI;
+        ctxt.wA=wA;
+
+        auto keys=uniform_random_key_value_set(ctxt.urng, wO, wI, 0, 0.9);
+
+        BitHash result;
+        bool success;
+        std::tie(result, success)=solver_walk(ctxt, keys);
+        if(!success || !result.is_solution(keys)){
+            fprintf(stderr, "FAIL : solver_walk did not solve instance %d\n", i);
+            exit(1);
+        }
+        fprintf(stderr, "  instance %d solved in %d tries\n", i, ctxt.tries);
+    }
+
+    // Weak-minimal hashes, using only some of the slots
+    for(int i=0; i<5; i++){
+        solve_context ctxt;
+        ctxt.urng.seed(i);
+        ctxt.verbose=0;
+        ctxt.maxTries=10000000;
+        ctxt.maxTime=60;
+        ctxt.wO=wO;
+        ctxt.wI=wI;
+        ctxt.wA=wA;
+
+        auto keys=uniform_random_key_value_set(ctxt.urng, wO, wI, 0, 0.75);
+        keys.setMaxHash(56);
+
+        BitHash result;
+        bool success;
+        std::tie(result, success)=solver_walk(ctxt, keys);
+        if(!success || !result.is_solution(keys)){
+            fprintf(stderr, "FAIL : solver_walk did not solve maxHash instance %d\n", i);
+            exit(1);
+        }
+        fprintf(stderr, "  maxHash instance %d solved in %d tries\n", i, ctxt.tries);
+    }
+
+    // Ternary keys, where all variants must hash to the same place
+    for(int i=0; i<5; i++){
+        solve_context ctxt;
+        ctxt.urng.seed(i);
+        ctxt.verbose=0;
+        ctxt.maxTries=10000000;
+        ctxt.maxTime=60;
+        ctxt.wO=wO;
+        ctxt.wI=wI;
+        ctxt.wA=wA;
+
+        auto keys=uniform_random_key_value_set(ctxt.urng, wO, wI, 0, 0.75, 0.05);
+
+        BitHash result;
+        bool success;
+        std::tie(result, success)=solver_walk(ctxt, keys);
+        if(!success || !result.is_solution(keys)){
+            fprintf(stderr, "FAIL : solver_walk did not solve ternary instance %d\n", i);
+            exit(1);
+        }
+        fprintf(stderr, "  ternary instance %d (%u variants) solved in %d tries\n", i, keys.keys_size_distinct(), ctxt.tries);
+    }
+
+    // Full load, with a few keys allowed to overflow into the stash
+    for(int i=0; i<5; i++){
+        solve_context ctxt;
+        ctxt.urng.seed(i);
+        ctxt.verbose=0;
+        ctxt.maxTries=10000000;
+        ctxt.maxTime=60;
+        ctxt.wO=wO;
+        ctxt.wI=wI;
+        ctxt.wA=wA;
+
+        auto keys=uniform_random_key_value_set(ctxt.urng, wO, wI, 0, 1.0);
+        keys.setMaxStash(4);
+
+        BitHash result;
+        bool success;
+        std::tie(result, success)=solver_walk(ctxt, keys);
+        unsigned nStash=result.find_stash(keys).size();
+        if(!success || !result.is_solution(keys) || nStash>4){
+            fprintf(stderr, "FAIL : solver_walk did not solve stash instance %d\n", i);
+            exit(1);
+        }
+        fprintf(stderr, "  stash instance %d (%u stashed) solved in %d tries\n", i, nStash, ctxt.tries);
+    }
+
+    fprintf(stderr, "Pass\n");
+    return 0;
+}
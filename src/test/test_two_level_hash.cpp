@@ -0,0 +1,84 @@
+#include "bit_hash.hpp"
+#include "two_level_hash.hpp"
+#include "solver_two_level.hpp"
+#include "brute_stash.hpp"
+
+#include <random>
+#include <iostream>
+#include <sstream>
+
+void checkRoundTrip(const TwoLevelHash &h, const key_value_set &keys)
+{
+    std::stringstream a, b;
+    h.print(a);
+    auto back=parse_two_level_hash(a);
+    back.print(b);
+    if(a.str()!=b.str()){
+        fprintf(stderr, "FAIL : two level hash did not survive print and parse\n");
+        exit(1);
+    }
+    for(const auto &kv : keys){
+        if(back(*kv.first.variants_begin())!=h(*kv.first.variants_begin())){
+            fprintf(stderr, "FAIL : parsed two level hash gives a different hash\n");
+            exit(1);
+        }
+    }
+}
+
+int main()
+{
+    unsigned wI=12;
+
+    for(int i=0; i<6; i++){
+        solve_context ctxt;
+        ctxt.urng.seed(i);
+        ctxt.verbose=0;
+        ctxt.maxTime=60;
+        ctxt.wA=4;
+        ctxt.threads=2;
+
+        // Odd instances have ternary keys
+        auto keys=uniform_random_key_value_set(ctxt.urng, 7, wI, 0, 0.6, (i%2) ? 0.05 : 0.0);
+
+        TwoLevelHash result;
+        bool success;
+        std::tie(result, success)=solve_two_level(ctxt, keys, 2);
+        if(!success || bruteStash(result, keys)!=0){
+            fprintf(stderr, "FAIL : solve_two_level did not solve instance %d\n", i);
+            exit(1);
+        }
+
+        // Every key must land in the range of its own bucket
+        for(const auto &kv : keys){
+            unsigned b=result.split(*kv.first.variants_begin()), h=result(*kv.first.variants_begin());
+            if(h<result.offsets[b] || h>=result.offsets[b+1]){
+                fprintf(stderr, "FAIL : instance %d puts a key outside its bucket\n", i);
+                exit(1);
+            }
+        }
+        if(result.offsets.back() > (1u<<result.wO)){
+            fprintf(stderr, "FAIL : instance %d has offsets beyond wO\n", i);
+            exit(1);
+        }
+        checkRoundTrip(result, keys);
+
+        // Damaged buckets must be caught the same way by both
+        for(int j=0; j<20; j++){
+            TwoLevelHash bad(result);
+            auto &bucket=bad.buckets[ctxt.urng()%bad.buckets.size()];
+            if(bucket.wO==0)
+                continue;
+            auto &t=bucket.tables[ctxt.urng()%bucket.wO];
+            int &le=t.lut[ctxt.urng()%t.lut.size()];
+            le=1-le;
+            if(bad.is_solution(keys) != (bruteStash(bad, keys)==0)){
+                fprintf(stderr, "FAIL : is_solution disagrees with brute force on instance %d\n", i);
+                exit(1);
+            }
+        }
+        fprintf(stderr, "  instance %d : %u keys in %u outputs\n", i, (unsigned)keys.keys_size(), result.offsets.back());
+    }
+
+    fprintf(stderr, "Pass\n");
+    return 0;
+}
@@ -0,0 +1,238 @@
+#include "bit_hash.hpp"
+#include "family_hash.hpp"
+
+#include "key_value_set.hpp"
+
+#include "solve_context.hpp"
+#include "solver_family.hpp"
+
+#include <random>
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <unistd.h>
+
+void print_exception(const std::exception& e, int level =  0)
+{
+    std::cerr << std::string(level, ' ') << "exception: " << e.what() << '\n';
+    try {
+        std::rethrow_if_nested(e);
+    } catch(const std::exception& e) {
+        print_exception(e, level+1);
+    } catch(...) {}
+}
+
+/* With --family, only the control word of an existing family is searched
+ * for, which is what happens when the key set changes in a deployed design.
+ * Otherwise random families are generated until one of them has a control
+ * word which works for the keys, which is what happens at design time.
+ */
+int main(int argc, char *argv[])
+{
+    solve_context ctxt;
+
+    ctxt.verbose=1;
+    std::string srcFileName="-";
+    std::string familyFileName;
+    ctxt.maxTries=INT_MAX;
+
+    int wC=3;
+    int wT=5;
+    unsigned families=100;
+    unsigned maxHash=0;
+    unsigned maxStash=0;
+
+    std::string csvLogDst;
+
+    ctxt.urng.seed(time(0));
+
+    try {
+        int ia = 1;
+        while (ia < argc) {
+            if (!strcmp(argv[ia], "--verbose")) {
+                if ((argc - ia) < 2) throw std::runtime_error("No argument to --verbose");
+                ctxt.verbose = atoi(argv[ia + 1]);
+                ia += 2;
+            } else if (!strcmp(argv[ia], "--input")) {
+                if ((argc - ia) < 2) throw std::runtime_error("No argument to --input");
+                srcFileName = argv[ia + 1];
+                ia += 2;
+            } else if (!strcmp(argv[ia], "--family")) {
+                if ((argc - ia) < 2) throw std::runtime_error("No argument to --family");
+                familyFileName = argv[ia + 1];
+                ia += 2;
+            } else if (!strcmp(argv[ia], "--csv-log")) {
+                if ((argc - ia) < 3) throw std::runtime_error("No argument to --csv-dst");
+                ctxt.csvLogPrefix = argv[ia + 1];
+                csvLogDst = argv[ia + 2];
+                ia += 3;
+            } else if (!strcmp(argv[ia], "--seed")) {
+                if ((argc - ia) < 2) throw std::runtime_error("No argument to --seed");
+                ctxt.urng.seed(atoi(argv[ia + 1]));
+                ia += 2;
+            } else if (!strcmp(argv[ia], "--wo")) {
+                if ((argc - ia) < 2) throw std::runtime_error("No argument to --wo");
+                ctxt.wO = atoi(argv[ia + 1]);
+                if (ctxt.wO < 1) throw std::runtime_error("Can't have wo < 1");
+                if (ctxt.wO > 16) throw std::runtime_error("wo > 16 is unexpectedly large (edit code if you are sure).");
+                ia += 2;
+            } else if (!strcmp(argv[ia], "--wc")) {
+                if ((argc - ia) < 2) throw std::runtime_error("No argument to --wc");
+                wC = atoi(argv[ia + 1]);
+                if (wC < 1) throw std::runtime_error("Can't have wc < 1");
+                if (wC > 8) throw std::runtime_error("wc > 8 is unexpectedly large (edit code if you are sure).");
+                ia += 2;
+            } else if (!strcmp(argv[ia], "--wt")) {
+                if ((argc - ia) < 2) throw std::runtime_error("No argument to --wt");
+                wT = atoi(argv[ia + 1]);
+                if (wT < 1) throw std::runtime_error("Can't have wt < 1");
+                ia += 2;
+            } else if (!strcmp(argv[ia], "--families")) {
+                if ((argc - ia) < 2) throw std::runtime_error("No argument to --families");
+                families = atoi(argv[ia + 1]);
+                if (families < 1) throw std::runtime_error("families must be at least 1");
+                ia += 2;
+            } else if (!strcmp(argv[ia], "--group-size")) {
+                if ((argc - ia) < 2) throw std::runtime_error("No argument to --group-size");
+                ctxt.groupSize = atoi(argv[ia + 1]);
+                if (ctxt.groupSize < 1) throw std::runtime_error("Can't have groupSize < 1");
+                ia += 2;
+            } else if (!strcmp(argv[ia], "--max-hash")) {
+                if ((argc - ia) < 2) throw std::runtime_error("No argument to --max-hash");
+                maxHash = atoi(argv[ia + 1]);
+                ia += 2;
+            } else if (!strcmp(argv[ia], "--stash")) {
+                if ((argc - ia) < 2) throw std::runtime_error("No argument to --stash");
+                maxStash = atoi(argv[ia + 1]);
+                ia += 2;
+            } else if (!strcmp(argv[ia], "--threads")) {
+                if ((argc - ia) < 2) throw std::runtime_error("No argument to --threads");
+                ctxt.threads = atoi(argv[ia + 1]);
+                if (ctxt.threads < 1) throw std::runtime_error("threads must be at least 1");
+                ia += 2;
+            } else if (!strcmp(argv[ia], "--max-time")) {
+                if ((argc - ia) < 2) throw std::runtime_error("No argument to --max-time");
+                ctxt.maxTime = strtod(argv[ia + 1], 0);
+                ia += 2;
+            } else {
+                throw std::runtime_error(std::string("Didn't understand argument ") + argv[ia]);
+            }
+        }
+
+        if(!csvLogDst.empty()){
+            if(csvLogDst=="-"){
+                ctxt.pCsvDst = &std::cout;
+            }else{
+                ctxt.csvLogFile.open(csvLogDst);
+                if(!ctxt.csvLogFile.is_open()){
+                    throw std::runtime_error("Couldn't open csv log destination.");
+                }
+                ctxt.pCsvDst=&ctxt.csvLogFile;
+            }
+        }
+
+        ctxt.logMsg(1, "Loading input from %s.\n", (srcFileName == "-" ? "<stdin>" : srcFileName.c_str()));
+
+        key_value_set problem;
+
+        if (srcFileName == "-") {
+            problem = parse_key_value_set(std::cin);
+        } else {
+            std::ifstream srcFile(srcFileName);
+            if (!srcFile.is_open())
+                throw std::runtime_error("Couldn't open source file " + srcFileName);
+            problem = parse_key_value_set(srcFile);
+        }
+
+        if(ctxt.verbose>1){
+            std::cerr << "nKeys = " << problem.size() << "\n";
+            std::cerr << "wKey = " << problem.getKeyWidth() << "\n";
+            std::cerr << "wValue = " << problem.getValueWidth() << "\n";
+        }
+
+        if(maxStash>0){
+            problem.setMaxStash(maxStash);
+        }
+        if(maxHash>0){
+            problem.setMaxHash(maxHash);
+        }
+
+        FamilyHash family;
+        bool haveFamily=!familyFileName.empty();
+        if(haveFamily){
+            std::ifstream familyFile(familyFileName);
+            if (!familyFile.is_open())
+                throw std::runtime_error("Couldn't open family file " + familyFileName);
+            family = parse_family_hash(familyFile);
+            if (family.wI < problem.getKeyWidth())
+                throw std::runtime_error("Family key width does not cover all keys.");
+            ctxt.wO = family.wO;
+            ctxt.logMsg(1, "Loaded family with wO=%u, wC=%u.\n", family.wO, family.wC);
+        }
+
+        ctxt.wI = haveFamily ? family.wI : problem.getKeyWidth();
+
+        if (ctxt.wO == -1) {
+            unsigned nKeys = problem.keys_size() - problem.getMaxStash();
+            unsigned nSlots = (nKeys + ctxt.groupSize - 1) / ctxt.groupSize;
+            ctxt.wO = (unsigned) ceil(log(nSlots) / log(2.0));
+            ctxt.logMsg(1, "Auto-selecting wO = %u  based on nKeys = %u, groupSize = %u\n", ctxt.wO, nKeys, ctxt.groupSize);
+        }
+        if ((1u << ctxt.wO)*ctxt.groupSize + problem.getMaxStash() < problem.keys_size()) {
+            throw std::runtime_error("Output width cannot span number of keys.");
+        }
+        if (maxHash > (1u << ctxt.wO)) {
+            throw std::runtime_error("max-hash is larger than the output range 2^wo.");
+        }
+        if (ctxt.wO*(haveFamily ? family.wC : wC) > 64) {
+            throw std::runtime_error("Control word is limited to 64 bits (wo*wc <= 64).");
+        }
+
+        ctxt.startTime=cpuTime();
+
+        bool success=false;
+        if(haveFamily){
+            success=search_family_control(ctxt, family, problem);
+        }else{
+            for(unsigned i=0; i<families && !success && cpuTime()<ctxt.maxTime; i++){
+                ctxt.tries=i;
+                family=makeFamilyHash(ctxt.urng, ctxt.wO, ctxt.wI, wC, wT);
+                success=search_family_control(ctxt, family, problem);
+                ctxt.logMsg(2, "  Family %u : %s\n", i, success ? "found control word" : "no control word");
+            }
+        }
+
+        // The search bound is exact, but a wrong answer here would be silent
+        if(success && !family.is_solution(problem, ctxt.groupSize)){
+            throw std::runtime_error("Control word failed post solution check.");
+        }
+
+        double solveTime=cpuTime()-ctxt.startTime;
+        ctxt.logCsv("SolveTime", solveTime);
+        ctxt.logMsg(1, "Solve time = %f\n", solveTime);
+
+        ctxt.logCsv("Result", success?"Success":"OutOfAttempts");
+
+        ctxt.logMsg(0, success?"Success\n":"OutOfAttempts\n");
+
+        if (!success) {
+            exit(1);
+        }
+
+        ctxt.logMsg(1, "Control word = 0x%llx\n", (unsigned long long)family.control_word());
+
+        // Print the two back to back
+        family.print(std::cout);
+        problem.print(std::cout);
+
+    }catch(std::exception &e){
+        ctxt.logCsv("Result", "Exception");
+
+        std::cerr<<"Caught exception : ";
+        print_exception(e);
+        std::cerr.flush();
+        _exit(3);
+    }
+
+    return 0;
+}
@@ -9,6 +9,16 @@
 #include "solver_cnf.hpp"
 #include "solver_anneal.hpp"
 #include "solver_grasp.hpp"
+#include "solver_walk.hpp"
+#include "solver_tabu.hpp"
+#include "solver_hybrid.hpp"
+#include "solver_lns.hpp"
+#include "distinguishing_bits.hpp"
+#include "concentrated_hash.hpp"
+#include "solver_concentrator.hpp"
+#include "linear_hash.hpp"
+#include "solver_linear.hpp"
+#include "premix.hpp"
 
 #include <random>
 #include <iostream>
@@ -104,6 +114,13 @@ int main(int argc, char *argv[])
 
     ctxt.tapSelectMethod="default";
     unsigned maxHash=0;
+    unsigned maxStash=0;
+    bool reduceInputs=false;
+    unsigned concentrate=0;
+    std::string concentrator="xor";
+    double linearFallback=0;
+    bool usePremix=false;
+    unsigned premixWeight=2;
 
     double solveTime=0.0;
     std::string csvLogDst;
@@ -167,10 +184,80 @@ int main(int argc, char *argv[])
                 if ((argc - ia) < 2) throw std::runtime_error("No argument to --tap-select-method");
                 ctxt.tapSelectMethod = argv[ia + 1];
                 ia += 2;
+            } else if (!strcmp(argv[ia], "--walk-noise")) {
+                if ((argc - ia) < 2) throw std::runtime_error("No argument to --walk-noise");
+                ctxt.walkNoise = strtod(argv[ia + 1], 0);
+                if (ctxt.walkNoise < 0 || ctxt.walkNoise > 1) throw std::runtime_error("walk-noise must be in [0,1]");
+                ia += 2;
+            } else if (!strcmp(argv[ia], "--tap-move-prob")) {
+                if ((argc - ia) < 2) throw std::runtime_error("No argument to --tap-move-prob");
+                ctxt.tapMoveProb = strtod(argv[ia + 1], 0);
+                if (ctxt.tapMoveProb < 0 || ctxt.tapMoveProb > 1) throw std::runtime_error("tap-move-prob must be in [0,1]");
+                ia += 2;
+            } else if (!strcmp(argv[ia], "--tabu-tenure")) {
+                if ((argc - ia) < 2) throw std::runtime_error("No argument to --tabu-tenure");
+                ctxt.tabuTenure = atoi(argv[ia + 1]);
+                if (ctxt.tabuTenure < 1) throw std::runtime_error("tabu-tenure must be at least 1");
+                ia += 2;
+            } else if (!strcmp(argv[ia], "--threads")) {
+                if ((argc - ia) < 2) throw std::runtime_error("No argument to --threads");
+                ctxt.threads = atoi(argv[ia + 1]);
+                if (ctxt.threads < 1) throw std::runtime_error("threads must be at least 1");
+                ia += 2;
+            } else if (!strcmp(argv[ia], "--hybrid-time")) {
+                if ((argc - ia) < 2) throw std::runtime_error("No argument to --hybrid-time");
+                ctxt.hybridTime = strtod(argv[ia + 1], 0);
+                if (ctxt.hybridTime <= 0) throw std::runtime_error("hybrid-time must be positive");
+                ia += 2;
+            } else if (!strcmp(argv[ia], "--tap-candidates")) {
+                if ((argc - ia) < 2) throw std::runtime_error("No argument to --tap-candidates");
+                ctxt.tapCandidates = atoi(argv[ia + 1]);
+                if (ctxt.tapCandidates < 1) throw std::runtime_error("tap-candidates must be at least 1");
+                ia += 2;
+            } else if (!strcmp(argv[ia], "--shuffle-candidates")) {
+                if ((argc - ia) < 2) throw std::runtime_error("No argument to --shuffle-candidates");
+                ctxt.shuffleCandidates = atoi(argv[ia + 1]);
+                if (ctxt.shuffleCandidates < 1) throw std::runtime_error("shuffle-candidates must be at least 1");
+                ia += 2;
+            } else if (!strcmp(argv[ia], "--group-size")) {
+                if ((argc - ia) < 2) throw std::runtime_error("No argument to --group-size");
+                ctxt.groupSize = atoi(argv[ia + 1]);
+                if (ctxt.groupSize < 1) throw std::runtime_error("Can't have groupSize < 1");
+                ia += 2;
             } else if (!strcmp(argv[ia], "--max-hash")) {
                 if ((argc - ia) < 2) throw std::runtime_error("No argument to --max-hash");
                 maxHash = atoi(argv[ia + 1]);
                 ia += 2;
+            } else if (!strcmp(argv[ia], "--stash")) {
+                if ((argc - ia) < 2) throw std::runtime_error("No argument to --stash");
+                maxStash = atoi(argv[ia + 1]);
+                ia += 2;
+            } else if (!strcmp(argv[ia], "--reduce-inputs")) {
+                reduceInputs = true;
+                ia += 1;
+            } else if (!strcmp(argv[ia], "--concentrate")) {
+                if ((argc - ia) < 2) throw std::runtime_error("No argument to --concentrate");
+                concentrate = atoi(argv[ia + 1]);
+                if (concentrate < 1) throw std::runtime_error("Can't concentrate to less than one bit");
+                ia += 2;
+            } else if (!strcmp(argv[ia], "--concentrator")) {
+                if ((argc - ia) < 2) throw std::runtime_error("No argument to --concentrator");
+                concentrator = argv[ia + 1];
+                if (concentrator!="xor" && concentrator!="lut") throw std::runtime_error("concentrator must be xor or lut");
+                ia += 2;
+            } else if (!strcmp(argv[ia], "--premix")) {
+                usePremix = true;
+                ia += 1;
+            } else if (!strcmp(argv[ia], "--premix-weight")) {
+                if ((argc - ia) < 2) throw std::runtime_error("No argument to --premix-weight");
+                premixWeight = atoi(argv[ia + 1]);
+                if (premixWeight < 1) throw std::runtime_error("premix-weight must be at least 1");
+                usePremix = true;
+                ia += 2;
+            } else if (!strcmp(argv[ia], "--linear-fallback")) {
+                if ((argc - ia) < 2) throw std::runtime_error("No argument to --linear-fallback");
+                linearFallback = strtod(argv[ia + 1], 0);
+                ia += 2;
             } else if (!strcmp(argv[ia], "--minimal")) {
                 if ((argc - ia) < 1) throw std::runtime_error("No argument to --minimal");
                 maxHash = UINT_MAX;
@@ -197,8 +284,14 @@ int main(int argc, char *argv[])
 
         }
 
-        ctxt.logMsg(1, "Setting limits of %f seconds CPU time and %f MB of memory.\n", ctxt.maxTime, ctxt.maxMem);
-        setTimeAndSpaceLimit(ctxt.maxTime, ctxt.maxMem);
+        // The hard limit leaves room for the linear fallback after the luts,
+        // plus a second, as solve_linear only looks at the time now and then
+        double cpuLimit = ctxt.maxTime;
+        if(cpuLimit>0 && linearFallback>0){
+            cpuLimit += linearFallback+1;
+        }
+        ctxt.logMsg(1, "Setting limits of %f seconds CPU time and %f MB of memory.\n", cpuLimit, ctxt.maxMem);
+        setTimeAndSpaceLimit(cpuLimit, ctxt.maxMem);
 
         if (ctxt.tapSelectMethod == "default") {
             ctxt.tapSelectMethod = "minisat_weighted";
@@ -229,6 +322,11 @@ int main(int argc, char *argv[])
             std::cerr << "wValue = " << problem.getValueWidth() << "\n";
         }
 
+        if(maxStash>0){
+            ctxt.logMsg(1," Allowing up to %u keys in the stash.\n", maxStash);
+            problem.setMaxStash(maxStash);
+        }
+
         if(maxHash==UINT_MAX){
             ctxt.logMsg(1," Building minimal hash.\n");
             problem.setMaxHash(maxHash);
@@ -247,39 +345,197 @@ int main(int argc, char *argv[])
         }
 
         if (ctxt.wO == -1) {
-            unsigned nKeys = problem.keys_size();
-            ctxt.wO = (unsigned) ceil(log(nKeys) / log(2.0));
-            ctxt.logMsg(1, "Auto-selecting wO = %u  based on nKeys = %u\n", ctxt.wO, nKeys);
+            unsigned nKeys = problem.keys_size() - problem.getMaxStash();
+            unsigned nSlots = (nKeys + ctxt.groupSize - 1) / ctxt.groupSize;
+            ctxt.wO = (unsigned) ceil(log(nSlots) / log(2.0));
+            ctxt.logMsg(1, "Auto-selecting wO = %u  based on nKeys = %u, groupSize = %u\n", ctxt.wO, nKeys, ctxt.groupSize);
         } else {
-            if ((1u << ctxt.wO) < problem.keys_size()) {
+            if ((1u << ctxt.wO)*ctxt.groupSize + problem.getMaxStash() < problem.keys_size()) {
                 throw std::runtime_error("Specified output width cannot span number of keys.");
             }
         }
         if (ctxt.verbose > 0) {
-            std::cerr << "Group load factor is 2^wO / nKeyGroups = " << problem.keys_size() << " / " << (1 << ctxt.wO) <<
-            " = " << problem.keys_size() / (double) (1 << ctxt.wO) << "\n";
-            std::cerr << "True load factor is 2^wO / nKeysDistinct = " << problem.keys_size_distinct() << " / " <<
-            (1 << ctxt.wO) << " = " << problem.keys_size_distinct() / (double) (1 << ctxt.wO) << "\n";
+            unsigned nSlots = (1u << ctxt.wO)*ctxt.groupSize;
+            std::cerr << "Group load factor is nKeyGroups / (2^wO*groupSize) = " << problem.keys_size() << " / " << nSlots <<
+            " = " << problem.keys_size() / (double) nSlots << "\n";
+            std::cerr << "True load factor is nKeysDistinct / (2^wO*groupSize) = " << problem.keys_size_distinct() << " / " <<
+            nSlots << " = " << problem.keys_size_distinct() / (double) nSlots << "\n";
         }
 
         BitHash result;
         bool success;
+        std::vector<bit_vector> stash; // Only for maxsat
+        bool optimal=false;
 
         ctxt.startTime=cpuTime();
 
+        // Bring the keys down to concentrate bits with a stage that only has
+        // to be injective, then solve the perfect hash on the narrow keys
+        key_value_set wideProblem;
+        BitHash front;
+        int wIWide=ctxt.wI;
+        if(concentrate>0){
+            if(concentrate >= (unsigned)ctxt.wI)
+                throw std::runtime_error("Concentrating to at least wI bits would not make the key narrower.");
+            if((1ull<<concentrate) < problem.keys_size())
+                throw std::runtime_error("Concentrated key cannot span number of keys.");
+            if(problem.getMaxHash() > (1ull<<concentrate))
+                throw std::runtime_error("Concentrated key cannot span maxHash, so --concentrate must be at least log2(maxHash).");
+
+            bool ok;
+            if(concentrator=="lut"){
+                std::tie(front, ok)=solve_concentrator_lut(ctxt, problem, concentrate);
+            }else{
+                std::tie(front, ok)=solve_concentrator_xor(ctxt, problem, concentrate);
+            }
+            ctxt.logMsg(1, "Concentrator (%s) to %u bits : %s after %f seconds.\n", concentrator.c_str(), concentrate, ok ? "injective" : "failed", cpuTime()-ctxt.startTime);
+            ctxt.logCsv("ConcentrateTime", cpuTime()-ctxt.startTime);
+            if(!ok){
+                ctxt.logCsv("Result", "OutOfAttempts");
+                ctxt.logMsg(0, "OutOfAttempts");
+                exit(1);
+            }
+            ctxt.tries=0;
+            wideProblem=problem;
+            problem=concentrateKeys(front, wideProblem);
+            ctxt.wI=concentrate;
+        }
+
+        // Spread the entropy of structured keys over more bits with an XOR
+        // level, solve on the mixed keys, then put the premix in front
+        key_value_set unmixedProblem;
+        std::vector<std::vector<unsigned> > premix;
+        int wIUnmixed=ctxt.wI;
+        if(usePremix){
+            if(concentrate>0)
+                throw std::runtime_error("Can't combine --premix with --concentrate.");
+            premix=makePremix(ctxt.urng, problem, premixWeight);
+            ctxt.logMsg(1, "Premix of %u bits, each the XOR of at most %u inputs.\n", (unsigned)premix.size(), premixWeight);
+            ctxt.logCsv("PremixBits", premix.size());
+            unmixedProblem=problem;
+            problem=premixKeys(premix, unmixedProblem);
+            ctxt.wI=premix.size();
+        }
+
+        // Solve using only the inputs needed to tell the keys apart, then
+        // map the taps back onto the original inputs afterwards
+        key_value_set fullProblem;
+        std::vector<unsigned> inputBits;
+        int wIFull=ctxt.wI;
+        if(reduceInputs && problem.keys_size()>1){
+            inputBits=findDistinguishingBits(problem, 100000);
+            inputBits=widenForMaxHash(inputBits, ctxt.wI, problem.getMaxHash());
+            ctxt.logMsg(1, "Reduced to %u of %u inputs.\n", (unsigned)inputBits.size(), ctxt.wI);
+            ctxt.logCsv("ReducedInputs", inputBits.size());
+            fullProblem=problem;
+            problem=projectKeys(fullProblem, inputBits);
+            ctxt.wI=inputBits.size();
+        }
+
         if(method=="minisat") {
             std::tie(result, success) = solve_cnf(ctxt, problem);
+        }else if(method=="minisat_mux") {
+            std::tie(result, success) = solve_cnf_mux(ctxt, problem);
         }else if(method=="anneal") {
             std::tie(result, success) = solver_anneal(ctxt, problem);
         }else if(method=="grasp") {
             std::tie(result, success) = solver_grasp(ctxt, problem);
+        }else if(method=="walk") {
+            std::tie(result, success) = solver_walk(ctxt, problem);
+        }else if(method=="tabu") {
+            std::tie(result, success) = solver_tabu(ctxt, problem);
+        }else if(method=="hybrid") {
+            std::tie(result, success) = solver_hybrid(ctxt, problem);
+        }else if(method=="lns") {
+            std::tie(result, success) = solver_lns(ctxt, problem);
+        }else if(method=="maxsat") {
+            // Always produces a hash if it can, with any colliding keys in a stash
+            std::tie(result, stash, optimal) = solve_cnf_maxsat(ctxt, problem);
+            success = !result.tables.empty();
         }else{
             throw std::runtime_error("Didn't understand method '"+method+"'");
         }
 
+        if(!inputBits.empty()){
+            problem=fullProblem;
+            ctxt.wI=wIFull;
+            if(success){
+                result=unprojectBitHash(result, inputBits, wIFull);
+                stash=result.find_stash(problem, ctxt.groupSize);
+            }
+        }
+
+        if(usePremix){
+            problem=unmixedProblem;
+            ctxt.wI=wIUnmixed;
+            if(success){
+                result.premix=premix;
+                result.wI=wIUnmixed;
+                stash=result.find_stash(problem, ctxt.groupSize);
+            }
+        }
+
+        // The stash holds the keys as the hash saw them, so with a concentrator
+        // log the wide keys they came from
+        auto wideStash=[&](const std::vector<bit_vector> &keys) -> std::vector<bit_vector>
+        {
+            if(concentrate==0)
+                return keys;
+            std::map<bit_vector,bit_vector> wideOf;
+            for(const auto &kv : wideProblem){
+                wideOf.insert(std::make_pair(concentrateKey(front, kv.first), kv.first));
+            }
+            std::vector<bit_vector> res;
+            for(const auto &k : keys){
+                res.push_back(wideOf.at(k));
+            }
+            return res;
+        };
+
+        if(success && method=="maxsat"){
+            stash=wideStash(stash);
+            // Only optimal for the taps it was found with, as other shuffles may do better
+            ctxt.logMsg(0, "Collisions = %u (%s)\n", (unsigned)stash.size(), optimal ? "optimal for shuffle" : "best known");
+            ctxt.logCsv("Collisions", stash.size());
+            ctxt.logCsv("OptimalForShuffle", optimal ? 1 : 0);
+            for(const auto &k : stash){
+                if(ctxt.verbose>0){
+                    std::cerr<<"  stash : "<<k<<"\n";
+                }
+                ctxt.logCsv("StashKey", k);
+            }
+        }
+
         double finishTime=cpuTime();
         solveTime=finishTime-ctxt.startTime;
 
+        if(success && method!="maxsat" && problem.getMaxStash()>0){
+            auto stash=wideStash(result.find_stash(problem, ctxt.groupSize));
+            ctxt.logMsg(0, "Stashed = %u\n", (unsigned)stash.size());
+            ctxt.logCsv("Stashed", stash.size());
+            for(const auto &k : stash){
+                ctxt.logCsv("StashKey", k);
+            }
+        }
+
+        // The luts ran out of time, so give a linear hash (see solver_linear.hpp)
+        // a few more seconds, which is often enough for dense keys
+        if(!success && linearFallback>0 && concentrate==0){
+            ctxt.maxTime=cpuTime()+linearFallback;
+            LinearHash linear;
+            bool ok;
+            std::tie(linear, ok)=solve_linear(ctxt, problem);
+            ctxt.logMsg(1, "Linear fallback : %s after %f seconds.\n", ok ? "found" : "failed", cpuTime()-finishTime);
+            ctxt.logCsv("LinearFallback", ok ? 1 : 0);
+            if(ok){
+                ctxt.logCsv("Result", "Success");
+                ctxt.logMsg(0, "Success");
+                linear.print(std::cout);
+                problem.print(std::cout);
+                return 0;
+            }
+        }
+
         ctxt.logCsv("Result", success?"Success":"OutOfAttempts");
 
         ctxt.logMsg(0, success?"Success":"OutOfAttempts");
@@ -296,8 +552,18 @@ int main(int argc, char *argv[])
             }
         }
         // Print the two back to back
-        result.print(std::cout);
-        problem.print(std::cout);
+        if(concentrate>0){
+            ConcentratedHash ch;
+            ch.wI=wIWide;
+            ch.wO=result.wO;
+            ch.front=front;
+            ch.back=result;
+            ch.print(std::cout);
+            wideProblem.print(std::cout);
+        }else{
+            result.print(std::cout);
+            problem.print(std::cout);
+        }
 
     }catch(Minisat::OutOfMemoryException &e){
 
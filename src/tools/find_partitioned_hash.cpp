@@ -0,0 +1,171 @@
+#include "bit_hash.hpp"
+#include "partitioned_hash.hpp"
+
+#include "key_value_set.hpp"
+
+#include "solve_context.hpp"
+#include "solver_partitioned.hpp"
+
+#include <random>
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <unistd.h>
+
+void print_exception(const std::exception& e, int level =  0)
+{
+    std::cerr << std::string(level, ' ') << "exception: " << e.what() << '\n';
+    try {
+        std::rethrow_if_nested(e);
+    } catch(const std::exception& e) {
+        print_exception(e, level+1);
+    } catch(...) {}
+}
+
+int main(int argc, char *argv[])
+{
+    solve_context ctxt;
+
+    ctxt.verbose=1;
+    std::string srcFileName="-";
+    ctxt.maxTries=INT_MAX;
+    ctxt.wA=6;
+
+    unsigned selectorCandidates=64;
+    unsigned maxHash=0;
+
+    std::string csvLogDst;
+
+    ctxt.urng.seed(time(0));
+
+    try {
+        int ia = 1;
+        while (ia < argc) {
+            if (!strcmp(argv[ia], "--verbose")) {
+                if ((argc - ia) < 2) throw std::runtime_error("No argument to --verbose");
+                ctxt.verbose = atoi(argv[ia + 1]);
+                ia += 2;
+            } else if (!strcmp(argv[ia], "--input")) {
+                if ((argc - ia) < 2) throw std::runtime_error("No argument to --input");
+                srcFileName = argv[ia + 1];
+                ia += 2;
+            } else if (!strcmp(argv[ia], "--csv-log")) {
+                if ((argc - ia) < 3) throw std::runtime_error("No argument to --csv-dst");
+                ctxt.csvLogPrefix = argv[ia + 1];
+                csvLogDst = argv[ia + 2];
+                ia += 3;
+            } else if (!strcmp(argv[ia], "--seed")) {
+                if ((argc - ia) < 2) throw std::runtime_error("No argument to --seed");
+                ctxt.urng.seed(atoi(argv[ia + 1]));
+                ia += 2;
+            } else if (!strcmp(argv[ia], "--wo")) {
+                if ((argc - ia) < 2) throw std::runtime_error("No argument to --wo");
+                ctxt.wO = atoi(argv[ia + 1]);
+                if (ctxt.wO < 2) throw std::runtime_error("Can't have wo < 2");
+                if (ctxt.wO > 16) throw std::runtime_error("wo > 16 is unexpectedly large (edit code if you are sure).");
+                ia += 2;
+            } else if (!strcmp(argv[ia], "--wa")) {
+                if ((argc - ia) < 2) throw std::runtime_error("No argument to --wa");
+                ctxt.wA = atoi(argv[ia + 1]);
+                if (ctxt.wA < 2) throw std::runtime_error("Can't have wa < 2");
+                if (ctxt.wA > 12) throw std::runtime_error("wa > 12 is unexpectedly large (edit code if you are sure).");
+                ia += 2;
+            } else if (!strcmp(argv[ia], "--selector-candidates")) {
+                if ((argc - ia) < 2) throw std::runtime_error("No argument to --selector-candidates");
+                selectorCandidates = atoi(argv[ia + 1]);
+                if (selectorCandidates < 1) throw std::runtime_error("selector-candidates must be at least 1");
+                ia += 2;
+            } else if (!strcmp(argv[ia], "--group-size")) {
+                if ((argc - ia) < 2) throw std::runtime_error("No argument to --group-size");
+                ctxt.groupSize = atoi(argv[ia + 1]);
+                if (ctxt.groupSize < 1) throw std::runtime_error("Can't have groupSize < 1");
+                ia += 2;
+            } else if (!strcmp(argv[ia], "--max-hash")) {
+                if ((argc - ia) < 2) throw std::runtime_error("No argument to --max-hash");
+                maxHash = atoi(argv[ia + 1]);
+                ia += 2;
+            } else if (!strcmp(argv[ia], "--max-time")) {
+                if ((argc - ia) < 2) throw std::runtime_error("No argument to --max-time");
+                ctxt.maxTime = strtod(argv[ia + 1], 0);
+                ia += 2;
+            } else {
+                throw std::runtime_error(std::string("Didn't understand argument ") + argv[ia]);
+            }
+        }
+
+        if(!csvLogDst.empty()){
+            if(csvLogDst=="-"){
+                ctxt.pCsvDst = &std::cout;
+            }else{
+                ctxt.csvLogFile.open(csvLogDst);
+                if(!ctxt.csvLogFile.is_open()){
+                    throw std::runtime_error("Couldn't open csv log destination.");
+                }
+                ctxt.pCsvDst=&ctxt.csvLogFile;
+            }
+        }
+
+        ctxt.logMsg(1, "Loading input from %s.\n", (srcFileName == "-" ? "<stdin>" : srcFileName.c_str()));
+
+        key_value_set problem;
+
+        if (srcFileName == "-") {
+            problem = parse_key_value_set(std::cin);
+        } else {
+            std::ifstream srcFile(srcFileName);
+            if (!srcFile.is_open())
+                throw std::runtime_error("Couldn't open source file " + srcFileName);
+            problem = parse_key_value_set(srcFile);
+        }
+
+        if(ctxt.verbose>1){
+            std::cerr << "nKeys = " << problem.size() << "\n";
+            std::cerr << "wKey = " << problem.getKeyWidth() << "\n";
+            std::cerr << "wValue = " << problem.getValueWidth() << "\n";
+        }
+
+        if(maxHash>0){
+            problem.setMaxHash(maxHash);
+        }
+
+        ctxt.wI = problem.getKeyWidth();
+
+        if (ctxt.wO == -1) {
+            unsigned nSlots = (problem.keys_size() + ctxt.groupSize - 1) / ctxt.groupSize;
+            ctxt.wO = std::max(2u, (unsigned) ceil(log(nSlots) / log(2.0)));
+            ctxt.logMsg(1, "Auto-selecting wO = %u  based on nKeys = %u, groupSize = %u\n", ctxt.wO, problem.keys_size(), ctxt.groupSize);
+        }
+
+        ctxt.startTime=cpuTime();
+
+        PartitionedHash result;
+        bool success;
+        std::tie(result, success)=solve_partitioned(ctxt, problem, selectorCandidates);
+
+        double solveTime=cpuTime()-ctxt.startTime;
+        ctxt.logCsv("SolveTime", solveTime);
+        ctxt.logMsg(1, "Solve time = %f\n", solveTime);
+
+        ctxt.logCsv("Result", success?"Success":"OutOfAttempts");
+
+        ctxt.logMsg(0, success?"Success\n":"OutOfAttempts\n");
+
+        if (!success) {
+            exit(1);
+        }
+
+        // Print the two back to back
+        result.print(std::cout);
+        problem.print(std::cout);
+
+    }catch(std::exception &e){
+        ctxt.logCsv("Result", "Exception");
+
+        std::cerr<<"Caught exception : ";
+        print_exception(e);
+        std::cerr.flush();
+        _exit(3);
+    }
+
+    return 0;
+}
@@ -0,0 +1,176 @@
+#include "bit_hash.hpp"
+#include "two_level_hash.hpp"
+
+#include "key_value_set.hpp"
+
+#include "solve_context.hpp"
+#include "solver_two_level.hpp"
+
+#include <random>
+#include <iostream>
+#include <fstream>
+#include <cstring>
+
+void print_exception(const std::exception& e, int level =  0)
+{
+    std::cerr << std::string(level, ' ') << "exception: " << e.what() << '\n';
+    try {
+        std::rethrow_if_nested(e);
+    } catch(const std::exception& e) {
+        print_exception(e, level+1);
+    } catch(...) {}
+}
+
+int main(int argc, char *argv[])
+{
+    solve_context ctxt;
+
+    ctxt.verbose=1;
+    std::string srcFileName="-";
+    ctxt.maxTries=INT_MAX;
+    ctxt.wA=6;
+
+    int wB=-1;
+    double bucketLoad=0.8;
+    unsigned splitCandidates=16;
+
+    std::string csvLogDst;
+
+    ctxt.urng.seed(time(0));
+
+    try {
+        int ia = 1;
+        while (ia < argc) {
+            if (!strcmp(argv[ia], "--verbose")) {
+                if ((argc - ia) < 2) throw std::runtime_error("No argument to --verbose");
+                ctxt.verbose = atoi(argv[ia + 1]);
+                ia += 2;
+            } else if (!strcmp(argv[ia], "--input")) {
+                if ((argc - ia) < 2) throw std::runtime_error("No argument to --input");
+                srcFileName = argv[ia + 1];
+                ia += 2;
+            } else if (!strcmp(argv[ia], "--csv-log")) {
+                if ((argc - ia) < 3) throw std::runtime_error("No argument to --csv-dst");
+                ctxt.csvLogPrefix = argv[ia + 1];
+                csvLogDst = argv[ia + 2];
+                ia += 3;
+            } else if (!strcmp(argv[ia], "--seed")) {
+                if ((argc - ia) < 2) throw std::runtime_error("No argument to --seed");
+                ctxt.urng.seed(atoi(argv[ia + 1]));
+                ia += 2;
+            } else if (!strcmp(argv[ia], "--wa")) {
+                if ((argc - ia) < 2) throw std::runtime_error("No argument to --wa");
+                ctxt.wA = atoi(argv[ia + 1]);
+                if (ctxt.wA < 1) throw std::runtime_error("Can't have wa < 1");
+                if (ctxt.wA > 6) throw std::runtime_error("Bucket luts are limited to wa <= 6.");
+                ia += 2;
+            } else if (!strcmp(argv[ia], "--bucket-bits")) {
+                if ((argc - ia) < 2) throw std::runtime_error("No argument to --bucket-bits");
+                wB = atoi(argv[ia + 1]);
+                if (wB < 1) throw std::runtime_error("Can't have bucket-bits < 1");
+                if (wB > 20) throw std::runtime_error("bucket-bits > 20 is unexpectedly large (edit code if you are sure).");
+                ia += 2;
+            } else if (!strcmp(argv[ia], "--bucket-load")) {
+                if ((argc - ia) < 2) throw std::runtime_error("No argument to --bucket-load");
+                bucketLoad = strtod(argv[ia + 1], 0);
+                if (bucketLoad <= 0 || bucketLoad > 1) throw std::runtime_error("bucket-load must be in (0,1]");
+                ia += 2;
+            } else if (!strcmp(argv[ia], "--split-candidates")) {
+                if ((argc - ia) < 2) throw std::runtime_error("No argument to --split-candidates");
+                splitCandidates = atoi(argv[ia + 1]);
+                if (splitCandidates < 1) throw std::runtime_error("split-candidates must be at least 1");
+                ia += 2;
+            } else if (!strcmp(argv[ia], "--threads")) {
+                if ((argc - ia) < 2) throw std::runtime_error("No argument to --threads");
+                ctxt.threads = atoi(argv[ia + 1]);
+                if (ctxt.threads < 1) throw std::runtime_error("threads must be at least 1");
+                ia += 2;
+            } else if (!strcmp(argv[ia], "--max-time")) {
+                if ((argc - ia) < 2) throw std::runtime_error("No argument to --max-time");
+                ctxt.maxTime = strtod(argv[ia + 1], 0);
+                ia += 2;
+            } else if (!strcmp(argv[ia], "--walk-noise")) {
+                if ((argc - ia) < 2) throw std::runtime_error("No argument to --walk-noise");
+                ctxt.walkNoise = strtod(argv[ia + 1], 0);
+                if (ctxt.walkNoise < 0 || ctxt.walkNoise > 1) throw std::runtime_error("walk-noise must be in [0,1]");
+                ia += 2;
+            } else {
+                throw std::runtime_error(std::string("Didn't understand argument ") + argv[ia]);
+            }
+        }
+
+        if(!csvLogDst.empty()){
+            if(csvLogDst=="-"){
+                ctxt.pCsvDst = &std::cout;
+            }else{
+                ctxt.csvLogFile.open(csvLogDst);
+                if(!ctxt.csvLogFile.is_open()){
+                    throw std::runtime_error("Couldn't open csv log destination.");
+                }
+                ctxt.pCsvDst=&ctxt.csvLogFile;
+            }
+        }
+
+        ctxt.logMsg(1, "Loading input from %s.\n", (srcFileName == "-" ? "<stdin>" : srcFileName.c_str()));
+
+        key_value_set problem;
+
+        if (srcFileName == "-") {
+            problem = parse_key_value_set(std::cin);
+        } else {
+            std::ifstream srcFile(srcFileName);
+            if (!srcFile.is_open())
+                throw std::runtime_error("Couldn't open source file " + srcFileName);
+            problem = parse_key_value_set(srcFile);
+        }
+
+        if(ctxt.verbose>1){
+            std::cerr << "nKeys = " << problem.size() << "\n";
+            std::cerr << "wKey = " << problem.getKeyWidth() << "\n";
+            std::cerr << "wValue = " << problem.getValueWidth() << "\n";
+        }
+
+        ctxt.wI = problem.getKeyWidth();
+
+        if (wB == -1) {
+            // About eight keys per bucket, which walk solves almost instantly
+            wB = 1;
+            while((8u<<wB) < problem.keys_size()){
+                wB++;
+            }
+            ctxt.logMsg(1, "Auto-selecting bucket-bits = %u based on nKeys = %u\n", wB, problem.keys_size());
+        }
+
+        ctxt.startTime=cpuTime();
+
+        TwoLevelHash result;
+        bool success;
+        std::tie(result, success)=solve_two_level(ctxt, problem, wB, bucketLoad, splitCandidates);
+
+        double solveTime=cpuTime()-ctxt.startTime;
+        ctxt.logCsv("SolveTime", solveTime);
+        ctxt.logMsg(1, "Solve time = %f\n", solveTime);
+
+        ctxt.logCsv("Result", success?"Success":"OutOfAttempts");
+
+        ctxt.logMsg(0, success?"Success\n":"OutOfAttempts\n");
+
+        if (!success) {
+            exit(1);
+        }
+
+        // Print the two back to back
+        result.print(std::cout);
+        problem.print(std::cout);
+
+    }catch(std::exception &e){
+        ctxt.logCsv("Result", "Exception");
+
+        std::cerr<<"Caught exception : ";
+        print_exception(e);
+        std::cerr.flush();
+        _exit(3);
+    }
+
+    return 0;
+}
@@ -3,7 +3,9 @@
 
 #include "key_value_set.hpp"
 #include "weighted_shuffle.hpp"
-#include "bit_hash_history.hpp"
+
+#include "solve_context.hpp"
+#include "solver_tabu.hpp"
 
 #include <random>
 #include <iostream>
@@ -13,11 +15,6 @@
 #include <sys/time.h>
 #include <sys/resource.h>
 #include <signal.h>
-#include <queue>
-
-std::mt19937 urng;
-
-
 
 void print_exception(const std::exception& e, int level =  0)
 {
@@ -31,17 +28,19 @@ void print_exception(const std::exception& e, int level =  0)
 
 int main(int argc, char *argv[])
 {
-    int verbose=2;
-    int wA=6;
+    solve_context ctxt;
+
+    ctxt.verbose=2;
     std::string srcFileName="-";
-    int maxTries=INT_MAX;
-    int wO=-1;
-    int wI=-1;
-    int wV=-1;
-    double maxTime=600;
-    int groupSize=1;
+    ctxt.maxTries=INT_MAX;
+    ctxt.maxTime=600;
+
+    int &verbose=ctxt.verbose;
+    int &wO=ctxt.wO;
+    int &wI=ctxt.wI;
+    int &groupSize=ctxt.groupSize;
 
-    urng.seed(time(0));
+    ctxt.urng.seed(time(0));
 
     try {
 
@@ -57,15 +56,9 @@ int main(int argc, char *argv[])
                 ia += 2;
             } else if (!strcmp(argv[ia], "--wa")) {
                 if ((argc - ia) < 2) throw std::runtime_error("No argument to --wa");
-                wA = atoi(argv[ia + 1]);
-                if (wA < 1) throw std::runtime_error("Can't have wa < 1");
-                if (wA > 12) throw std::runtime_error("wa > 12 is unexpectedly large (edit code if you are sure).");
-                ia += 2;
-            } else if (!strcmp(argv[ia], "--wo")) {
-                if ((argc - ia) < 2) throw std::runtime_error("No argument to --wo");
-                wO = atoi(argv[ia + 1]);
-                if (wO < 1) throw std::runtime_error("Can't have wo < 1");
-                if (wO > 16) throw std::runtime_error("wo > 16 is unexpectedly large (edit code if you are sure).");
+                ctxt.wA = atoi(argv[ia + 1]);
+                if (ctxt.wA < 1) throw std::runtime_error("Can't have wa < 1");
+                if (ctxt.wA > 12) throw std::runtime_error("wa > 12 is unexpectedly large (edit code if you are sure).");
                 ia += 2;
             } else if (!strcmp(argv[ia], "--wo")) {
                 if ((argc - ia) < 2) throw std::runtime_error("No argument to --wo");
@@ -80,8 +73,13 @@ int main(int argc, char *argv[])
                 ia += 2;
             } else if (!strcmp(argv[ia], "--max-time")) {
                 if ((argc - ia) < 2) throw std::runtime_error("No argument to --max-time");
-                maxTime = strtod(argv[ia + 1], 0);
-                if (maxTime <= 0) throw std::runtime_error("Can't have maxTime<=0");
+                ctxt.maxTime = strtod(argv[ia + 1], 0);
+                if (ctxt.maxTime <= 0) throw std::runtime_error("Can't have maxTime<=0");
+                ia += 2;
+            } else if (!strcmp(argv[ia], "--tabu-tenure")) {
+                if ((argc - ia) < 2) throw std::runtime_error("No argument to --tabu-tenure");
+                ctxt.tabuTenure = atoi(argv[ia + 1]);
+                if (ctxt.tabuTenure < 1) throw std::runtime_error("tabu-tenure must be at least 1");
                 ia += 2;
             } else {
                 throw std::runtime_error(std::string("Didn't understand argument ") + argv[ia]);
@@ -140,148 +138,19 @@ int main(int argc, char *argv[])
                     ((1 << wO)*groupSize) << " = " << problem.keys_size_distinct() / (double) (1 << wO) << "\n";
         }
 
-        std::uniform_real_distribution<> udist;
-
-        std::vector<BitHash> solBest(1, makeBitHashConcrete(urng, wO, wI, wA));
-        double eBest=evalSolution(solBest[0], problem, groupSize);
-
-        int tries = 0;
-        int triesAtLevel = 10000;
-
-        BitHash solCurr=solBest[0];
-        EntryToKey manipCurr(solCurr, problem);
-
-        typedef bit_signature_table<0> sig0_t;
-        typedef bit_signature_table<1> sig1_t;
-        typedef bit_signature_table<2> sig2_t;
-        typedef bit_sig_multi<sig0_t,bit_sig_multi<sig1_t,sig2_t> > sig_t;
-
-        unsigned maxNaboo=1<<16;
-        bit_sig_multi_set<sig_t> nabooSet(22);
-        std::queue<sig_t> nabooQueue;
-
-
-        auto isNaboo=[&](const sig_t &base, unsigned flip) -> bool
-        {
-            return nabooSet.contains_with_flip(base, flip);
-        };
-
-        auto addNaboo=[&](const sig_t &base)
-        {
-            if(nabooQueue.size()>maxNaboo){
-                nabooSet.remove(nabooQueue.front());
-                nabooQueue.pop();
-            }
-            nabooSet.add(base);
-            nabooQueue.push(base);
-        };
-
-
-        while (eBest!=0 && tries < maxTries) {
-            double ePrev=manipCurr.eval(groupSize);
-
-            sig_t sig=toSignature<sig_t>(manipCurr);
+        ctxt.startTime=cpuTime();
 
-            double eBestLocal=ePrev*1e6;
-            std::vector<int> flipBestLocal;
-
-            int allowed=0;
-            for(int i=0;i<manipCurr.bitCount();i++){
-                //auto sigNext(sig);
-                //sigNext.flip(i);
-                //std::cerr<<"   try "<<sigNext.str()<<", contained = "<<nabooSet.contains(sigNext)<<" \n";
-                //if(!nabooSet.contains(sigNext)){
-                if(!nabooSet.contains_with_flip(sig,i)){
-                    ++allowed;
-                    manipCurr.flipBit(i);
-
-                    double eCurr=manipCurr.eval(groupSize);
-                    if(eCurr<eBestLocal){
-                        flipBestLocal.clear();
-                    }
-                    if(eCurr<=eBestLocal){
-                        eBestLocal=eCurr;
-                        flipBestLocal.push_back(i);
-                    }
-
-                    manipCurr.flipBit(i);
-                }
-            }
-
-            //if(verbose>1){
-            //    std::cerr<<"   allowed = "<<allowed<<", naboo= "<<nabooQueue.size()<<"\n";
-            //}
-
-            if(flipBestLocal.size()==0){
-                std::cerr<<"  out of moves...\n";
-                exit(1);
-            }
-
-            int flip=flipBestLocal[urng()%flipBestLocal.size()];
-            manipCurr.flipBit(flip);
-            double eCurr=manipCurr.eval(groupSize);
-            sig.flip(flip);
-
-            addNaboo(sig);
-            //std::cerr<<"  naboo includes : "<<sig.str()<<"\n";
-
-
-            if(verbose>2){
-                std::cerr<<"    Try: "<<tries<<", e = "<<eCurr<<"\n";
-            }
-
-
-            if(eCurr <= eBest) {
-                eCurr = manipCurr.eval(groupSize);
-
-                if(eCurr < eBest) {
-                    if (verbose > 1) {
-                        std::cerr << "    Try: " << tries << ", New eBest = " << eBest << "\n";
-                    }
-                    solBest.clear();
-                    solBest.push_back(solCurr);
-                }else{
-                    bool hit=false;
-                    for(const auto &x : solBest){
-                        if(x==solCurr){
-                            hit=true;
-                            break;
-                        }
-                    }
-                    if(!hit) {
-                        if(solBest.size()>0){
-                            solBest.erase(solBest.begin());
-                        }
-                        solBest.push_back(solCurr);
-                    }
-                }
-                eBest = eCurr;
-            }
-
-            tries++;
-
-            if(udist(urng)<0.001){
-                solCurr=solBest[urng()%solBest.size()];
-                manipCurr.sync();
-            }
-
-            if(0==(tries%triesAtLevel)){
-                if (verbose > 1) {
-                    std::cerr << "    Try: " << tries << ", eBest = " << eBest << ", nBest = "<<solBest.size()<<", ePrev = " << ePrev <<", naboo=2^"<<log2(nabooQueue.size())<<"\n";
-                }
-
-
-
-                // cpuTime() is really expensive in OS X
-                if(cpuTime() > maxTime)
-                    break;
-            }
+        BitHash result;
+        bool success;
+        std::tie(result, success)=solver_tabu(ctxt, problem);
 
+        ctxt.logMsg(0, success?"Success\n":"OutOfAttempts\n");
 
+        if (!success) {
+            exit(1);
         }
 
-
-        solBest[0].print(std::cout);
+        result.print(std::cout);
         problem.print(std::cout);
     }catch(std::exception &e){
         std::cerr<<"Caught exception : ";
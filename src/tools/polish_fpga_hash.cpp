@@ -27,6 +27,7 @@ int main(int argc, char *argv[])
     std::string dstFileName="-";
     std::string name="perfect";
     bool writeTest=false;
+    bool expandCore=false;
 
     std::mt19937 rng;
 
@@ -42,6 +43,9 @@ int main(int argc, char *argv[])
                 if ((argc - ia) < 2) throw std::runtime_error("No argument to --input");
                 srcFileName = argv[ia + 1];
                 ia += 2;
+            } else if (!strcmp(argv[ia], "--expand-core")) {
+                expandCore=true;
+                ia++;
             } else {
                 throw std::runtime_error(std::string("Didn't understand argument ") + argv[ia]);
             }
@@ -71,7 +75,7 @@ int main(int argc, char *argv[])
             std::cerr << "wValue = " << problem.getValueWidth() << "\n";
         }
 
-        solution=bit_hash_polish(rng, solution, problem, verbose);
+        solution=bit_hash_polish(rng, solution, problem, verbose, expandCore);
 
 
         std::ofstream dstFile;
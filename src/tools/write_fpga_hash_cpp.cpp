@@ -1,5 +1,11 @@
 #include "bit_hash.hpp"
 #include "bit_hash_cpp.hpp"
+#include "two_level_hash_cpp.hpp"
+#include "family_hash_cpp.hpp"
+#include "concentrated_hash_cpp.hpp"
+#include "partitioned_hash_cpp.hpp"
+#include "linear_hash_cpp.hpp"
+#include "cuckoo_hash_cpp.hpp"
 
 #include "key_value_set.hpp"
 
@@ -8,6 +14,7 @@
 #include <set>
 #include <fstream>
 #include <cstring>
+#include <sstream>
 
 void print_exception(const std::exception& e, int level =  0)
 {
@@ -19,6 +26,17 @@ void print_exception(const std::exception& e, int level =  0)
     } catch(...) {}
 }
 
+//! Everything after the hash function itself, which is the same for every kind of hash
+template<class THash>
+void write_cpp_wrappers(const THash &h, const key_value_set &problem, std::string name, bool writeTest, std::ostream &dst, unsigned groupSize)
+{
+    write_cpp_hit(h, problem, name, "", dst, groupSize);
+    write_cpp_lookup(h, problem, name, "", dst, groupSize);
+    if(writeTest) {
+        write_cpp_test(h, problem, name, "", dst);
+    }
+}
+
 int main(int argc, char *argv[])
 {
     int verbose=2;
@@ -27,6 +45,9 @@ int main(int argc, char *argv[])
     std::string dstFileName="-";
     std::string name="perfect";
     bool writeTest=false;
+    // Not persisted with the hash, so these have to match the solve
+    unsigned groupSize=1;
+    unsigned maxStash=0;
 
     try {
 
@@ -43,6 +64,15 @@ int main(int argc, char *argv[])
             } else if (!strcmp(argv[ia], "--write-test")) {
                 writeTest=true;
                 ia++;
+            } else if (!strcmp(argv[ia], "--group-size")) {
+                if ((argc - ia) < 2) throw std::runtime_error("No argument to --group-size");
+                groupSize = atoi(argv[ia + 1]);
+                if (groupSize < 1) throw std::runtime_error("Can't have groupSize < 1");
+                ia += 2;
+            } else if (!strcmp(argv[ia], "--stash")) {
+                if ((argc - ia) < 2) throw std::runtime_error("No argument to --stash");
+                maxStash = atoi(argv[ia + 1]);
+                ia += 2;
             } else {
                 throw std::runtime_error(std::string("Didn't understand argument ") + argv[ia]);
             }
@@ -53,17 +83,51 @@ int main(int argc, char *argv[])
         }
 
         BitHash solution;
+        TwoLevelHash twoLevel;
+        FamilyHash family;
+        ConcentratedHash concentrated;
+        PartitionedHash partitioned;
+        LinearHash linear;
+        CuckooHash cuckoo;
+        std::string kind;
         key_value_set problem;
 
+        // A BitHash or ConcentratedHash (from find_fpga_hash), LinearHash (from
+        // find_linear_hash or find_fpga_hash), TwoLevelHash (from
+        // find_two_level_hash), FamilyHash (from find_family_hash),
+        // PartitionedHash (from find_partitioned_hash) or CuckooHash (from
+        // find_cuckoo_hash), told apart by the first word
+        auto parse=[&](std::istream &in)
+        {
+            std::stringstream src;
+            src<<in.rdbuf();
+            std::istringstream(src.str())>>kind;
+            if(kind=="TwoLevelHashBegin"){
+                twoLevel = parse_two_level_hash(src);
+            }else if(kind=="FamilyHashBegin"){
+                family = parse_family_hash(src);
+            }else if(kind=="ConcentratedHashBegin"){
+                concentrated = parse_concentrated_hash(src);
+            }else if(kind=="PartitionedHashBegin"){
+                partitioned = parse_partitioned_hash(src);
+            }else if(kind=="LinearHashBegin"){
+                linear = parse_linear_hash(src);
+            }else if(kind=="CuckooHashBegin"){
+                cuckoo = parse_cuckoo_hash(src);
+            }else{
+                solution = parse_bit_hash(src);
+            }
+            problem = parse_key_value_set(src);
+            problem.setMaxStash(maxStash);
+        };
+
         if (srcFileName == "-") {
-            solution = parse_bit_hash(std::cin);
-            problem = parse_key_value_set(std::cin);
+            parse(std::cin);
         } else {
             std::ifstream srcFile(srcFileName);
             if (!srcFile.is_open())
                 throw std::runtime_error("Couldn't open source file " + srcFileName);
-            solution = parse_bit_hash(srcFile);
-            problem = parse_key_value_set(srcFile);
+            parse(srcFile);
         }
 
         if (verbose > 1) {
@@ -85,11 +149,35 @@ int main(int argc, char *argv[])
         }
         std::ostream &dst = dstFile.is_open() ? dstFile : std::cout;
 
-        write_cpp_hash(solution, name, "", dst);
-        write_cpp_hit(solution, problem, name, "", dst);
-        write_cpp_lookup(solution, problem, name, "", dst);
-        if(writeTest) {
-            write_cpp_test(solution, problem, name, "", dst);
+        if(kind=="TwoLevelHashBegin"){
+            write_cpp_two_level_hash(twoLevel, name, "", dst);
+            write_cpp_wrappers(twoLevel, problem, name, writeTest, dst, groupSize);
+        }else if(kind=="FamilyHashBegin"){
+            write_cpp_family_hash(family, name, "", dst);
+            write_cpp_wrappers(family, problem, name, writeTest, dst, groupSize);
+        }else if(kind=="ConcentratedHashBegin"){
+            write_cpp_concentrated_hash(concentrated, name, "", dst);
+            write_cpp_wrappers(concentrated, problem, name, writeTest, dst, groupSize);
+        }else if(kind=="PartitionedHashBegin"){
+            write_cpp_partitioned_hash(partitioned, name, "", dst);
+            write_cpp_wrappers(partitioned, problem, name, writeTest, dst, groupSize);
+        }else if(kind=="LinearHashBegin"){
+            write_cpp_linear_hash(linear, name, "", dst);
+            write_cpp_wrappers(linear, problem, name, writeTest, dst, groupSize);
+        }else if(kind=="CuckooHashBegin"){
+            if(groupSize>1)
+                throw std::runtime_error("Cuckoo hashes only support a group size of 1.");
+            // Two banks are probed, so the hit is custom, but the rest only needs a slot per key
+            write_cpp_cuckoo_hash(cuckoo, name, "", dst);
+            CuckooLookup lookup(cuckoo, problem);
+            write_cpp_cuckoo_hit(lookup, problem, name, "", dst);
+            write_cpp_lookup(lookup, problem, name, "", dst);
+            if(writeTest) {
+                write_cpp_test(lookup, problem, name, "", dst);
+            }
+        }else{
+            write_cpp_hash(solution, name, "", dst);
+            write_cpp_wrappers(solution, problem, name, writeTest, dst, groupSize);
         }
     }catch(std::exception &e){
         std::cerr<<"Caught exception : ";